@@ -0,0 +1,125 @@
+/*
+** rgssad-bench.cpp
+**
+** This file is part of HiddenChest
+*/
+
+/* Times RGSSAD decryption of a buffer the way it used to work,
+ * advancing the magic one dword at a time, against xorMagic's
+ * four lanes, and seeking by jumpMagic against advancing the
+ * magic up to the sought dword. Every result is checked
+ * against the serial one.
+ *
+ * Usage: rgssad-bench [buffer size in MB] */
+
+#include "rgssadmagic.h"
+
+#include <chrono>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const int rounds = 20;
+static const uint32_t startMagic = 0xDEADCAFE;
+
+typedef std::chrono::steady_clock Clock;
+
+static double msSince(Clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static uint32_t serialXor(uint32_t *dwords, uint64_t count, uint32_t magic)
+{
+  for (uint64_t i = 0; i < count; ++i)
+    dwords[i] ^= advanceMagic(magic);
+  return magic;
+}
+
+/* Decrypts in 'chunks' pieces, each jumping to its own start,
+ * like reads split across threads do */
+static uint32_t chunkedXor(uint32_t *dwords, uint64_t count, uint32_t magic, int chunks)
+{
+  for (int i = 0; i < chunks; ++i) {
+    const uint64_t start = count * i / chunks;
+    xorMagic(dwords + start, count * (i+1) / chunks - start, jumpMagic(magic, start));
+  }
+  return jumpMagic(magic, count);
+}
+
+static bool check(const char *what, const std::vector<uint32_t> &result,
+                  const std::vector<uint32_t> &expected,
+                  uint32_t magic, uint32_t expectedMagic)
+{
+  if (result == expected && magic == expectedMagic) return true;
+  fprintf(stderr, "%s: output differs from the serial loop\n", what);
+  return false;
+}
+
+int main(int argc, char *argv[])
+{
+  const int mb = argc > 1 ? atoi(argv[1]) : 4;
+  if (mb <= 0) {
+    fprintf(stderr, "Usage: rgssad-bench [buffer size in MB]\n");
+    return 1;
+  }
+  /* Odd dword count, so the tail after the lanes gets used too */
+  const uint64_t count = (uint64_t) mb * 1024 * 1024 / 4 - 3;
+  std::vector<uint32_t> source(count);
+  srand(1);
+  for (uint64_t i = 0; i < count; ++i)
+    source[i] = (uint32_t) rand() * 2654435761u;
+  std::vector<uint32_t> expected(source), buffer;
+  const uint32_t expectedMagic = serialXor(&expected[0], count, startMagic);
+  bool ok = true;
+  double serialMs = 0, laneMs = 0, chunkMs = 0;
+  for (int r = 0; r < rounds; ++r) {
+    buffer = source;
+    Clock::time_point start = Clock::now();
+    uint32_t magic = serialXor(&buffer[0], count, startMagic);
+    serialMs += msSince(start);
+    ok &= check("serial", buffer, expected, magic, expectedMagic);
+
+    buffer = source;
+    start = Clock::now();
+    magic = xorMagic(&buffer[0], count, startMagic);
+    laneMs += msSince(start);
+    ok &= check("xorMagic", buffer, expected, magic, expectedMagic);
+
+    buffer = source;
+    start = Clock::now();
+    magic = chunkedXor(&buffer[0], count, startMagic, 4);
+    chunkMs += msSince(start);
+    ok &= check("jumpMagic chunks", buffer, expected, magic, expectedMagic);
+  }
+  /* Seeking to every 4096th dword of the buffer */
+  const uint64_t seekStep = 4096;
+  std::vector<uint32_t> advanced, jumped;
+  Clock::time_point start = Clock::now();
+  for (uint64_t off = 0; off < count; off += seekStep) {
+    uint32_t magic = startMagic;
+    for (uint64_t i = 0; i < off; ++i)
+      advanceMagic(magic);
+    advanced.push_back(magic);
+  }
+  const double advanceMs = msSince(start);
+  start = Clock::now();
+  for (uint64_t off = 0; off < count; off += seekStep)
+    jumped.push_back(jumpMagic(startMagic, off));
+  const double jumpMs = msSince(start);
+  if (jumped != advanced) {
+    fprintf(stderr, "jumpMagic: seek results differ from advancing\n");
+    ok = false;
+  }
+  const double bytes = count * 4.0;
+  printf("%d MB, %d rounds\n", mb, rounds);
+  printf("serial loop:          %8.3f ms  %7.1f MB/s\n", serialMs / rounds,
+         bytes * rounds / serialMs / 1000);
+  printf("xorMagic (4 lanes):   %8.3f ms  %7.1f MB/s\n", laneMs / rounds,
+         bytes * rounds / laneMs / 1000);
+  printf("jumpMagic, 4 chunks:  %8.3f ms  %7.1f MB/s\n", chunkMs / rounds,
+         bytes * rounds / chunkMs / 1000);
+  printf("%u seeks: advancing %.3f ms, jumpMagic %.3f ms\n",
+         (unsigned) jumped.size(), advanceMs, jumpMs);
+  return ok ? 0 : 1;
+}
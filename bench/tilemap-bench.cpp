@@ -0,0 +1,105 @@
+/*
+** tilemap-bench.cpp
+**
+** This file is part of HiddenChest
+*/
+
+/* Times the generation of XP tilemap vertices, the way Tilemap
+ * fills its buffers, for a 40x30 map viewport panned across
+ * real map data. Map and priorities tables are read from files
+ * holding their marshal data, which can be written like this:
+ *
+ *   map = load_data("Data/Map001.rxdata")
+ *   File.binwrite("map.table", map.data._dump(-1))
+ *   tileset = load_data("Data/Tilesets.rxdata")[map.tileset_id]
+ *   File.binwrite("prio.table", tileset.priorities._dump(-1))
+ *
+ * Usage: tilemap-bench map.table [prio.table] [tileset height]
+ * Without any map file a randomly filled 100x100 map is used. */
+
+#include "tileatlas.h"
+#include "table.h"
+#include "exception.h"
+
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const int viewW = 40;
+static const int viewH = 30;
+static const int rounds = 2000;
+
+static Table *readTable(const char *path)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    exit(1);
+  }
+  std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                          std::istreambuf_iterator<char>());
+  try {
+    return Table::deserialize(data.empty() ? 0 : &data[0], data.size());
+  } catch (const Exception &e) {
+    fprintf(stderr, "%s: %s\n", path, e.msg.c_str());
+    exit(1);
+  }
+}
+
+static Table *randomMap()
+{
+  Table *map = new Table(100, 100, 3);
+  srand(1);
+  for (int z = 0; z < 3; ++z)
+    for (int y = 0; y < 100; ++y)
+      for (int x = 0; x < 100; ++x)
+        map->set(z == 0 || rand() % 4 == 0 ? 48 + rand() % 400 : 0, x, y, z);
+  return map;
+}
+
+int main(int argc, char *argv[])
+{
+  Table *map = argc > 1 ? readTable(argv[1]) : randomMap();
+  Table *priorities = argc > 2 ? readTable(argv[2]) : 0;
+  /* Tall enough for every tile id of a stock tileset */
+  int tilesetH = argc > 3 ? atoi(argv[3]) : 32 * 256;
+  tilesetH -= tilesetH % 32;
+  Vec2i atlasSize = TileAtlas::minSize(tilesetH, 16384);
+  if (atlasSize.x < 0) {
+    fprintf(stderr, "Tileset too tall for the atlas\n");
+    return 1;
+  }
+  TileAtlas::QuadTemplates templates;
+  templates.build(tilesetH, atlasSize.y, priorities);
+  std::vector<TileAtlas::TileRef> refs;
+  std::vector<SVertex> vert;
+  size_t quads = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; ++i) {
+    /* Pan diagonally, so runs get split at the map edges too */
+    const IntRect rect(i % map->xSize(), (i / 3) % map->ySize(), viewW, viewH);
+    TileAtlas::collectTiles(templates, *map, rect, refs);
+    size_t count = 0;
+    for (size_t j = 0; j < refs.size(); ++j)
+      count += refs[j].quads;
+    vert.resize(count * 4);
+    SVertex *dst = vert.empty() ? 0 : &vert[0];
+    for (size_t j = 0; j < refs.size(); ++j) {
+      templates.emit(refs[j].id, refs[j].x * 32, refs[j].y * 32, dst);
+      dst += refs[j].quads * 4;
+    }
+    quads += count;
+  }
+  std::chrono::steady_clock::duration time = std::chrono::steady_clock::now() - start;
+  const double ns = std::chrono::duration<double, std::nano>(time).count();
+  printf("map %dx%dx%d, viewport %dx%d, %d rounds\n",
+         map->xSize(), map->ySize(), map->zSize(), viewW, viewH, rounds);
+  printf("%.1f quads per viewport\n", (double) quads / rounds);
+  printf("%.2f ns per tile, %.1f us per viewport\n",
+         ns / ((double) rounds * viewW * viewH), ns / rounds / 1000);
+  delete priorities;
+  delete map;
+  return 0;
+}
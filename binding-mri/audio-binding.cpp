@@ -25,6 +25,7 @@
 #include "exception.h"
 #include "binding-util.h"
 #include "filesystem.h"
+#include "soundemitter.h"
 
 static VALUE audio_bgmPlay(int argc, VALUE* argv, VALUE self)
 {
@@ -180,6 +181,20 @@ static VALUE audio_seStop(VALUE self)
   return Qnil;
 }
 
+/* Starts decoding the given sound effects in the background,
+ * so playing them later on doesn't have to wait for it */
+static VALUE audio_se_preload(VALUE self, VALUE list)
+{
+  if (!RB_TYPE_P(list, RUBY_T_ARRAY))
+    list = rb_ary_new3(1, list);
+  for (long i = 0; i < RARRAY_LEN(list); ++i) {
+    VALUE name = rb_ary_entry(list, i);
+    const char *filename = StringValueCStr(name);
+    GUARD_EXC( shState->audio().sePreload(filename); )
+  }
+  return Qnil;
+}
+
 static VALUE audio_mePlay(int argc, VALUE* argv, VALUE self)
 {
   const char *filename;
@@ -226,6 +241,43 @@ static VALUE audioSetupMidi(VALUE self)
   return Qnil;
 }
 
+static VALUE audio_stream_latency(Audio::StreamId stream)
+{
+  unsigned int last, max;
+  shState->audio().fillLatency(stream, last, max);
+  return rb_ary_new3(2, UINT2NUM(last), UINT2NUM(max));
+}
+
+/* Wakeups of the audio service thread and the latest
+ * and worst buffer refill latency of every stream in ms */
+static VALUE audio_service_stats(VALUE self)
+{
+  VALUE hash = rb_hash_new();
+  rb_hash_aset(hash, ID2SYM(rb_intern("wakeups")),
+               UINT2NUM(shState->audio().serviceWakeups()));
+  rb_hash_aset(hash, ID2SYM(rb_intern("bgm")), audio_stream_latency(Audio::BGM));
+  rb_hash_aset(hash, ID2SYM(rb_intern("bgs")), audio_stream_latency(Audio::BGS));
+  rb_hash_aset(hash, ID2SYM(rb_intern("me")), audio_stream_latency(Audio::ME));
+  return hash;
+}
+
+/* Sound effect cache counters, for tuning SE.cacheSize
+ * and SE.pinPlays */
+static VALUE audio_se_cache_stats(VALUE self)
+{
+  SECacheStats stats;
+  shState->audio().seCacheStats(stats);
+  VALUE hash = rb_hash_new();
+  rb_hash_aset(hash, ID2SYM(rb_intern("hits")), UINT2NUM(stats.hits));
+  rb_hash_aset(hash, ID2SYM(rb_intern("misses")), UINT2NUM(stats.misses));
+  rb_hash_aset(hash, ID2SYM(rb_intern("evictions")), UINT2NUM(stats.evictions));
+  rb_hash_aset(hash, ID2SYM(rb_intern("count")), UINT2NUM(stats.count));
+  rb_hash_aset(hash, ID2SYM(rb_intern("pinned")), UINT2NUM(stats.pinned));
+  rb_hash_aset(hash, ID2SYM(rb_intern("bytes")), UINT2NUM(stats.bytes));
+  rb_hash_aset(hash, ID2SYM(rb_intern("capacity")), UINT2NUM(stats.capacity));
+  return hash;
+}
+
 static VALUE audioReset(VALUE self)
 {
   shState->audio().reset();
@@ -466,5 +518,8 @@ void audioBindingInit()
     rb_define_module_function(md, "setup_midi", RMF(audioSetupMidi), 0);
   rb_define_module_function(md, "se_play", RMF(audio_sePlay), -1);
   rb_define_module_function(md, "se_stop", RMF(audio_seStop), 0);
+  rb_define_module_function(md, "se_preload", RMF(audio_se_preload), 1);
+  rb_define_module_function(md, "service_stats", RMF(audio_service_stats), 0);
+  rb_define_module_function(md, "se_cache_stats", RMF(audio_se_cache_stats), 0);
   rb_define_module_function(md, "__reset__", RMF(audioReset), 0);
 }
@@ -23,6 +23,8 @@
 #include "font.h"
 #include "exception.h"
 #include "sharedstate.h"
+#include "textcache.h"
+#include "texpool.h"
 #include "disposable-binding.h"
 #include "binding-util.h"
 #include "binding-types.h"
@@ -237,10 +239,12 @@ static VALUE bitmap_turn_sepia(VALUE self)
   return self;
 }
 
-static VALUE bitmap_pixelate(VALUE self)
+static VALUE bitmap_pixelate(int argc, VALUE *argv, VALUE self)
 {
   Bitmap *b = getPrivateData<Bitmap>(self);
-  GUARD_EXC( b->pixelate(); );
+  int size = 4;
+  rb_get_args(argc, argv, "|i", &size RB_ARG_END);
+  GUARD_EXC( b->pixelate(size); );
   return self;
 }
 
@@ -446,6 +450,115 @@ static VALUE bitmapSnowFillRect(VALUE self)
   return self;
 }
 
+/* Each entry is either an effect name or an array holding
+ * the name followed by its arguments, eg. [:hue, 90] */
+static BitmapEffect parse_effect(VALUE entry)
+{
+  VALUE name = entry;
+  long argc = 0;
+  if (RB_TYPE_P(entry, T_ARRAY)) {
+    argc = RARRAY_LEN(entry) - 1;
+    name = rb_ary_entry(entry, 0);
+  }
+  Check_Type(name, T_SYMBOL);
+  ID id = SYM2ID(name);
+  float args[4] = { 0, 0, 0, 0 };
+  for (long i = 0; i < argc && i < 4; ++i) {
+    VALUE arg = rb_ary_entry(entry, i + 1);
+    if (rb_typeddata_is_kind_of(arg, &ToneType)) {
+      Tone *t = getPrivateDataCheck<Tone>(arg, ToneType);
+      args[0] = t->red / 255.0f;
+      args[1] = t->green / 255.0f;
+      args[2] = t->blue / 255.0f;
+      args[3] = t->gray / 255.0f;
+      break;
+    }
+    args[i] = NUM2DBL(arg);
+  }
+  if (id == rb_intern("gray"))
+    return BitmapEffect(BitmapEffect::Gray, argc > 0 ? args[0] : 1);
+  if (id == rb_intern("sepia"))
+    return BitmapEffect(BitmapEffect::Sepia);
+  if (id == rb_intern("hue"))
+    return BitmapEffect(BitmapEffect::Hue, args[0]);
+  if (id == rb_intern("tone")) {
+    // Plain numbers are given in the usual Tone ranges
+    if (argc > 0 && !rb_typeddata_is_kind_of(rb_ary_entry(entry, 1), &ToneType))
+      for (int i = 0; i < 4; ++i)
+        args[i] /= 255.0f;
+    return BitmapEffect(BitmapEffect::Tone, args[0], args[1], args[2], args[3]);
+  }
+  if (id == rb_intern("invert"))
+    return BitmapEffect(BitmapEffect::Invert);
+  if (id == rb_intern("blur"))
+    return BitmapEffect(BitmapEffect::Blur);
+  if (id == rb_intern("radial_blur"))
+    return BitmapEffect(BitmapEffect::RadialBlur, args[0], args[1]);
+  if (id == rb_intern("pixelate"))
+    return BitmapEffect(BitmapEffect::Pixelate, argc > 0 ? args[0] : 4);
+  rb_raise(rb_eArgError, "unknown bitmap effect :%s", rb_id2name(id));
+  return BitmapEffect(BitmapEffect::Invert);
+}
+
+/* Owns the vector in a frame of its own, so raising the Ruby
+ * exception afterwards never skips its destructor */
+static void apply_effects(Bitmap *b, const BitmapEffect *parsed, long count)
+{
+  std::vector<BitmapEffect> effects(parsed, parsed + count);
+  b->applyEffects(effects);
+}
+
+static VALUE bitmap_apply_effects(VALUE self, VALUE list)
+{
+  Bitmap *b = getPrivateData<Bitmap>(self);
+  Check_Type(list, T_ARRAY);
+  /* parse_effect may raise, so the effects are collected in
+   * a Ruby string, which the GC reclaims either way */
+  const long count = RARRAY_LEN(list);
+  VALUE buffer = rb_str_new(0, count * sizeof(BitmapEffect));
+  for (long i = 0; i < count; ++i) {
+    BitmapEffect effect = parse_effect(rb_ary_entry(list, i));
+    memcpy(RSTRING_PTR(buffer) + i * sizeof(BitmapEffect), &effect, sizeof(effect));
+  }
+  const BitmapEffect *parsed = reinterpret_cast<const BitmapEffect*>(RSTRING_PTR(buffer));
+  GUARD_EXC( apply_effects(b, parsed, count); );
+  RB_GC_GUARD(buffer);
+  return self;
+}
+
+static VALUE bitmap_prefetch(int argc, VALUE *argv, VALUE self)
+{
+  Bitmap *b = getPrivateData<Bitmap>(self);
+  IntRect area;
+  if (argc == 0) {
+    GUARD_EXC( area = b->rect(); );
+  } else if (argc == 1) {
+    VALUE rectObj;
+    rb_get_args(argc, argv, "o", &rectObj RB_ARG_END);
+    area = getPrivateDataCheck<Rect>(rectObj, RectType)->toIntRect();
+  } else {
+    int x, y, width, height;
+    rb_get_args(argc, argv, "iiii", &x, &y, &width, &height RB_ARG_END);
+    area = IntRect(x, y, width, height);
+  }
+  GUARD_EXC( b->prefetch(area); );
+  return self;
+}
+
+static VALUE bitmap_text_cache_stats(VALUE self)
+{
+  TextCache &cache = shState->textCache();
+  return rb_ary_new3(3, ULONG2NUM(cache.hits()), ULONG2NUM(cache.misses()),
+                     INT2NUM(cache.size()));
+}
+
+static VALUE bitmap_texture_pool_stats(VALUE self)
+{
+  TexPoolStats stats = shState->texPool().stats();
+  return rb_ary_new3(4, ULONG2NUM(stats.hits), ULONG2NUM(stats.misses),
+                     ULONG2NUM(stats.evictions), UINT2NUM(stats.residentBytes));
+}
+
 #define RMF(func) ((VALUE (*)(ANYARGS))(func))
 
 void bitmapBindingInit()
@@ -467,12 +580,14 @@ void bitmapBindingInit()
   rb_define_method(klass, "clear", RMF(bitmapClear), 0);
   rb_define_method(klass, "alpha_pixel?", RMF(bitmap_is_alpha_pixel), 2);
   rb_define_method(klass, "get_pixel", RMF(bitmapGetPixel), 2);
+  rb_define_method(klass, "prefetch", RMF(bitmap_prefetch), -1);
   rb_define_method(klass, "set_pixel", RMF(bitmapSetPixel), -1);
   rb_define_method(klass, "hue_change", RMF(bitmapHueChange), 1);
   rb_define_method(klass, "gray_out", RMF(bitmap_gray_out), 0),
   rb_define_method(klass, "turn_sepia", RMF(bitmap_turn_sepia), 0);
-  rb_define_method(klass, "pixelate", RMF(bitmap_pixelate), 0);
+  rb_define_method(klass, "pixelate", RMF(bitmap_pixelate), -1);
   rb_define_method(klass, "invert!", RMF(bitmap_invert), 0);
+  rb_define_method(klass, "apply_effects", RMF(bitmap_apply_effects), 1);
   rb_define_method(klass, "draw_text", RMF(bitmapDrawText), -1);
   rb_define_method(klass, "text_size", RMF(bitmapTextSize), -1);
   rb_define_method(klass, "text_width", RMF(bitmapTextWidth), -1);
@@ -485,4 +600,6 @@ void bitmapBindingInit()
   rb_define_method(klass, "radial_blur", RMF(bitmapRadialBlur), 2);
   rb_define_method(klass, "font", RMF(bitmapGetFont), 0);
   rb_define_method(klass, "font=", RMF(bitmapSetFont), 1);
+  rb_define_singleton_method(klass, "text_cache_stats", RMF(bitmap_text_cache_stats), 0);
+  rb_define_singleton_method(klass, "texture_pool_stats", RMF(bitmap_texture_pool_stats), 0);
 }
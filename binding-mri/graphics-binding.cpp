@@ -22,6 +22,7 @@
 
 #include "hcextras.h"
 #include "graphics.h"
+#include "profiler.h"
 #include "sharedstate.h"
 #include "binding-util.h"
 #include "binding-types.h"
@@ -210,6 +211,42 @@ static VALUE graphicsSetFrameCount(VALUE self, VALUE num)
   return rb_fix_new(shState->graphics().getFrameCount());
 }
 
+static VALUE graphics_frame_times(VALUE self)
+{
+  std::vector<float> times;
+  shState->graphics().frame_times(times);
+  VALUE ary = rb_ary_new2(times.size());
+  for (size_t i = 0; i < times.size(); ++i)
+    rb_ary_push(ary, rb_float_new(times[i]));
+  return ary;
+}
+
+static VALUE graphics_draw_calls(VALUE self)
+{
+  return UINT2NUM(shState->graphics().draw_calls());
+}
+
+static VALUE profile_ms(float ms)
+{
+  return ms < 0 ? Qnil : rb_float_new(ms);
+}
+
+/* Section name => [CPU ms, GPU ms] of the latest profiled
+ * frame, nil if the profiler is disabled */
+static VALUE graphics_profile(VALUE self)
+{
+  const Profiler &profiler = shState->graphics().profiler();
+  if (!profiler.enabled()) return Qnil;
+  VALUE hash = rb_hash_new();
+  for (int i = 0; i < Profiler::SectionCount; ++i) {
+    Profiler::Section section = (Profiler::Section) i;
+    VALUE times = rb_ary_new3(2, profile_ms(profiler.cpuTime(section)),
+                                 profile_ms(profiler.gpuTime(section)));
+    rb_hash_aset(hash, ID2SYM(rb_intern(Profiler::sectionName(section))), times);
+  }
+  return hash;
+}
+
 static VALUE graphicsGetBrightness(VALUE self)
 {
   return rb_fix_new(shState->graphics().getBrightness());
@@ -292,6 +329,9 @@ void graphicsBindingInit()
   rb_define_module_function(module, "frame_rate=", RMF(graphicsSetFrameRate), 1);
   rb_define_module_function(module, "frame_count", RMF(graphicsGetFrameCount), 0);
   rb_define_module_function(module, "frame_count=", RMF(graphicsSetFrameCount), 1);
+  rb_define_module_function(module, "frame_times", RMF(graphics_frame_times), 0);
+  rb_define_module_function(module, "draw_calls", RMF(graphics_draw_calls), 0);
+  rb_define_module_function(module, "profile", RMF(graphics_profile), 0);
   rb_define_module_function(module, "width", RMF(graphicsWidth), 0);
   rb_define_module_function(module, "height", RMF(graphicsHeight), 0);
   rb_define_module_function(module, "dimensions", RMF(graphics_dimensions), 0);
@@ -577,6 +577,60 @@ static VALUE SpriteisMouseAboveColorFound(VALUE self)
   return s->isMouseAboveColorFound() ? Qtrue : Qfalse;
 }
 
+static VALUE sprite_pixel_hit(VALUE self, VALUE x, VALUE y)
+{
+  Sprite *s = getPrivateData<Sprite>(self);
+  bool hit = false;
+  GUARD_EXC( hit = s->opaqueAt(NUM2INT(x), NUM2INT(y)); );
+  return hit ? Qtrue : Qfalse;
+}
+
+static VALUE sprite_pixel_overlap(VALUE self, VALUE other)
+{
+  Sprite *s = getPrivateData<Sprite>(self);
+  Sprite *o = getPrivateDataCheck<Sprite>(other, SpriteType);
+  bool hit = false;
+  GUARD_EXC( hit = s->overlaps(*o); );
+  return hit ? Qtrue : Qfalse;
+}
+
+// Takes an array of [x, y] pairs, returns an array of booleans
+static VALUE sprite_pixel_hits(VALUE self, VALUE points)
+{
+  Sprite *s = getPrivateData<Sprite>(self);
+  Check_Type(points, T_ARRAY);
+  long n = RARRAY_LEN(points);
+  VALUE result = rb_ary_new2(n);
+  for (long i = 0; i < n; ++i) {
+    VALUE pt = rb_ary_entry(points, i);
+    Check_Type(pt, T_ARRAY);
+    int x = NUM2INT(rb_ary_entry(pt, 0));
+    int y = NUM2INT(rb_ary_entry(pt, 1));
+    bool hit = false;
+    GUARD_EXC( hit = s->opaqueAt(x, y); );
+    rb_ary_push(result, hit ? Qtrue : Qfalse);
+  }
+  return result;
+}
+
+// Returns those sprites of the given array this one overlaps with
+static VALUE sprite_pixel_overlaps(VALUE self, VALUE sprites)
+{
+  Sprite *s = getPrivateData<Sprite>(self);
+  Check_Type(sprites, T_ARRAY);
+  long n = RARRAY_LEN(sprites);
+  VALUE result = rb_ary_new();
+  for (long i = 0; i < n; ++i) {
+    VALUE other = rb_ary_entry(sprites, i);
+    Sprite *o = getPrivateDataCheck<Sprite>(other, SpriteType);
+    if (o == s || o->isDisposed()) continue;
+    bool hit = false;
+    GUARD_EXC( hit = s->overlaps(*o); );
+    if (hit) rb_ary_push(result, other);
+  }
+  return result;
+}
+
 template<rb_data_type_t *SpriteType>
 static VALUE SpriteAllocate(VALUE klass)
 {
@@ -644,6 +698,10 @@ void SpriteBindingInit() {
   rb_define_method(RSprite, "mouse_inside?", RMF(SpriteisMouseInside), 0);
   rb_define_method(RSprite, "mouse_above?", RMF(SpriteisMouseInside), 0);
   rb_define_method(RSprite, "mouse_above_color?", RMF(SpriteisMouseAboveColorFound), 0);
+  rb_define_method(RSprite, "pixel_hit?", RMF(sprite_pixel_hit), 2);
+  rb_define_method(RSprite, "pixel_hits", RMF(sprite_pixel_hits), 1);
+  rb_define_method(RSprite, "pixel_overlap?", RMF(sprite_pixel_overlap), 1);
+  rb_define_method(RSprite, "pixel_overlaps", RMF(sprite_pixel_overlaps), 1);
   rb_define_method(RSprite, "gray_out=", RMF(sprite_gray_out), 1);
   rb_define_method(RSprite, "turn_sepia=", RMF(sprite_turn_sepia), 1);
   rb_define_method(RSprite, "invert_colors=", RMF(sprite_invert_colors), 1);
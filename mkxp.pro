@@ -188,6 +188,7 @@ EMBED = \
 	shader/trans.frag \
 	shader/hue.frag \
 	shader/sprite.frag \
+	shader/spriteBatch.frag \
 	shader/plane.frag \
 	shader/gray.frag \
 	shader/bitmapBlit.frag \
@@ -201,6 +202,8 @@ EMBED = \
 	shader/simple.vert \
 	shader/simpleColor.vert \
 	shader/sprite.vert \
+	shader/spriteBatch.vert \
+	shader/spriteWave.vert \
 	shader/tilemap.vert \
 	shader/blur.frag \
 	shader/blurH.vert \
@@ -0,0 +1,15 @@
+
+uniform sampler2D texture;
+/* Affine color transformation, the offset lives in the 4th column */
+uniform mat4 colorMat;
+
+varying vec2 v_texCoord;
+
+void main()
+{
+	vec4 frag = texture2D(texture, v_texCoord);
+
+	frag.rgb = clamp((colorMat * vec4(frag.rgb, 1.0)).rgb, 0.0, 1.0);
+
+	gl_FragColor = frag;
+}
@@ -0,0 +1,17 @@
+
+uniform sampler2D texture;
+
+varying vec2 v_texCoord;
+
+void main()
+{
+	vec4 frag = texture2D(texture, v_texCoord);
+
+	/* Fully transparent pixels are cleared instead */
+	if (frag.a == 0.0)
+		frag = vec4(0.0);
+	else
+		frag.rgb = vec3(1.0) - frag.rgb;
+
+	gl_FragColor = frag;
+}
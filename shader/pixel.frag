@@ -0,0 +1,17 @@
+
+uniform sampler2D texture;
+/* Size of one block in normalized texture coordinates */
+uniform vec2 blockSize;
+/* Center of the bottom right texel in use, pooled
+ * textures may be larger than the bitmap */
+uniform vec2 limit;
+
+varying vec2 v_texCoord;
+
+void main()
+{
+	/* Every pixel of a block takes the color at its center */
+	vec2 coor = min((floor(v_texCoord / blockSize) + 0.5) * blockSize, limit);
+
+	gl_FragColor = texture2D(texture, coor);
+}
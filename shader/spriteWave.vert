@@ -0,0 +1,30 @@
+
+uniform mat4 projMat;
+
+uniform mat4 spriteMat;
+
+uniform vec2 texSizeInv;
+
+uniform float waveAmp;
+uniform float waveLength;
+/* In radians */
+uniform float wavePhase;
+
+attribute vec2 position;
+attribute vec2 texCoord;
+/* First row of the chunk this vertex belongs to */
+attribute float waveY;
+
+varying vec2 v_texCoord;
+
+const float twoPi = 6.283185307;
+
+void main()
+{
+	/* Whole chunks get shifted sideways, by the
+	 * wave offset at their first row */
+	float shift = sin(wavePhase + (waveY / waveLength) * twoPi) * waveAmp;
+
+	gl_Position = projMat * spriteMat * vec4(position.x + shift, position.y, 0, 1);
+	v_texCoord = texCoord * texSizeInv;
+}
@@ -3,6 +3,8 @@
 uniform sampler2D currentScene;
 uniform sampler2D frozenScene;
 uniform sampler2D transMap;
+/* Part of the transMap texture the bitmap uses */
+uniform vec2 transMapScale;
 /* Normalized */
 uniform float prog;
 /* Vague [0, 512] normalized */
@@ -12,7 +14,7 @@ varying vec2 v_texCoord;
 
 void main()
 {
-    float transV = texture2D(transMap, v_texCoord).r;
+    float transV = texture2D(transMap, v_texCoord * transMapScale).r;
     float cTransV = clamp(transV, prog, prog+vague);
     lowp float alpha = (cTransV - prog) / vague;
     
@@ -0,0 +1,82 @@
+/*
+** alphamask.cpp
+**
+** This file is part of HiddenChest
+*/
+
+#include "alphamask.h"
+#include <algorithm>
+
+AlphaMask::AlphaMask(const uint8_t *pixels, int width, int height, int pitch)
+: w(width), h(height), stride((width + 31) / 32),
+  bits(stride * height, 0)
+{
+  for (int y = 0; y < h; ++y) {
+    const uint8_t *src = pixels + y * pitch + 3;
+    uint32_t *dst = &bits[y * stride];
+    for (int x = 0; x < w; ++x, src += 4)
+      if (*src)
+        dst[x >> 5] |= 1u << (x & 31);
+  }
+}
+
+bool AlphaMask::opaque(int x, int y) const
+{
+  if (x < 0 || y < 0 || x >= w || y >= h) return false;
+  return (row(y)[x >> 5] >> (x & 31)) & 1;
+}
+
+void AlphaMask::set(int x, int y, bool opaque)
+{
+  if (x < 0 || y < 0 || x >= w || y >= h) return;
+  uint32_t &word = bits[y * stride + (x >> 5)];
+  if (opaque)
+    word |= 1u << (x & 31);
+  else
+    word &= ~(1u << (x & 31));
+}
+
+uint32_t AlphaMask::fetch(const uint32_t *row, int x) const
+{
+  const int word = x >> 5, shift = x & 31;
+  uint32_t result = row[word] >> shift;
+  if (shift && word + 1 < stride)
+    result |= row[word + 1] << (32 - shift);
+  return result;
+}
+
+static IntRect clipToMask(const IntRect &rect, const AlphaMask &mask)
+{
+  IntRect r = rect;
+  if (r.x < 0) { r.w += r.x; r.x = 0; }
+  if (r.y < 0) { r.h += r.y; r.y = 0; }
+  r.w = std::min(r.w, mask.width() - r.x);
+  r.h = std::min(r.h, mask.height() - r.y);
+  return r;
+}
+
+bool AlphaMask::overlap(const AlphaMask &a, const IntRect &rectA,
+                        const AlphaMask &b, const IntRect &rectB,
+                        const Vec2i &offset)
+{
+  IntRect ra = clipToMask(rectA, a);
+  IntRect rb = clipToMask(rectB, b);
+  // Clipping might have moved the rectangles' origins
+  Vec2i off(offset.x + (rb.x - rectB.x) - (ra.x - rectA.x),
+            offset.y + (rb.y - rectB.y) - (ra.y - rectA.y));
+  // Intersection, in coordinates relative to 'ra'
+  const int x0 = std::max(0, off.x), x1 = std::min(ra.w, off.x + rb.w);
+  const int y0 = std::max(0, off.y), y1 = std::min(ra.h, off.y + rb.h);
+  if (x0 >= x1 || y0 >= y1) return false;
+  for (int y = y0; y < y1; ++y) {
+    const uint32_t *rowA = a.row(ra.y + y);
+    const uint32_t *rowB = b.row(rb.y + y - off.y);
+    for (int x = x0; x < x1; x += 32) {
+      const int n = std::min(32, x1 - x);
+      const uint32_t m = n == 32 ? ~0u : (1u << n) - 1;
+      if (a.fetch(rowA, ra.x + x) & b.fetch(rowB, rb.x + x - off.x) & m)
+        return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,41 @@
+/*
+** alphamask.h
+**
+** This file is part of HiddenChest
+*/
+
+#ifndef ALPHAMASK_H
+#define ALPHAMASK_H
+
+#include "etc-internal.h"
+#include <vector>
+#include <stdint.h>
+
+/* One bit per pixel telling whether it's opaque at all
+ * (alpha > 0), packed into 32 bit words row by row */
+class AlphaMask
+{
+public:
+  /* 'pixels' holds 'height' rows of RGBA byte quadruplets,
+   * 'pitch' bytes apart */
+  AlphaMask(const uint8_t *pixels, int width, int height, int pitch);
+  int width() const { return w; }
+  int height() const { return h; }
+  bool opaque(int x, int y) const;
+  void set(int x, int y, bool opaque);
+  /* Tests whether any opaque pixel inside 'rectA' of 'a' lies
+   * on top of one inside 'rectB' of 'b', with the top left
+   * corner of 'rectB' placed at 'offset' relative to 'rectA' */
+  static bool overlap(const AlphaMask &a, const IntRect &rectA,
+                      const AlphaMask &b, const IntRect &rectB,
+                      const Vec2i &offset);
+
+private:
+  /* 32 bits of 'row' starting at bit 'x' */
+  uint32_t fetch(const uint32_t *row, int x) const;
+  const uint32_t *row(int y) const { return &bits[y * stride]; }
+  int w, h, stride;
+  std::vector<uint32_t> bits;
+};
+
+#endif // ALPHAMASK_H
@@ -29,17 +29,23 @@
 #include "fluid-fun.h"
 #include "sdl-util.h"
 #include "debugwriter.h"
+#include "util.h"
 #include <SDL_mutex.h>
-#include <SDL_thread.h>
 #include <SDL_timer.h>
 
-ALStream::ALStream(LoopMode loopMode, const std::string &threadId)
+/* Longest the service may leave a playing stream alone */
+#define STREAM_MAX_SLEEP 250
+
+ALStream::ALStream(LoopMode loopMode, AudioService &service)
 : looped(loopMode == Looped),
   state(Closed),
   source(0),
-  thread(0),
+  service(service),
+  feeding(false),
+  watcher(0),
   preemptPause(false),
-  pitch(1.0f)
+  pitch(1.0f),
+  bufferMs(0)
 {
   alSrc = AL::Source::gen();
   AL::Source::setVolume(alSrc, 1.0f);
@@ -48,12 +54,14 @@ ALStream::ALStream(LoopMode loopMode, const std::string &threadId)
   for (int i = 0; i < STREAM_BUFS; ++i)
     alBuf[i] = AL::Buffer::gen();
   pauseMut = SDL_CreateMutex();
-  threadName = std::string("al_stream (") + threadId + ")";
+  fillLatency.last = fillLatency.max = 0;
+  service.add(this);
 }
 
 ALStream::~ALStream()
 {
   close();
+  service.remove(this);
   AL::Source::clearQueue(alSrc);
   AL::Source::del(alSrc);
   for (int i = 0; i < STREAM_BUFS; ++i)
@@ -146,6 +154,7 @@ void ALStream::setPitch(float value)
   * we don't have to do it via OpenAL */
   if (source && source->setPitch(value)) value = 1.0f;
   AL::Source::setPitch(alSrc, value);
+  pitch = value;
 }
 
 ALStream::State ALStream::queryState()
@@ -223,15 +232,14 @@ void ALStream::openSource(const std::string &filename)
 
 void ALStream::stopStream()
 {
-  threadTermReq.set();
-  if (thread) {
-    SDL_WaitThread(thread, 0);
-    thread = 0;
+  if (feeding) {
+    service.cancel(this);
+    feeding = false;
     needsRewind.set();
   }
-  /* Need to stop the source _after_ the thread has terminated,
-   * because it might have accidentally started it again before
-   * seeing the term request */
+  /* Need to stop the source _after_ any refill in progress
+   * has finished, because it might have accidentally
+   * started it again */
   AL::Source::stop(alSrc);
   procFrames = 0;
 }
@@ -242,11 +250,10 @@ void ALStream::startStream(float offset)
   preemptPause = false;
   streamInited.clear();
   sourceExhausted.clear();
-  threadTermReq.clear();
   startOffset = offset;
   procFrames = offset * source->sampleRate();
-  thread = createSDLThread
-    <ALStream, &ALStream::streamData>(this, threadName);
+  feeding = true;
+  service.schedule(this);
 }
 
 void ALStream::pauseStream()
@@ -286,70 +293,102 @@ void ALStream::checkStopped()
   stopStream();
   state = Stopped;
 }
-// thread func
-void ALStream::streamData()
-{// Fill up queue
-  bool firstBuffer = true;
-  ALDataSource::Status status;
-  if (threadTermReq) return;
+/* Queues up all buffers and starts playback */
+bool ALStream::fillQueue()
+{
   if (needsRewind) source->seekToOffset(startOffset);
   for (int i = 0; i < STREAM_BUFS; ++i) {
-    if (threadTermReq) return;
     AL::Buffer::ID buf = alBuf[i];
-    status = source->fillBuffer(buf);
-    if (status == ALDataSource::Error) return;
+    ALDataSource::Status status = source->fillBuffer(buf);
+    if (status == ALDataSource::Error) return false;
     AL::Source::queueBuffer(alSrc, buf);
-    if (firstBuffer) {
+    bufferMs = playbackMs(buf);
+    if (i == 0) {
       resumeStream();
-      firstBuffer = false;
       streamInited.set();
     }
-    if (threadTermReq) return;
     if (status == ALDataSource::EndOfStream) {
       sourceExhausted.set();
       break;
     }
-  }// Wait for buffers to be consumed, then refill and queue them up again
-  while (true) {
-    shState->rtData().syncPoint.passSecondarySync();
-    ALint procBufs = AL::Source::getProcBufferCount(alSrc);
-    while (procBufs--) {
-      if (threadTermReq) break;
-      AL::Buffer::ID buf = AL::Source::unqueueBuffer(alSrc);
-      // If something went wrong, try again later
-      if (buf == AL::Buffer::ID(0)) break;
-      if (buf == lastBuf) {
+  }
+  return true;
+}
+
+/* Refills and queues up again whatever buffers got consumed */
+bool ALStream::refillQueue()
+{
+  ALint procBufs = AL::Source::getProcBufferCount(alSrc);
+  while (procBufs--) {
+    AL::Buffer::ID buf = AL::Source::unqueueBuffer(alSrc);
+    // If something went wrong, try again later
+    if (buf == AL::Buffer::ID(0)) break;
+    if (buf == lastBuf) {
 // Reset processed sample count so querying playback offset returns 0.0 again
-        procFrames = source->loopStartFrames();
-        lastBuf = AL::Buffer::ID(0);
-      } else {
-      // Add the frame count contained in this buffer to the total count
-        ALint bits = AL::Buffer::getBits(buf);
-        ALint size = AL::Buffer::getSize(buf);
-        ALint chan = AL::Buffer::getChannels(buf);
-        if (bits != 0 && chan != 0)
-          procFrames += ((size / (bits / 8)) / chan);
-      }
-      if (sourceExhausted) continue;
-      status = source->fillBuffer(buf);
-      if (status == ALDataSource::Error) {
-        sourceExhausted.set();
-        return;
-      }
-      AL::Source::queueBuffer(alSrc, buf);
-      // In case of buffer underrun, start playing again
-      if (AL::Source::getState(alSrc) == AL_STOPPED)
-        AL::Source::play(alSrc);
-      /* If this was the last buffer before the data
-       * source loop wrapped around again, mark it as
-       * such so we can catch it and reset the processed
-       * sample count once it gets unqueued */
-      if (status == ALDataSource::WrapAround)
-        lastBuf = buf;
-      if (status == ALDataSource::EndOfStream)
-        sourceExhausted.set();
+      procFrames = source->loopStartFrames();
+      lastBuf = AL::Buffer::ID(0);
+    } else {
+    // Add the frame count contained in this buffer to the total count
+      ALint bits = AL::Buffer::getBits(buf);
+      ALint size = AL::Buffer::getSize(buf);
+      ALint chan = AL::Buffer::getChannels(buf);
+      if (bits != 0 && chan != 0)
+        procFrames += ((size / (bits / 8)) / chan);
+    }
+    if (sourceExhausted) continue;
+    ALDataSource::Status status = source->fillBuffer(buf);
+    if (status == ALDataSource::Error) {
+      sourceExhausted.set();
+      return false;
     }
-    if (threadTermReq) break;
-    SDL_Delay(AUDIO_SLEEP);
+    AL::Source::queueBuffer(alSrc, buf);
+    bufferMs = playbackMs(buf);
+    // In case of buffer underrun, start playing again
+    if (AL::Source::getState(alSrc) == AL_STOPPED)
+      AL::Source::play(alSrc);
+    /* If this was the last buffer before the data
+     * source loop wrapped around again, mark it as
+     * such so we can catch it and reset the processed
+     * sample count once it gets unqueued */
+    if (status == ALDataSource::WrapAround)
+      lastBuf = buf;
+    if (status == ALDataSource::EndOfStream)
+      sourceExhausted.set();
+  }
+  return true;
+}
+
+uint32_t ALStream::playbackMs(AL::Buffer::ID buf)
+{
+  ALint bits = AL::Buffer::getBits(buf);
+  ALint size = AL::Buffer::getSize(buf);
+  ALint chan = AL::Buffer::getChannels(buf);
+  ALint freq = AL::Buffer::getFrequency(buf);
+  if (bits == 0 || chan == 0 || freq == 0) return 0;
+  return (uint64_t) (size / (bits / 8) / chan) * 1000 / freq;
+}
+
+/* Half a buffer's playback time, so a consumed buffer
+ * is back in the queue long before the others run out */
+uint32_t ALStream::refillDelay() const
+{
+  uint32_t ms = bufferMs / (2 * std::max(pitch, 0.5f));
+  return clamp<uint32_t>(ms, AUDIO_SLEEP, STREAM_MAX_SLEEP);
+}
+
+/* Runs on the audio service thread */
+uint32_t ALStream::run()
+{
+  const uint32_t start = SDL_GetTicks();
+  const bool inited = streamInited;
+  const bool ok = inited ? refillQueue() : fillQueue();
+  if (!ok) return Idle;
+  fillLatency.last = lateMs + (SDL_GetTicks() - start);
+  fillLatency.max = std::max(fillLatency.max, fillLatency.last);
+  if (sourceExhausted && AL::Source::getState(alSrc) == AL_STOPPED) {
+    /* Played to the end, there's nothing left to refill */
+    if (watcher) service.schedule(watcher);
+    return Idle;
   }
+  return refillDelay();
 }
@@ -24,6 +24,7 @@
 
 #include "al-util.h"
 #include "sdl-util.h"
+#include "audioservice.h"
 #include <string>
 #include <SDL_rwops.h>
 
@@ -31,9 +32,10 @@ struct ALDataSource;
 
 #define STREAM_BUFS 3
 
-/* State-machine like audio playback stream.
+/* State-machine like audio playback stream, its buffers
+ * get refilled by the audio service thread.
  * This class is NOT thread safe */
-struct ALStream
+struct ALStream : AudioTask
 {
   enum State
   {
@@ -46,8 +48,11 @@ struct ALStream
   bool looped;
   State state;
   ALDataSource *source;
-  SDL_Thread *thread;
-  std::string threadName;
+  AudioService &service;
+  /* Set while the service refills our buffers */
+  bool feeding;
+  /* Scheduled whenever the stream ended on its own */
+  AudioTask *watcher;
   SDL_mutex *pauseMut;
   bool preemptPause;
   /* When this flag isn't set and alSrc is
@@ -55,7 +60,6 @@ struct ALStream
    * (it just hasn't started yet) */
   AtomicFlag streamInited;
   AtomicFlag sourceExhausted;
-  AtomicFlag threadTermReq;
   AtomicFlag needsRewind;
   float startOffset;
   float pitch;
@@ -64,6 +68,15 @@ struct ALStream
   uint64_t procFrames;
   AL::Buffer::ID lastBuf;
   SDL_RWops srcOps;
+  /* Playback time of the latest buffer filled, in ms */
+  uint32_t bufferMs;
+  /* Time from a refill being due until
+   * the buffer was queued again, in ms */
+  struct
+  {
+    uint32_t last;
+    uint32_t max;
+  } fillLatency;
 
   struct
   {
@@ -77,7 +90,7 @@ struct ALStream
     NotLooped
   };
 
-  ALStream(LoopMode loopMode, const std::string &threadId);
+  ALStream(LoopMode loopMode, AudioService &service);
   ~ALStream();
   void close();
   void open(const std::string &filename);
@@ -98,8 +111,11 @@ private:
   void pauseStream();
   void resumeStream();
   void checkStopped();
-  /* thread func */
-  void streamData();
+  bool fillQueue();
+  bool refillQueue();
+  static uint32_t playbackMs(AL::Buffer::ID buf);
+  uint32_t refillDelay() const;
+  uint32_t run();
 };
 
 #endif // ALSTREAM_H
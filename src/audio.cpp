@@ -21,25 +21,32 @@
 
 #include "audio.h"
 #include "audiostream.h"
+#include "audioservice.h"
 #include "soundemitter.h"
 #include "sharedstate.h"
 #include "sharedmidistate.h"
 #include "eventthread.h"
 #include "sdl-util.h"
 #include <string>
-#include <SDL_thread.h>
 #include <SDL_timer.h>
+
+/* How often the MeWatch checks whether a playing ME ended,
+ * in case nothing told it */
+#define ME_WATCH_POLL 100
+
 //#include "ok_ogg.xxd"#include "wrong_ogg.xxd"
-struct AudioPrivate
+struct AudioPrivate : AudioTask
 {
+  AudioService service;
   AudioStream bgm;
   AudioStream bgs;
   AudioStream me;
   SoundEmitter se;
-  SyncPoint &syncPoint;
   /* The 'MeWatch' is responsible for detecting a playing ME, quickly fading out
    * the BGM and keeping it paused/stopped while the ME plays, and unpausing /
-   * fading the BGM back in again afterwards */
+   * fading the BGM back in again afterwards. It is run by the audio service
+   * while the BGM fades and while an ME plays, and is woken up
+   * whenever the ME starts or plays to its end */
   enum MeWatchState
   {
     MeNotPlaying,
@@ -50,132 +57,131 @@ struct AudioPrivate
 
   struct
   {
-    SDL_Thread *thread;
-    AtomicFlag termReq;
     MeWatchState state;
   } meWatch;
 
   AudioPrivate(RGSSThreadData &rtData)
-  : bgm(ALStream::Looped, "bgm"),
-    bgs(ALStream::Looped, "bgs"),
-    me(ALStream::NotLooped, "me"),
-    se(rtData.config),
-    syncPoint(rtData.syncPoint)
+  : service(rtData.syncPoint),
+    bgm(ALStream::Looped, service),
+    bgs(ALStream::Looped, service),
+    me(ALStream::NotLooped, service),
+    se(rtData.config)
   {
     meWatch.state = MeNotPlaying;
-    meWatch.thread = createSDLThread
-      <AudioPrivate, &AudioPrivate::meWatchFun>(this, "audio_mewatch");
+    service.add(this);
+    me.watcher = this;
+    me.stream.watcher = this;
   }
 
   ~AudioPrivate()
   {
-    meWatch.termReq.set();
-    SDL_WaitThread(meWatch.thread, 0);
+    service.remove(this);
   }
 
-  void meWatchFun()
+  /* Runs one MeWatch step on the audio service thread */
+  uint32_t run()
   {
     const float fadeOutStep = 1.f / (200  / AUDIO_SLEEP);
     const float fadeInStep  = 1.f / (1000 / AUDIO_SLEEP);
-    while (true) {
-      syncPoint.passSecondarySync();
-      if (meWatch.termReq)
-        return;
-      switch (meWatch.state) {
-      case MeNotPlaying:
-      {
-        me.lockStream();
-        if (me.stream.queryState() == ALStream::Playing) {
-          /* ME playing detected. -> FadeOutBGM */
-          bgm.extPaused = true;
-          meWatch.state = BgmFadingOut;
-        }
-        me.unlockStream();
-        break;
+    switch (meWatch.state) {
+    case MeNotPlaying:
+    {
+      me.lockStream();
+      bool mePlaying = me.stream.queryState() == ALStream::Playing;
+      if (mePlaying) {
+        /* ME playing detected. -> FadeOutBGM */
+        bgm.extPaused = true;
+        meWatch.state = BgmFadingOut;
       }
-      case BgmFadingOut :
-      {
-        me.lockStream();
-        if (me.stream.queryState() != ALStream::Playing) {
-          /* ME has ended while fading OUT BGM. -> FadeInBGM */
-          me.unlockStream();
-          meWatch.state = BgmFadingIn;
-          break;
-        }
-        bgm.lockStream();
-        float vol = bgm.getVolume(AudioStream::External);
-        vol -= fadeOutStep;
-        if (vol < 0 || bgm.stream.queryState() != ALStream::Playing) {
-          /* Either BGM has fully faded out, or stopped midway. -> MePlaying */
-          bgm.setVolume(AudioStream::External, 0);
-          bgm.stream.pause();
-          meWatch.state = MePlaying;
-          bgm.unlockStream();
-          me.unlockStream();
-          break;
-        }
-        bgm.setVolume(AudioStream::External, vol);
-        bgm.unlockStream();
+      me.unlockStream();
+      if (!mePlaying)
+        return Idle;
+      break;
+    }
+    case BgmFadingOut :
+    {
+      me.lockStream();
+      if (me.stream.queryState() != ALStream::Playing) {
+        /* ME has ended while fading OUT BGM. -> FadeInBGM */
         me.unlockStream();
+        meWatch.state = BgmFadingIn;
         break;
       }
-      case MePlaying :
-      {
-        me.lockStream();
-        if (me.stream.queryState() != ALStream::Playing) {
-          /* ME has ended */
-          bgm.lockStream();
-          bgm.extPaused = false;
-          ALStream::State sState = bgm.stream.queryState();
-          if (sState == ALStream::Paused) {
-            /* BGM is paused. -> FadeInBGM */
-            bgm.stream.play();
-            meWatch.state = BgmFadingIn;
-          } else {
-            /* BGM is stopped. -> MeNotPlaying */
-            bgm.setVolume(AudioStream::External, 1.0f);
-            if (!bgm.noResumeStop)
-                bgm.stream.play();
-            meWatch.state = MeNotPlaying;
-          }
-          bgm.unlockStream();
-        }
+      bgm.lockStream();
+      float vol = bgm.getVolume(AudioStream::External);
+      vol -= fadeOutStep;
+      if (vol < 0 || bgm.stream.queryState() != ALStream::Playing) {
+        /* Either BGM has fully faded out, or stopped midway. -> MePlaying */
+        bgm.setVolume(AudioStream::External, 0);
+        bgm.stream.pause();
+        meWatch.state = MePlaying;
+        bgm.unlockStream();
         me.unlockStream();
         break;
       }
-      case BgmFadingIn :
-      {
+      bgm.setVolume(AudioStream::External, vol);
+      bgm.unlockStream();
+      me.unlockStream();
+      break;
+    }
+    case MePlaying :
+    {
+      me.lockStream();
+      if (me.stream.queryState() != ALStream::Playing) {
+        /* ME has ended */
         bgm.lockStream();
-        if (bgm.stream.queryState() == ALStream::Stopped) {
-          /* BGM stopped midway fade in. -> MeNotPlaying */
+        bgm.extPaused = false;
+        ALStream::State sState = bgm.stream.queryState();
+        if (sState == ALStream::Paused) {
+          /* BGM is paused. -> FadeInBGM */
+          bgm.stream.play();
+          meWatch.state = BgmFadingIn;
+        } else {
+          /* BGM is stopped. -> MeNotPlaying */
           bgm.setVolume(AudioStream::External, 1.0f);
+          if (!bgm.noResumeStop)
+              bgm.stream.play();
           meWatch.state = MeNotPlaying;
-          bgm.unlockStream();
-          break;
         }
-        me.lockStream();
-        if (me.stream.queryState() == ALStream::Playing) {
-          /* ME started playing midway BGM fade in. -> FadeOutBGM */
-          bgm.extPaused = true;
-          meWatch.state = BgmFadingOut;
-          me.unlockStream();
-          bgm.unlockStream();
-          break;
-        }
-        float vol = bgm.getVolume(AudioStream::External);
-        vol += fadeInStep;
-        if (vol >= 1) {// BGM fully faded in. -> MeNotPlaying
-          vol = 1.0f;
-          meWatch.state = MeNotPlaying;
-        }
-        bgm.setVolume(AudioStream::External, vol);
+        bgm.unlockStream();
+        me.unlockStream();
+        break;
+      }
+      me.unlockStream();
+      return ME_WATCH_POLL;
+    }
+    case BgmFadingIn :
+    {
+      bgm.lockStream();
+      if (bgm.stream.queryState() == ALStream::Stopped) {
+        /* BGM stopped midway fade in. -> MeNotPlaying */
+        bgm.setVolume(AudioStream::External, 1.0f);
+        meWatch.state = MeNotPlaying;
+        bgm.unlockStream();
+        break;
+      }
+      me.lockStream();
+      if (me.stream.queryState() == ALStream::Playing) {
+        /* ME started playing midway BGM fade in. -> FadeOutBGM */
+        bgm.extPaused = true;
+        meWatch.state = BgmFadingOut;
         me.unlockStream();
         bgm.unlockStream();
         break;
       }
+      float vol = bgm.getVolume(AudioStream::External);
+      vol += fadeInStep;
+      if (vol >= 1) {// BGM fully faded in. -> MeNotPlaying
+        vol = 1.0f;
+        meWatch.state = MeNotPlaying;
+      }
+      bgm.setVolume(AudioStream::External, vol);
+      me.unlockStream();
+      bgm.unlockStream();
+      break;
     }
-    SDL_Delay(AUDIO_SLEEP);
     }
+    return AUDIO_SLEEP;
   }
 };
 
@@ -238,6 +244,16 @@ void Audio::seStop()
   p->se.stop();
 }
 
+void Audio::sePreload(const char *filename)
+{
+  p->se.preload(filename);
+}
+
+void Audio::seCacheStats(SECacheStats &stats)
+{
+  stats = p->se.cacheStats();
+}
+
 void Audio::setupMidi()
 {
   shState->midiState().initIfNeeded(shState->config());
@@ -253,6 +269,18 @@ float Audio::bgsPos()
   return p->bgs.playingOffset();
 }
 
+unsigned int Audio::serviceWakeups()
+{
+  return p->service.wakeups();
+}
+
+void Audio::fillLatency(StreamId stream, unsigned int &last, unsigned int &max)
+{
+  AudioStream &s = stream == BGM ? p->bgm : stream == BGS ? p->bgs : p->me;
+  last = s.stream.fillLatency.last;
+  max = s.stream.fillLatency.max;
+}
+
 void Audio::reset()
 {
   p->bgm.stop();
@@ -34,6 +34,7 @@
 
 struct AudioPrivate;
 struct RGSSThreadData;
+struct SECacheStats;
 
 class Audio
 {
@@ -62,11 +63,26 @@ public:
 	            int volume = 100,
 	            int pitch = 100);
 	void seStop();
+	/* Decodes 'filename' in the background without playing it */
+	void sePreload(const char *filename);
+	void seCacheStats(SECacheStats &stats);
 
 	void setupMidi();
 	float bgmPos();
 	float bgsPos();
 
+	/* Diagnostics of the audio service thread */
+	enum StreamId
+	{
+		BGM,
+		BGS,
+		ME
+	};
+	unsigned int serviceWakeups();
+	/* Latest and worst time in ms from a buffer refill
+	 * of 'stream' being due until it was queued again */
+	void fillLatency(StreamId stream, unsigned int &last, unsigned int &max);
+
 	void reset();
 
 private:
@@ -0,0 +1,147 @@
+/*
+** audioservice.cpp
+**
+** This file is part of HiddenChest
+*/
+
+#include "audioservice.h"
+#include "eventthread.h"
+#include "sdl-util.h"
+#include <SDL_timer.h>
+#include <algorithm>
+
+/* Tick differences, correct across SDL_GetTicks wrapping around */
+static int32_t ticksUntil(uint32_t due, uint32_t now)
+{
+  return (int32_t) (due - now);
+}
+
+AudioService::AudioService(SyncPoint &syncPoint)
+: syncPoint(syncPoint),
+  running(0),
+  runningCancelled(false),
+  termReq(false),
+  wakeupCount(0)
+{
+  mut = SDL_CreateMutex();
+  cond = SDL_CreateCond();
+  ranCond = SDL_CreateCond();
+  /* The thread can't look at its id before we filled it in */
+  SDL_LockMutex(mut);
+  thread = createSDLThread<AudioService, &AudioService::serviceTasks>(this, "audio_service");
+  threadId = SDL_GetThreadID(thread);
+  SDL_UnlockMutex(mut);
+}
+
+AudioService::~AudioService()
+{
+  SDL_LockMutex(mut);
+  termReq = true;
+  SDL_CondSignal(cond);
+  SDL_UnlockMutex(mut);
+  SDL_WaitThread(thread, 0);
+  SDL_DestroyCond(ranCond);
+  SDL_DestroyCond(cond);
+  SDL_DestroyMutex(mut);
+}
+
+void AudioService::add(AudioTask *task)
+{
+  SDL_LockMutex(mut);
+  tasks.push_back(task);
+  SDL_UnlockMutex(mut);
+}
+
+void AudioService::remove(AudioTask *task)
+{
+  SDL_LockMutex(mut);
+  cancelLocked(task);
+  tasks.erase(std::remove(tasks.begin(), tasks.end(), task), tasks.end());
+  SDL_UnlockMutex(mut);
+}
+
+void AudioService::schedule(AudioTask *task, uint32_t delay)
+{
+  const uint32_t due = SDL_GetTicks() + delay;
+  SDL_LockMutex(mut);
+  if (!task->pending || ticksUntil(due, task->due) < 0) {
+    task->pending = true;
+    task->due = due;
+    /* The thread picks its next deadline anew */
+    SDL_CondSignal(cond);
+  }
+  SDL_UnlockMutex(mut);
+}
+
+void AudioService::cancel(AudioTask *task)
+{
+  SDL_LockMutex(mut);
+  cancelLocked(task);
+  SDL_UnlockMutex(mut);
+}
+
+uint32_t AudioService::wakeups()
+{
+  SDL_LockMutex(mut);
+  uint32_t result = wakeupCount;
+  SDL_UnlockMutex(mut);
+  return result;
+}
+
+void AudioService::cancelLocked(AudioTask *task)
+{
+  task->pending = false;
+  if (running != task) return;
+  runningCancelled = true;
+  /* Tasks cancelling others from within
+   * the service thread mustn't wait for themselves */
+  if (SDL_ThreadID() == threadId) return;
+  while (running == task)
+    SDL_CondWait(ranCond, mut);
+}
+
+void AudioService::serviceTasks()
+{
+  SDL_LockMutex(mut);
+  while (!termReq) {
+    SDL_UnlockMutex(mut);
+    syncPoint.passSecondarySync();
+    SDL_LockMutex(mut);
+    if (termReq) break;
+    AudioTask *next = 0;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      AudioTask *task = tasks[i];
+      if (task->pending && (!next || ticksUntil(task->due, next->due) < 0))
+        next = task;
+    }
+    const uint32_t now = SDL_GetTicks();
+    if (!next) {
+      SDL_CondWait(cond, mut);
+      ++wakeupCount;
+      continue;
+    }
+    const int32_t wait = ticksUntil(next->due, now);
+    if (wait > 0) {
+      SDL_CondWaitTimeout(cond, mut, wait);
+      ++wakeupCount;
+      continue;
+    }
+    next->pending = false;
+    next->lateMs = -wait;
+    running = next;
+    runningCancelled = false;
+    SDL_UnlockMutex(mut);
+    const uint32_t delay = next->run();
+    SDL_LockMutex(mut);
+    if (delay != AudioTask::Idle && !runningCancelled) {
+      const uint32_t due = SDL_GetTicks() + delay;
+      /* Keep an earlier deadline set meanwhile */
+      if (!next->pending || ticksUntil(due, next->due) < 0)
+        next->due = due;
+      next->pending = true;
+    }
+    running = 0;
+    SDL_CondBroadcast(ranCond);
+  }
+  SDL_UnlockMutex(mut);
+}
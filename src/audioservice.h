@@ -0,0 +1,74 @@
+/*
+** audioservice.h
+**
+** This file is part of HiddenChest
+*/
+
+#ifndef AUDIOSERVICE_H
+#define AUDIOSERVICE_H
+
+#include <stdint.h>
+#include <vector>
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+
+struct SyncPoint;
+
+/* Anything the audio service thread looks after, like stream
+ * buffer refills, fades and the MeWatch */
+struct AudioTask
+{
+  /* Returned by run() to sleep until scheduled again */
+  static const uint32_t Idle = 0xFFFFFFFF;
+
+  AudioTask() : pending(false), due(0), lateMs(0) {}
+  virtual ~AudioTask() {}
+  /* Runs on the service thread, without the service lock held.
+   * Returns the milliseconds until the task wants to run again */
+  virtual uint32_t run() = 0;
+
+  /* Owned by AudioService */
+  bool pending;
+  uint32_t due;
+  /* How late the latest run started */
+  uint32_t lateMs;
+};
+
+/* Single thread running every audio task from one wait loop,
+ * sleeping until the earliest deadline or until woken up
+ * by a task getting scheduled earlier than that */
+class AudioService
+{
+public:
+  AudioService(SyncPoint &syncPoint);
+  ~AudioService();
+  void add(AudioTask *task);
+  /* Also waits for a run of the task in progress to finish,
+   * so the task can't take any lock held by the caller */
+  void remove(AudioTask *task);
+  /* Runs 'task' in 'delay' ms at the latest */
+  void schedule(AudioTask *task, uint32_t delay = 0);
+  /* Unschedules 'task', waiting like remove() does */
+  void cancel(AudioTask *task);
+  /* Times the service thread woke up so far */
+  uint32_t wakeups();
+
+private:
+  void cancelLocked(AudioTask *task);
+  void serviceTasks();
+
+  SyncPoint &syncPoint;
+  std::vector<AudioTask*> tasks;
+  SDL_mutex *mut;
+  SDL_cond *cond;
+  /* Signalled whenever a task run finishes */
+  SDL_cond *ranCond;
+  AudioTask *running;
+  bool runningCancelled;
+  bool termReq;
+  uint32_t wakeupCount;
+  SDL_threadID threadId;
+  SDL_Thread *thread;
+};
+
+#endif // AUDIOSERVICE_H
@@ -23,35 +23,28 @@
 #include "util.h"
 #include "exception.h"
 #include <SDL_mutex.h>
-#include <SDL_thread.h>
 #include <SDL_timer.h>
 
-AudioStream::AudioStream(ALStream::LoopMode loopMode, const std::string &threadId)
+AudioStream::AudioStream(ALStream::LoopMode loopMode, AudioService &service)
 : extPaused(false),
   noResumeStop(false),
-  stream(loopMode, threadId)
+  service(service),
+  stream(loopMode, service),
+  watcher(0)
 {
   current.volume = 1.0f;
   current.pitch = 1.0f;
   for (size_t i = 0; i < VolumeTypeCount; ++i)
     volumes[i] = 1.0f;
-  fade.thread = 0;
-  fade.threadName = std::string("audio_fadeout (") + threadId + ")";
-  fadeIn.thread = 0;
-  fadeIn.threadName = std::string("audio_fadein (") + threadId + ")";
+  fade.active = false;
+  fadeIn.active = false;
   streamMut = SDL_CreateMutex();
+  service.add(this);
 }
 
 AudioStream::~AudioStream()
 {
-  if (fade.thread) {
-    fade.reqTerm.set();
-    SDL_WaitThread(fade.thread, 0);
-  }
-  if (fadeIn.thread) {
-    fadeIn.rqTerm.set();
-    SDL_WaitThread(fadeIn.thread, 0);
-  }
+  service.remove(this);
   lockStream();
   stream.stop();
   stream.close();
@@ -62,8 +55,8 @@ AudioStream::~AudioStream()
 void AudioStream::play(const std::string &filename,
   int volume, int pitch, float offset)
 {
-  finiFadeOutInt();
   lockStream();
+  finiFadeOutInt();
   float _volume = clamp<int>(volume, 0, 100) / 100.0f;
   float _pitch  = clamp<int>(pitch, 50, 200) / 100.0f;
   ALStream::State sState = stream.queryState();
@@ -123,13 +116,15 @@ void AudioStream::play(const std::string &filename,
     stream.play(offset);
   else
     noResumeStop = false;
+  if (watcher)
+    service.schedule(watcher);
   unlockStream();
 }
 
 void AudioStream::stop()
 {
-  finiFadeOutInt();
   lockStream();
+  finiFadeOutInt();
   noResumeStop = true;
   stream.stop();
   unlockStream();
@@ -153,18 +148,10 @@ void AudioStream::fadeOut(int duration)
     unlockStream();
     return;
   }
-  if (fade.thread) {
-    fade.reqFini.set();
-    SDL_WaitThread(fade.thread, 0);
-    fade.thread = 0;
-  }
-  fade.active.set();
+  fade.active = true;
   fade.msStep = 1.0f / duration;
-  fade.reqFini.clear();
-  fade.reqTerm.clear();
   fade.startTicks = SDL_GetTicks();
-  fade.thread = createSDLThread
-      <AudioStream, &AudioStream::fadeOutThread>(this, fade.threadName);
+  service.schedule(this);
   unlockStream();
 }
 
@@ -205,69 +192,67 @@ void AudioStream::updateVolume()
   stream.setVolume(vol);
 }
 
+/* Brings running fades to their end at once,
+ * expects the stream lock to be held */
 void AudioStream::finiFadeOutInt()
 {
-  if (fade.thread) {
-    fade.reqFini.set();
-    SDL_WaitThread(fade.thread, 0);
-    fade.thread = 0;
+  if (fade.active) {
+    if (stream.queryState() != ALStream::Paused)
+      stream.stop();
+    setVolume(FadeOut, 1.0f);
+    fade.active = false;
   }
-  if (fadeIn.thread) {
-    fadeIn.rqFini.set();
-    SDL_WaitThread(fadeIn.thread, 0);
-    fadeIn.thread = 0;
+  if (fadeIn.active) {
+    setVolume(FadeIn, 1.0f);
+    fadeIn.active = false;
   }
 }
 
 void AudioStream::startFadeIn()
 {
-  /* Previous fadein should always be terminated in play() */
-  assert(!fadeIn.thread);
-  fadeIn.rqFini.clear();
-  fadeIn.rqTerm.clear();
+  fadeIn.active = true;
   fadeIn.startTicks = SDL_GetTicks();
-  fadeIn.thread = createSDLThread
-    <AudioStream, &AudioStream::fadeInThread>(this, fadeIn.threadName);
+  service.schedule(this);
 }
 
-void AudioStream::fadeOutThread()
+void AudioStream::stepFadeOut()
 {
-  while (true) {// Just immediately terminate on request
-  if (fade.reqTerm) break;
-  lockStream();
+  if (!fade.active) return;
   uint32_t curDur = SDL_GetTicks() - fade.startTicks;
   float resVol = 1.0f - (curDur*fade.msStep);
-    ALStream::State state = stream.queryState();
-    if (state != ALStream::Playing || resVol < 0 || fade.reqFini) {
-      if (state != ALStream::Paused) stream.stop();
-      setVolume(FadeOut, 1.0f);
-      unlockStream();
-      break;
-    }
-    setVolume(FadeOut, resVol);
-    unlockStream();
-    SDL_Delay(AUDIO_SLEEP);
+  ALStream::State state = stream.queryState();
+  if (state != ALStream::Playing || resVol < 0) {
+    if (state != ALStream::Paused) stream.stop();
+    setVolume(FadeOut, 1.0f);
+    fade.active = false;
+    return;
   }
-  fade.active.clear();
+  setVolume(FadeOut, resVol);
 }
 
-void AudioStream::fadeInThread()
+void AudioStream::stepFadeIn()
 {
-  while (true) {
-    if (fadeIn.rqTerm) break;
-    lockStream();
-    /* Fade in duration is always 1 second */
-    uint32_t cur = SDL_GetTicks() - fadeIn.startTicks;
-    float prog = cur / 1000.0f;
-    ALStream::State state = stream.queryState();
-    if (state != ALStream::Playing ||  prog >= 1.0f ||  fadeIn.rqFini) {
-      setVolume(FadeIn, 1.0f);
-      unlockStream();
-      break;
-    }
-  // Quadratic increase (not really the same as in RMVXA, but close enough)
-    setVolume(FadeIn, prog*prog);
-    unlockStream();
-    SDL_Delay(AUDIO_SLEEP);
+  if (!fadeIn.active) return;
+  /* Fade in duration is always 1 second */
+  uint32_t cur = SDL_GetTicks() - fadeIn.startTicks;
+  float prog = cur / 1000.0f;
+  ALStream::State state = stream.queryState();
+  if (state != ALStream::Playing || prog >= 1.0f) {
+    setVolume(FadeIn, 1.0f);
+    fadeIn.active = false;
+    return;
   }
+  // Quadratic increase (not really the same as in RMVXA, but close enough)
+  setVolume(FadeIn, prog*prog);
+}
+
+/* Runs on the audio service thread */
+uint32_t AudioStream::run()
+{
+  lockStream();
+  stepFadeOut();
+  stepFadeIn();
+  const bool fading = fade.active || fadeIn.active;
+  unlockStream();
+  return fading ? AUDIO_SLEEP : Idle;
 }
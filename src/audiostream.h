@@ -24,18 +24,19 @@
 
 #include "al-util.h"
 #include "alstream.h"
+#include "audioservice.h"
 #include "sdl-util.h"
 #include <string>
 
-struct AudioStream
+/* Fades are stepped by the audio service thread */
+struct AudioStream : AudioTask
 {
   struct {
     std::string filename;
     float volume;
     float pitch;
   } current;
-  /* Volumes set by external threads,
-   * such as for fade-in/out.
+  /* Volumes set by fades and the MeWatch.
    * Multiplied together for final
    * playback volume. Used with setVolume().
    * Base is set by play().
@@ -69,18 +70,13 @@ struct AudioStream
    * the stream, but we want the MeWatch to start it as
    * soon as the ME ends, so we unset this flag. */
   bool noResumeStop;
+  AudioService &service;
   ALStream stream;
   SDL_mutex *streamMut;
+  /* Fade state is only accessed with the stream lock held */
   // Fade out
   struct { // Fade out is in progress
-    AtomicFlag active;
-    /* Request fade thread to finish and
-     * cleanup (like it normally would) */
-    AtomicFlag reqFini;
-    // Request fade thread to terminate immediately
-    AtomicFlag reqTerm;
-    SDL_Thread *thread;
-    std::string threadName;
+    bool active;
     // Amount of reduced absolute volume per ms of fade time
     float msStep;
     // Ticks at start of fade
@@ -88,14 +84,13 @@ struct AudioStream
   } fade;
   // Fade in
   struct {
-    AtomicFlag rqFini;
-    AtomicFlag rqTerm;
-    SDL_Thread *thread;
-    std::string threadName;
+    bool active;
     uint32_t startTicks;
   } fadeIn;
+  /* Scheduled whenever playback starts */
+  AudioTask *watcher;
 
-  AudioStream(ALStream::LoopMode loopMode, const std::string &threadId);
+  AudioStream(ALStream::LoopMode loopMode, AudioService &service);
   ~AudioStream();
   void play(const std::string &filename, int volume, int pitch, float offset=0);
   void stop();
@@ -114,8 +109,9 @@ private:
   void updateVolume();
   void finiFadeOutInt();
   void startFadeIn();
-  void fadeOutThread();
-  void fadeInThread();
+  void stepFadeOut();
+  void stepFadeIn();
+  uint32_t run();
 };
 
 #endif // AUDIOSTREAM_H
@@ -26,6 +26,7 @@
 #include <SDL_ttf.h>
 #include <SDL_rect.h>
 #include <SDL_surface.h>
+#include <string.h>
 #include <pixman.h>
 #include "gl-util.h"
 #include "gl-meta.h"
@@ -39,8 +40,14 @@
 #include "shader.h"
 #include "filesystem.h"
 #include "font.h"
+#include "glyphatlas.h"
+#include "textcache.h"
 #include "eventthread.h"
 #include "debugwriter.h"
+#include "intrulist.h"
+#include "alphamask.h"
+#include "colormatrix.h"
+#include "bitmapatlas.h"
 #include "app_logo.png.xxd"
 
 /*ifdef GLES2_HEADER// I added these lines
@@ -57,6 +64,19 @@ else*/
                     "Operation not supported for mega surfaces"); \
 }
 
+/* Granularity of get_pixel readbacks; querying a single pixel
+ * fetches the whole tile around it */
+#define READBACK_TILE 64
+/* Nanoseconds to wait for a prefetch before falling
+ * back to a synchronous read */
+#define PREFETCH_TIMEOUT 1000000000ull
+/* Copies into the bitmap atlas a bitmap may need before
+ * it's considered too volatile to be kept in there */
+#define ATLAS_UPDATE_MAX 8
+/* Frames a hot area is kept prefetched for without
+ * being queried again */
+#define HOT_AREA_FRAMES 2
+
 // Normalize (= ensure width and height are positive)
 static IntRect normalizedRect(const IntRect &rect)
 {
@@ -94,18 +114,67 @@ struct BitmapPrivate
    * in the texture and blit to it directly, saving
    * ourselves the expensive blending calculation */
   pixman_region16_t tainted;
-
-  BitmapPrivate(Bitmap *self) : self(self), megaSurface(0), surface(0)
+  /* Parts of 'surface' currently holding a valid
+   * copy of the texture contents */
+  pixman_region16_t readable;
+  /* Parts get_pixel / prefetch asked for; they're read
+   * back ahead of time again after every modification,
+   * until they go unqueried for HOT_AREA_FRAMES */
+  pixman_region16_t hot;
+  uint64_t hotFrame;
+  /* Asynchronous readback into a pixel buffer, finished
+   * (mapped) the first time its contents are needed */
+  GLuint pbo;
+  _GLsync fence;
+  IntRect fetchRect;
+  IntruListLink<BitmapPrivate> prefetchLink;
+  /* Opacity bitmask for collision queries, built on
+   * demand and dropped whenever the bitmap changes */
+  AlphaMask *mask;
+  /* Copy of the bitmap in the shared atlas sprites draw
+   * from, made the first time one does; 'atlasStale' is set
+   * by modifications not copied over yet */
+  AtlasSlot atlasSlot;
+  bool atlasStale;
+  int atlasUpdates;
+
+  BitmapPrivate(Bitmap *self) : self(self), megaSurface(0), surface(0),
+    hotFrame(0), pbo(0), fence(0), prefetchLink(this), mask(0),
+    atlasStale(true), atlasUpdates(0)
   {
     format = SDL_AllocFormat(SDL_PIXELFORMAT_ABGR8888);
     font = &shState->defaultFont();
     pixman_region_init(&tainted);
+    pixman_region_init(&readable);
+    pixman_region_init(&hot);
   }
 
   ~BitmapPrivate()
   {
+    shState->bitmapAtlas().release(atlasSlot);
+    cancelPrefetch();
+    if (pbo) ::gl.DeleteBuffers(1, &pbo);
+    prefetchQueue().remove(prefetchLink);
+    delete mask;
     SDL_FreeFormat(format);
     pixman_region_fini(&tainted);
+    pixman_region_fini(&readable);
+    pixman_region_fini(&hot);
+  }
+
+  /* Bitmaps waiting for their hot area to be prefetched
+   * at the end of the current frame */
+  static IntruList<BitmapPrivate> &prefetchQueue()
+  {
+    static IntruList<BitmapPrivate> queue;
+    return queue;
+  }
+
+  /* Counts flushPrefetches calls, ie. frames */
+  static uint64_t &prefetchFrame()
+  {
+    static uint64_t frame = 0;
+    return frame;
   }
 
   void allocSurface()
@@ -151,7 +220,7 @@ struct BitmapPrivate
   void bindTexture(ShaderBase &shader)
   {//std::cout << "About to bind shader " << std::endl;
     TEX::bind(gl.tex);
-    shader.setTexSize(Vec2i(gl.width, gl.height));
+    shader.setTexSize(Vec2i(gl.texW, gl.texH));
   }
 
   void bindFBO()
@@ -177,6 +246,100 @@ struct BitmapPrivate
     glState.blend.pop();
   }
 
+  /* Renders 'src' into 'dst' through 'shader', whose
+   * uniforms have to be set up already */
+  void shaderPass(ShaderBase &shader, TEXFBO &src, TEXFBO &dst)
+  {
+    FloatRect r(0, 0, src.width, src.height);
+    Quad &quad = shState->gpQuad();
+    quad.setTexPosRect(r, r);
+    quad.setColor(Vec4(1, 1, 1, 1));
+    shader.bind();
+    FBO::bind(dst.fbo);
+    glState.viewport.pushSet(IntRect(0, 0, dst.width, dst.height));
+    shader.applyViewportProj();
+    TEX::bind(src.tex);
+    shader.setTexSize(Vec2i(src.texW, src.texH));
+    blitQuad(quad);
+    glState.viewport.pop();
+    TEX::unbind();
+  }
+
+  /* Binds 'shader' set up for 'size' pixel blocks of 'src' */
+  void setupPixelate(PixelateShader &shader, const TEXFBO &src, int size)
+  {
+    shader.bind();
+    shader.setBlockSize(Vec2((float) size / src.texW, (float) size / src.texH));
+    shader.setLimit(Vec2((src.width - 0.5f) / src.texW,
+                         (src.height - 0.5f) / src.texH));
+  }
+
+  /* Two pass gaussian blur of 'tex' in place, 'aux'
+   * holds the intermediate result */
+  void blurPass(TEXFBO &tex, TEXFBO &aux)
+  {
+    BlurShader &shader = shState->shaders().blur;
+    shaderPass(shader.pass1, tex, aux);
+    shaderPass(shader.pass2, aux, tex);
+  }
+
+  void radialBlurPass(TEXFBO &src, TEXFBO &dst, int angle, int divisions)
+  {
+    angle     = clamp<int>(angle, 0, 359);
+    divisions = clamp<int>(divisions, 2, 100);
+    const int _width = src.width;
+    const int _height = src.height;
+    float angleStep = (float) angle / (divisions-1);
+    float opacity   = 1.0f / divisions;
+    float baseAngle = -((float) angle / 2);
+    ColorQuadArray qArray;
+    qArray.resize(5);
+    std::vector<Vertex> &vert = qArray.vertices;
+    int i = 0;
+    /* Center */
+    FloatRect texRect(0, 0, _width, _height);
+    FloatRect posRect(0, 0, _width, _height);
+    i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
+    /* Upper */
+    posRect = FloatRect(0, 0, _width, -_height);
+    i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
+    /* Lower */
+    posRect = FloatRect(0, _height*2, _width, -_height);
+    i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
+    /* Left */
+    posRect = FloatRect(0, 0, -_width, _height);
+    i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
+    /* Right */
+    posRect = FloatRect(_width*2, 0, -_width, _height);
+    i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
+    for (int i = 0; i < 4*5; ++i)
+      vert[i].color = Vec4(1, 1, 1, opacity);
+    qArray.commit();
+    FBO::bind(dst.fbo);
+    glState.clearColor.pushSet(Vec4());
+    FBO::clear();
+    Transform trans;
+    trans.setOrigin(Vec2(_width / 2.0f, _height / 2.0f));
+    trans.setPosition(Vec2(_width / 2.0f, _height / 2.0f));
+    glState.blendMode.pushSet(BlendAddition);
+    SimpleMatrixShader &shader = shState->shaders().simpleMatrix;
+    shader.bind();
+    TEX::bind(src.tex);
+    shader.setTexSize(Vec2i(src.texW, src.texH));
+    TEX::setSmooth(true);
+    glState.viewport.pushSet(IntRect(0, 0, dst.width, dst.height));
+    shader.applyViewportProj();
+    for (int i = 0; i < divisions; ++i) {
+      trans.setRotation(baseAngle + i*angleStep);
+      shader.setMatrix(trans.getMatrix());
+      qArray.draw();
+    }
+    glState.viewport.pop();
+    TEX::setSmooth(false);
+    glState.blendMode.pop();
+    glState.clearColor.pop();
+  }
+
   void fillRect(const IntRect &rect, const Vec4 &color)
   {
     bindFBO();
@@ -197,14 +360,189 @@ struct BitmapPrivate
     surf = surfConv;
   }
 
-  void onModified(bool freeSurface = true)
+  IntRect tileAt(int x, int y) const
+  {
+    IntRect tile(x - x % READBACK_TILE, y - y % READBACK_TILE,
+                 READBACK_TILE, READBACK_TILE);
+    tile.w = std::min(tile.w, gl.width - tile.x);
+    tile.h = std::min(tile.h, gl.height - tile.y);
+    return tile;
+  }
+
+  bool isReadable(const IntRect &rect)
+  {
+    pixman_box16_t box = { (int16_t) rect.x, (int16_t) rect.y,
+      (int16_t) (rect.x + rect.w), (int16_t) (rect.y + rect.h) };
+    return pixman_region_contains_rectangle(&readable, &box) == PIXMAN_REGION_IN;
+  }
+
+  void copyToSurface(const IntRect &rect, const uint8_t *pixels)
+  {
+    const int rowSize = rect.w * 4;
+    for (int i = 0; i < rect.h; ++i) {
+      uint8_t *dst = (uint8_t*) surface->pixels +
+                     (rect.y + i) * surface->pitch + rect.x * 4;
+      memcpy(dst, pixels + i * rowSize, rowSize);
+    }
+    pixman_region_union_rect(&readable, &readable, rect.x, rect.y, rect.w, rect.h);
+  }
+
+  // Stalls until the GPU has caught up, only used as a last resort
+  void readbackSync(const IntRect &rect)
+  {
+    std::vector<uint8_t> pixels(rect.w * rect.h * 4);
+    FBO::bind(gl.fbo);
+    ::gl.ReadPixels(rect.x, rect.y, rect.w, rect.h, GL_RGBA,
+                    GL_UNSIGNED_BYTE, &pixels[0]);
+    copyToSurface(rect, &pixels[0]);
+  }
+
+  void startPrefetch(const IntRect &rect)
+  {
+    if (!::gl.pbo_readback || rect.w <= 0 || rect.h <= 0) return;
+    cancelPrefetch();
+    if (!pbo) ::gl.GenBuffers(1, &pbo);
+    FBO::bind(gl.fbo);
+    ::gl.BindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    ::gl.BufferData(GL_PIXEL_PACK_BUFFER, rect.w * rect.h * 4, 0, GL_STREAM_READ);
+    ::gl.ReadPixels(rect.x, rect.y, rect.w, rect.h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    ::gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fence = ::gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    fetchRect = rect;
+  }
+
+  void cancelPrefetch()
+  {
+    if (!fence) return;
+    ::gl.DeleteSync(fence);
+    fence = 0;
+  }
+
+  // Returns false if the prefetched data couldn't be retrieved
+  bool finishPrefetch()
+  {
+    GLenum result = ::gl.ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                        PREFETCH_TIMEOUT);
+    cancelPrefetch();
+    if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED)
+      return false;
+    const IntRect &rect = fetchRect;
+    ::gl.BindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    void *pixels = ::gl.MapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                       rect.w * rect.h * 4, GL_MAP_READ_BIT);
+    if (pixels)
+      copyToSurface(rect, (const uint8_t*) pixels);
+    ::gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    ::gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return pixels != 0;
+  }
+
+  /* Makes sure 'rect' of the surface mirrors the texture,
+   * preferring an already finished prefetch over a stall */
+  void ensureReadable(const IntRect &rect)
+  {
+    if (!surface) allocSurface();
+    if (isReadable(rect)) return;
+    if (fence && SDL_HasIntersection(&rect, &fetchRect)) {
+      if (finishPrefetch() && isReadable(rect)) return;
+    }
+    readbackSync(rect);
+  }
+
+  void addHotArea(const IntRect &rect)
+  {
+    pixman_region_union_rect(&hot, &hot, rect.x, rect.y, rect.w, rect.h);
+    hotFrame = prefetchFrame();
+  }
+
+  /* Forgets hot areas nobody queried lately; returns false then */
+  bool keepHot()
   {
-    if (surface && freeSurface) {
+    if (!pixman_region_not_empty(&hot)) return false;
+    if (prefetchFrame() - hotFrame <= HOT_AREA_FRAMES) return true;
+    pixman_region_clear(&hot);
+    return false;
+  }
+
+  /* Pixel queries read back the surrounding tile, and keep
+   * it prefetched while they go on */
+  void ensurePixel(int x, int y)
+  {
+    IntRect tile = tileAt(x, y);
+    if (surface && isReadable(tile)) {
+      hotFrame = prefetchFrame();
+      return;
+    }
+    addHotArea(tile);
+    ensureReadable(tile);
+  }
+
+  void queuePrefetch()
+  {
+    if (prefetchLink.next || !keepHot()) return;
+    prefetchQueue().append(prefetchLink);
+  }
+
+  /* The mask only needs the surface temporarily; if there
+   * wasn't one around already it's freed again right away */
+  const AlphaMask &getMask()
+  {
+    if (mask) return *mask;
+    IntRect whole(0, 0, gl.width, gl.height);
+    bool hadSurface = surface != 0;
+    ensureReadable(whole);
+    mask = new AlphaMask((const uint8_t*) surface->pixels,
+                         gl.width, gl.height, surface->pitch);
+    if (!hadSurface) {
       SDL_FreeSurface(surface);
       surface = 0;
+      pixman_region_clear(&readable);
+    }
+    return *mask;
+  }
+
+  void onModified(bool freeSurface = true)
+  {
+    /* A pending prefetch might predate this change */
+    cancelPrefetch();
+    if (freeSurface) {
+      if (surface) {
+        SDL_FreeSurface(surface);
+        surface = 0;
+      }
+      pixman_region_clear(&readable);
+      delete mask;
+      mask = 0;
     }
+    queuePrefetch();
+    atlasStale = true;
+    Graphics::markDirty();
     self->modified();
   }
+
+  /* Makes sure the atlas copy is up to date; false if
+   * the bitmap is to be drawn from its own texture */
+  bool prepareAtlas()
+  {
+    if (atlasUpdates > ATLAS_UPDATE_MAX || megaSurface) return false;
+    BitmapAtlas &atlas = shState->bitmapAtlas();
+    if (!atlasSlot.valid() && !atlas.alloc(gl.width, gl.height, atlasSlot)) {
+      /* Too big or out of room, don't retry every frame */
+      atlasUpdates = ATLAS_UPDATE_MAX + 1;
+      return false;
+    }
+    if (!atlasStale) return true;
+    if (++atlasUpdates > ATLAS_UPDATE_MAX) {
+      atlas.release(atlasSlot);
+      return false;
+    }
+    GLMeta::blitBegin(atlas.page(atlasSlot.page));
+    GLMeta::blitSource(gl);
+    GLMeta::blitRectangle(IntRect(0, 0, gl.width, gl.height), atlasSlot.rect.pos());
+    GLMeta::blitEnd();
+    atlasStale = false;
+    return true;
+  }
 };
 
 struct BitmapOpenHandler : FileSystem::OpenHandler
@@ -244,7 +582,7 @@ Bitmap::Bitmap(const char *filename)
     p = new BitmapPrivate(this);
     p->gl = tex;
     TEX::bind(p->gl.tex);
-    TEX::uploadImage(p->gl.width, p->gl.height, imgSurf->pixels, GL_RGBA);
+    TEX::uploadSubImage(0, 0, p->gl.width, p->gl.height, imgSurf->pixels, GL_RGBA);
     SDL_FreeSurface(imgSurf);
   }
   p->addTaintedArea(rect());
@@ -261,7 +599,7 @@ Bitmap::Bitmap(int none)
   TEXFBO tex = shState->texPool().request(surface->w, surface->h);
   p->gl = tex;
   TEX::bind(p->gl.tex);
-  TEX::uploadImage(p->gl.width, p->gl.height, surface->pixels, GL_RGBA);
+  TEX::uploadSubImage(0, 0, p->gl.width, p->gl.height, surface->pixels, GL_RGBA);
   SDL_FreeSurface(surface);
   p->addTaintedArea(rect());
 }
@@ -397,10 +735,13 @@ void Bitmap::stretchBlt(const IntRect &destRect,
     GLMeta::blitSource(p->gl);
     GLMeta::blitRectangle(destRect, Vec2i());
     GLMeta::blitEnd();
-    FloatRect bltSubRect((float) sourceRect.x / source.width(),
-                         (float) sourceRect.y / source.height(),
-                         ((float) source.width() / sourceRect.w) * ((float) destRect.w / gpTex.width),
-                         ((float) source.height() / sourceRect.h) * ((float) destRect.h / gpTex.height));
+    /* In the units of the source texcoords, which bindTexture
+     * normalizes by the padded texture size */
+    const TEXFBO &srcGL = source.p->gl;
+    FloatRect bltSubRect((float) sourceRect.x / srcGL.texW,
+                         (float) sourceRect.y / srcGL.texH,
+                         ((float) srcGL.texW / sourceRect.w) * ((float) destRect.w / gpTex.texW),
+                         ((float) srcGL.texH / sourceRect.h) * ((float) destRect.h / gpTex.texH));
     BltShader &shader = shState->shaders().blt;
     shader.bind();
     shader.setDestination(gpTex.tex);
@@ -491,29 +832,8 @@ void Bitmap::blur()
 {
   guardDisposed();
   GUARD_MEGA;
-  Quad &quad = shState->gpQuad();
-  FloatRect rect(0, 0, width(), height());
-  quad.setTexPosRect(rect, rect);
   TEXFBO auxTex = shState->texPool().request(width(), height());
-  BlurShader &shader = shState->shaders().blur;
-  BlurShader::HPass &pass1 = shader.pass1;
-  BlurShader::VPass &pass2 = shader.pass2;
-  glState.blend.pushSet(false);
-  glState.viewport.pushSet(IntRect(0, 0, width(), height()));
-  TEX::bind(p->gl.tex);
-  FBO::bind(auxTex.fbo);
-  pass1.bind();
-  pass1.setTexSize(Vec2i(width(), height()));
-  pass1.applyViewportProj();
-  quad.draw();
-  TEX::bind(auxTex.tex);
-  p->bindFBO();
-  pass2.bind();
-  pass2.setTexSize(Vec2i(width(), height()));
-  pass2.applyViewportProj();
-  quad.draw();
-  glState.viewport.pop();
-  glState.blend.pop();
+  p->blurPass(p->gl, auxTex);
   shState->texPool().release(auxTex);
   p->onModified();
 }
@@ -522,58 +842,8 @@ void Bitmap::radialBlur(int angle, int divisions)
 {
   guardDisposed();
   GUARD_MEGA;
-  angle     = clamp<int>(angle, 0, 359);
-  divisions = clamp<int>(divisions, 2, 100);
-  const int _width = width();
-  const int _height = height();
-  float angleStep = (float) angle / (divisions-1);
-  float opacity   = 1.0f / divisions;
-  float baseAngle = -((float) angle / 2);
-  ColorQuadArray qArray;
-  qArray.resize(5);
-  std::vector<Vertex> &vert = qArray.vertices;
-  int i = 0;
-  /* Center */
-  FloatRect texRect(0, 0, _width, _height);
-  FloatRect posRect(0, 0, _width, _height);
-  i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
-  /* Upper */
-  posRect = FloatRect(0, 0, _width, -_height);
-  i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
-  /* Lower */
-  posRect = FloatRect(0, _height*2, _width, -_height);
-  i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
-  /* Left */
-  posRect = FloatRect(0, 0, -_width, _height);
-  i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
-  /* Right */
-  posRect = FloatRect(_width*2, 0, -_width, _height);
-  i += Quad::setTexPosRect(&vert[i*4], texRect, posRect);
-  for (int i = 0; i < 4*5; ++i)
-    vert[i].color = Vec4(1, 1, 1, opacity);
-  qArray.commit();
-  TEXFBO newTex = shState->texPool().request(_width, _height);
-  FBO::bind(newTex.fbo);
-  glState.clearColor.pushSet(Vec4());
-  FBO::clear();
-  Transform trans;
-  trans.setOrigin(Vec2(_width / 2.0f, _height / 2.0f));
-  trans.setPosition(Vec2(_width / 2.0f, _height / 2.0f));
-  glState.blendMode.pushSet(BlendAddition);
-  SimpleMatrixShader &shader = shState->shaders().simpleMatrix;
-  shader.bind();
-  p->bindTexture(shader);
-  TEX::setSmooth(true);
-  p->pushSetViewport(shader);
-  for (int i = 0; i < divisions; ++i) {
-    trans.setRotation(baseAngle + i*angleStep);
-    shader.setMatrix(trans.getMatrix());
-    qArray.draw();
-  }
-  p->popViewport();
-  TEX::setSmooth(false);
-  glState.blendMode.pop();
-  glState.clearColor.pop();
+  TEXFBO newTex = shState->texPool().request(width(), height());
+  p->radialBlurPass(p->gl, newTex, angle, divisions);
   shState->texPool().release(p->gl);
   p->gl = newTex;
   p->onModified();
@@ -600,11 +870,31 @@ static uint32_t &getPixelAt(SDL_Surface *surf, SDL_PixelFormat *form, int x, int
 
 void Bitmap::makeSurface() const
 {
-  p->allocSurface();
-  FBO::bind(p->gl.fbo);
-  glState.viewport.pushSet(IntRect(0, 0, width(), height()));
-  gl.ReadPixels(0, 0, width(), height(), GL_RGBA, GL_UNSIGNED_BYTE, p->surface->pixels);
-  glState.viewport.pop();
+  p->ensureReadable(rect());
+}
+
+void Bitmap::prefetch(const IntRect &area)
+{
+  guardDisposed();
+  GUARD_MEGA;
+  SDL_Rect bounds = { 0, 0, width(), height() };
+  IntRect clipped;
+  if (!SDL_IntersectRect(&area, &bounds, &clipped)) return;
+  p->addHotArea(clipped);
+  p->startPrefetch(clipped);
+}
+
+void Bitmap::flushPrefetches()
+{
+  IntruList<BitmapPrivate> &queue = BitmapPrivate::prefetchQueue();
+  ++BitmapPrivate::prefetchFrame();
+  while (!queue.isEmpty()) {
+    BitmapPrivate *bp = queue.begin()->data;
+    queue.remove(bp->prefetchLink);
+    if (!bp->keepHot()) continue;
+    pixman_box16_t *ext = pixman_region_extents(&bp->hot);
+    bp->startPrefetch(IntRect(ext->x1, ext->y1, ext->x2 - ext->x1, ext->y2 - ext->y1));
+  }
 }
 
 bool Bitmap::is_alpha_pixel(int x, int y) const
@@ -612,10 +902,18 @@ bool Bitmap::is_alpha_pixel(int x, int y) const
   guardDisposed();
   GUARD_MEGA;
   if (x < 0 || y < 0 || x >= width() || y >= height()) return false;
-  if (!p->surface) makeSurface();
+  if (p->mask) return !p->mask->opaque(x, y);
+  /* Only reads back the tile around the pixel */
+  p->ensurePixel(x, y);
   uint32_t pixel = getPixelAt(p->surface, p->format, x, y);
-  uint8_t alpha = (pixel >> p->format->Ashift) & 0xFF;
-  return alpha == 0;
+  return ((pixel >> p->format->Ashift) & 0xFF) == 0;
+}
+
+const AlphaMask &Bitmap::alphaMask() const
+{
+  guardDisposed();
+  GUARD_MEGA;
+  return p->getMask();
 }
 
 Color Bitmap::getPixel(int x, int y) const
@@ -623,7 +921,7 @@ Color Bitmap::getPixel(int x, int y) const
   guardDisposed();
   GUARD_MEGA;
   if (x < 0 || y < 0 || x >= width() || y >= height()) return Vec4();
-  if (!p->surface) makeSurface();
+  p->ensurePixel(x, y);
   uint32_t pixel = getPixelAt(p->surface, p->format, x, y);
   return Color((pixel >> p->format->Rshift) & 0xFF,
                (pixel >> p->format->Gshift) & 0xFF,
@@ -651,6 +949,7 @@ void Bitmap::setPixel(int x, int y, const Color &color)
     uint32_t &surfPixel = getPixelAt(p->surface, p->format, x, y);
     surfPixel = SDL_MapRGBA(p->format, pixel[0], pixel[1], pixel[2], pixel[3]);
   }
+  if (p->mask) p->mask->set(x, y, pixel[3] != 0);
   p->onModified(false);
 }
 
@@ -658,33 +957,8 @@ void Bitmap::invert_colors()
 {
   guardDisposed();
   GUARD_MEGA;
-  if (!p->surface) makeSurface();
-  SDL_PixelFormat *fmt = p->format;
-  int w = p->gl.width, h = p->gl.height;
-  uint8_t invert[w * 4];
-  for (int y = 0; y < h; y++) {
-    for (int x = 0; x < w; x++) {
-      uint32_t pixel = getPixelAt(p->surface, fmt, x, y);
-      Color c((pixel >> p->format->Rshift) & 0xFF,
-              (pixel >> p->format->Gshift) & 0xFF,
-              (pixel >> p->format->Bshift) & 0xFF,
-              (pixel >> p->format->Ashift) & 0xFF);
-      if (c.alpha == 0) {
-        invert[x * 4] = 0;
-        invert[x * 4 + 1] = 0;
-        invert[x * 4 + 2] = 0;
-        invert[x * 4 + 3] = 0;
-        continue;
-      }
-      invert[x * 4] = 255.0 - c.red;
-      invert[x * 4 + 1] = 255.0 - c.green;
-      invert[x * 4 + 2] = 255.0 - c.blue;
-      invert[x * 4 + 3] = c.alpha;
-    }
-    TEX::bind(p->gl.tex);
-    TEX::uploadSubImage(0, y, w, 1, &invert, GL_RGBA);
-  }
-  p->onModified();
+  InvertShader &shader = shState->shaders().invert;
+  apply_this_shader(shader);
 }
 
 void Bitmap::hueChange(int hue)
@@ -760,7 +1034,95 @@ void Bitmap::turn_sepia()
   apply_this_shader(shader);
 }
 
-void Bitmap::pixelate() {}
+void Bitmap::pixelate(int size)
+{
+  guardDisposed();
+  GUARD_MEGA;
+  if (size <= 1) return;
+  PixelateShader &shader = shState->shaders().pixel;
+  p->setupPixelate(shader, p->gl, size);
+  apply_this_shader(shader);
+}
+
+static bool isColorMatrixEffect(const BitmapEffect &effect)
+{
+  return effect.type <= BitmapEffect::Tone;
+}
+
+static ColorMatrix effectColorMatrix(const BitmapEffect &effect)
+{
+  const float *a = effect.args;
+  switch (effect.type) {
+  case BitmapEffect::Gray :
+    return ColorMatrix::gray(a[0]);
+  case BitmapEffect::Sepia :
+    return ColorMatrix::sepia();
+  case BitmapEffect::Hue :
+    return ColorMatrix::hue(a[0]);
+  case BitmapEffect::Tone :
+    return ColorMatrix::tone(a[0], a[1], a[2], a[3]);
+  default :
+    return ColorMatrix();
+  }
+}
+
+void Bitmap::applyEffects(const std::vector<BitmapEffect> &effects)
+{
+  guardDisposed();
+  GUARD_MEGA;
+  if (effects.empty()) return;
+  TEXFBO tex[2] = { p->gl, shState->texPool().request(width(), height()) };
+  int cur = 0;
+  ColorMatrix matrix;
+  bool pendingMatrix = false;
+  for (size_t i = 0; i <= effects.size(); ++i) {
+    if (i < effects.size() && isColorMatrixEffect(effects[i])) {
+      matrix = effectColorMatrix(effects[i]) * matrix;
+      pendingMatrix = true;
+      continue;
+    }
+    if (pendingMatrix) {
+      float mat[16];
+      matrix.toGL(mat);
+      ColorMatrixShader &shader = shState->shaders().colorMatrix;
+      shader.bind();
+      shader.setColorMatrix(mat);
+      p->shaderPass(shader, tex[cur], tex[cur^1]);
+      cur ^= 1;
+      matrix = ColorMatrix();
+      pendingMatrix = false;
+    }
+    if (i == effects.size()) break;
+    const BitmapEffect &effect = effects[i];
+    switch (effect.type) {
+    case BitmapEffect::Invert :
+      p->shaderPass(shState->shaders().invert, tex[cur], tex[cur^1]);
+      cur ^= 1;
+      break;
+    case BitmapEffect::Pixelate : {
+      int size = effect.args[0];
+      if (size <= 1) break;
+      PixelateShader &shader = shState->shaders().pixel;
+      p->setupPixelate(shader, tex[cur], size);
+      p->shaderPass(shader, tex[cur], tex[cur^1]);
+      cur ^= 1;
+      break;
+    }
+    case BitmapEffect::Blur :
+      p->blurPass(tex[cur], tex[cur^1]);
+      break;
+    case BitmapEffect::RadialBlur :
+      p->radialBlurPass(tex[cur], tex[cur^1], effect.args[0], effect.args[1]);
+      cur ^= 1;
+      break;
+    default :
+      break;
+    }
+  }
+  p->gl = tex[cur];
+  shState->texPool().release(tex[cur^1]);
+  p->onModified();
+}
 
 void Bitmap::drawText(int x, int y, int width, int height,
                       const char *str, int align)
@@ -789,6 +1151,143 @@ SDL_Surface* Bitmap::render_str(bool is_solid, const char *str, SDL_Color c)
     return TTF_RenderUTF8_Blended(p->font->getSdlFont(), str, c);
 }
 
+static uint32_t packColor(const Color &c)
+{
+  SDL_Color sc = c.toSDLColor();
+  return (sc.r << 24) | (sc.g << 16) | (sc.b << 8) | sc.a;
+}
+
+static Vec4 opaqueColor(uint32_t c)
+{
+  return Vec4((c >> 24) / 255.0f, ((c >> 16) & 0xFF) / 255.0f,
+              ((c >> 8) & 0xFF) / 255.0f, 1.0f);
+}
+
+/* Lays out the string described by 'key' and splits it into
+ * the shadow, outline and fill layers drawAtlasText composes */
+static void layoutAtlasText(const TextKey &key, TextRun &tr)
+{
+  GlyphAtlas &atlas = shState->glyphAtlas();
+  atlas.layout(key.font, key.outline, key.str.c_str(), tr.run);
+  tr.generation = atlas.generation();
+  tr.width = tr.run.width;
+  tr.height = tr.run.height;
+  Vec2i fillPos;
+  std::vector<Vec2i> shadowPos;
+  int shapx = key.shadowSize;
+  if (shapx > 0) {
+    int mode = key.shadowMode;
+    for (int n = 0; n < shapx; n++) {
+      Vec2i d(0, 1);
+      if (mode == 0) d.y = 2;
+      else if (mode == 1) d.x = 1;
+      for (size_t i = 0; i < shadowPos.size(); ++i)
+        shadowPos[i] += d;
+      fillPos += d;
+      // Every new shadow ends up below the previous ones
+      shadowPos.insert(shadowPos.begin(), Vec2i(mode == 2 ? n + 1 : 0, 1));
+    }
+    tr.width += shapx * 2;
+    tr.height += shapx * 2;
+  }
+  Vec2i base;
+  if (key.outline > 0) {
+    tr.layers.push_back(GlyphLayer(true, Vec2i(), opaqueColor(key.outColor)));
+    base = Vec2i(key.outline, key.outline);
+    tr.width = tr.run.width + key.outline * 2;
+    tr.height = tr.run.height + key.outline * 2;
+  }
+  for (size_t i = 0; i < shadowPos.size(); ++i)
+    tr.layers.push_back(GlyphLayer(false, base + shadowPos[i],
+                                   opaqueColor(key.shadowColor)));
+  tr.layers.push_back(GlyphLayer(false, base + fillPos, opaqueColor(key.color)));
+}
+
+/* Same result as the SDL_ttf path below, but the glyphs come
+ * out of the shared atlas and get composed on the GPU. Shadows
+ * and outlines are reproduced layer by layer, keeping the
+ * offsets and the final surface size the iterative blits of
+ * the surface based version end up with */
+void Bitmap::drawAtlasText(const IntRect &rect, const char *str, int align)
+{
+  Font *f = p->font;
+  TTF_Font *font = f->getSdlFont();
+  bool is_outline = f->get_outline();
+  bool is_shadow = f->get_shadow();
+  float txtAlpha = f->get_color().norm.w;
+  TextKey key(str, font, TTF_GetFontStyle(font));
+  key.outline = is_outline ? f->get_outline_size() : 0;
+  key.shadowSize = is_shadow ? f->get_shadow_size() : 0;
+  key.shadowMode = is_shadow ? f->get_shadow_mode() : 0;
+  key.color = packColor(f->get_color());
+  key.outColor = is_outline ? packColor(f->get_out_color()) : 0;
+  key.shadowColor = is_shadow ? packColor(f->get_shadow_color()) : 0;
+  TextCache &cache = shState->textCache();
+  GlyphAtlas &atlas = shState->glyphAtlas();
+  const TextRun *cached = cache.findRun(key, atlas.generation());
+  TextRun fresh;
+  if (!cached) {
+    layoutAtlasText(key, fresh);
+    cache.storeRun(key, fresh);
+    cached = &fresh;
+  }
+  const TextRun &tr = *cached;
+  int txtW = tr.width, txtH = tr.height;
+  TEXFBO &txt = atlas.render(tr.run, tr.layers);
+  int alignX = rect.x;
+  switch (align) {
+  default:
+  case Left :
+    break;
+  case Center :
+    alignX += (rect.w - txtW) / 2;
+    break;
+  case Right :
+    alignX += rect.w - txtW;
+    break;
+  }
+  if (alignX < rect.x) alignX = rect.x;
+  int alignY = rect.y + (rect.h - txtH) / 2;
+  float squeeze = (float) rect.w / txtW;
+  if (f->get_no_squeeze() || squeeze > 1) squeeze = 1;
+  IntRect posRect(alignX, alignY, txtW * squeeze, txtH);
+  bool fastBlit = !p->touchesTaintedArea(posRect) && txtAlpha == 1.0f;
+  if (fastBlit) {
+    GLMeta::blitBegin(p->gl);
+    GLMeta::blitSource(txt);
+    GLMeta::blitRectangle(IntRect(0, 0, txtW, txtH), posRect, squeeze != 1.0f);
+    GLMeta::blitEnd();
+  } else {
+    // Acquire partial copy of the destination buffer we're about to render to
+    TEXFBO &gpTex2 = shState->gpTexFBO(posRect.w, posRect.h);
+    GLMeta::blitBegin(gpTex2);
+    GLMeta::blitSource(p->gl);
+    GLMeta::blitRectangle(posRect, Vec2i());
+    GLMeta::blitEnd();
+    FloatRect bltRect(0, 0, (float) (txt.width * squeeze) / gpTex2.width,
+                      (float) txt.height / gpTex2.height);
+    BltShader &shader = shState->shaders().blt;
+    shader.bind();
+    shader.setTexSize(Vec2i(txt.width, txt.height));
+    shader.setSource();
+    shader.setDestination(gpTex2.tex);
+    shader.setSubRect(bltRect);
+    shader.setOpacity(txtAlpha);
+    TEX::bind(txt.tex);
+    TEX::setSmooth(squeeze != 1.0f);
+    Quad &quad = shState->gpQuad();
+    quad.setTexRect(FloatRect(0, 0, txtW, txtH));
+    quad.setPosRect(posRect);
+    p->bindFBO();
+    p->pushSetViewport(shader);
+    p->blitQuad(quad);
+    p->popViewport();
+    TEX::setSmooth(false);
+  }
+  p->addTaintedArea(posRect);
+  p->onModified();
+}
+
 void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 {
   guardDisposed();
@@ -798,6 +1297,12 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
   if (*str == '\0') return;
   if (str[0] == ' ' && str[1] == '\0') return;
   bool is_solid = shState->rtData().config.solidFonts;
+  if (shState->config().glyphAtlas && !is_solid &&
+      !p->font->get_underline() && !p->font->get_strikethrough())
+  {
+    drawAtlasText(rect, str, align);
+    return;
+  }
   Font *f = p->font;
   TTF_Font *font = f->getSdlFont();
   const Color &fontColor = f->get_color();
@@ -946,38 +1451,18 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
   SDL_FreeSurface(surf);//p->addTaintedArea(posRect);
   p->onModified();
 }
-/* http://www.lemoda.net/c/utf8-to-ucs2/index.html */
-static uint16_t utf8_to_ucs2(const char *_input, const char **end_ptr)
-{
-  const unsigned char *input = reinterpret_cast<const unsigned char*>(_input);
-  *end_ptr = _input;
-  if (input[0] == 0) return -1;
-  if (input[0] < 0x80) {
-    *end_ptr = _input + 1;
-    return input[0];
-  }
-  if ((input[0] & 0xE0) == 0xE0) {
-    if (input[1] == 0 || input[2] == 0) return -1;
-    *end_ptr = _input + 3;
-    return (input[0] & 0x0F)<<12 |
-           (input[1] & 0x3F)<<6  |
-           (input[2] & 0x3F);
-  }
-  if ((input[0] & 0xC0) == 0xC0) {
-    if (input[1] == 0) return -1;
-    *end_ptr = _input + 2;
-    return (input[0] & 0x1F)<<6 | (input[1] & 0x3F);
-  }
-  return -1;
-}
-
-IntRect Bitmap::textSize(const char *str)
+/* Shared by the text_size family; results are cached per
+ * string, font handle and style since scripts tend to measure
+ * the same few strings again every frame */
+static IntRect measureText(Font &f, const char *str)
 {
-  guardDisposed();
-  GUARD_MEGA;
-  TTF_Font *font = p->font->getSdlFont();
+  TTF_Font *font = f.getSdlFont();
   std::string fixed = fixupString(str);
   str = fixed.c_str();
+  TextKey key(str, font, TTF_GetFontStyle(font));
+  TextCache &cache = shState->textCache();
+  IntRect size;
+  if (cache.findSize(key, size)) return size;
   int w, h;
   TTF_SizeUTF8(font, str, &w, &h);
   /* If str is one character long, *endPtr == 0 */
@@ -985,40 +1470,32 @@ IntRect Bitmap::textSize(const char *str)
   uint16_t ucs2 = utf8_to_ucs2(str, &endPtr);
   /* For cursive characters, returning the advance
    * as width yields better results */
-  if (p->font->get_italic() && *endPtr == '\0')
+  if (f.get_italic() && *endPtr == '\0')
     TTF_GlyphMetrics(font, ucs2, 0, 0, 0, 0, &w);
-  return IntRect(0, 0, w, h);
+  size = IntRect(0, 0, w, h);
+  cache.storeSize(key, size);
+  return size;
+}
+
+IntRect Bitmap::textSize(const char *str)
+{
+  guardDisposedQuiet();
+  GUARD_MEGA;
+  return measureText(*p->font, str);
 }
 
 int Bitmap::textWidth(const char *str)
 {
-  guardDisposed();
+  guardDisposedQuiet();
   GUARD_MEGA;
-  TTF_Font *font = p->font->getSdlFont();
-  std::string fixed = fixupString(str);
-  str = fixed.c_str();
-  int w, h;
-  TTF_SizeUTF8(font, str, &w, &h);
-  /* If str is one character long, *endPtr == 0 */
-  const char *endPtr;
-  uint16_t ucs2 = utf8_to_ucs2(str, &endPtr);
-  /* For cursive characters, returning the advance
-   * as width yields better results */
-  if (p->font->get_italic() && *endPtr == '\0')
-    TTF_GlyphMetrics(font, ucs2, 0, 0, 0, 0, &w);
-  return w;
+  return measureText(*p->font, str).w;
 }
 
 int Bitmap::textHeight(const char *str)
 {
-  guardDisposed();
+  guardDisposedQuiet();
   GUARD_MEGA;
-  TTF_Font *font = p->font->getSdlFont();
-  std::string fixed = fixupString(str);
-  str = fixed.c_str();
-  int w, h;
-  TTF_SizeUTF8(font, str, &w, &h);
-  return h;
+  return measureText(*p->font, str).h;
 }
 
 Font& Bitmap::getFont() const
@@ -1037,6 +1514,29 @@ void Bitmap::setInitFont(Font *value)
   p->font = value;
 }
 
+const TEXFBO &Bitmap::prepareDrawTex(Vec2i &offset)
+{
+  if (p->prepareAtlas()) {
+    offset = p->atlasSlot.rect.pos();
+    return shState->bitmapAtlas().page(p->atlasSlot.page);
+  }
+  offset = Vec2i();
+  return p->gl;
+}
+
+const TEXFBO &Bitmap::drawTex() const
+{
+  if (!p->atlasSlot.valid()) return p->gl;
+  return shState->bitmapAtlas().page(p->atlasSlot.page);
+}
+
+void Bitmap::bindDrawTex(ShaderBase &shader)
+{
+  const TEXFBO &tex = drawTex();
+  TEX::bind(tex.tex);
+  shader.setTexSize(Vec2i(tex.texW, tex.texH));
+}
+
 TEXFBO &Bitmap::getGLTypes()
 {
   return p->gl;
@@ -1049,7 +1549,7 @@ SDL_Surface *Bitmap::megaSurface() const
 
 SDL_Surface *Bitmap::surface() const
 {
-  if (!p->surface) makeSurface();
+  makeSurface();
   return p->surface;
 }
 
@@ -26,6 +26,7 @@
 #include "etc-internal.h"
 #include "etc.h"
 #include <sigc++/signal.h>
+#include <vector>
 
 class Font;
 class ShaderBase;
@@ -33,6 +34,33 @@ struct TEXFBO;
 struct SDL_Surface;
 
 struct BitmapPrivate;
+class AlphaMask;
+
+/* One step of Bitmap::applyEffects */
+struct BitmapEffect
+{
+  enum Type
+  {
+    // Color matrix effects, fused into a single pass
+    Gray,       // amount (0 ~ 1)
+    Sepia,
+    Hue,        // degrees
+    Tone,       // red, green, blue, gray (normalized)
+    // Effects needing their own passes
+    Invert,
+    Blur,
+    RadialBlur, // angle, divisions
+    Pixelate    // block size
+  };
+  Type type;
+  float args[4];
+
+  BitmapEffect(Type type, float a = 0, float b = 0, float c = 0, float d = 0)
+  : type(type)
+  {
+    args[0] = a; args[1] = b; args[2] = c; args[3] = d;
+  }
+};
 // FIXME make this class use proper RGSS classes again
 class Bitmap : public Disposable
 {
@@ -64,14 +92,26 @@ public:
   void radialBlur(int angle, int divisions);
   void clear();
   void makeSurface() const;
+  /* Starts reading 'area' back into client memory, so
+   * get_pixel calls a frame later don't stall on the GPU */
+  void prefetch(const IntRect &area);
+  /* Prefetches the areas of all bitmaps queried for pixels
+   * and modified since; called once per frame */
+  static void flushPrefetches();
   bool is_alpha_pixel(int x, int y) const;
+  // Opacity bitmask, for pixel perfect collision tests
+  const AlphaMask &alphaMask() const;
   Color getPixel(int x, int y) const;
   void setPixel(int x, int y, const Color &color);
   void invert_colors();
   void hueChange(int hue);
   void gray_out();
   void turn_sepia();
-  void pixelate();
+  // Every size * size block takes the color of its center pixel
+  void pixelate(int size = 4);
+  /* Runs all effects in order, ping-ponging between the bitmap's
+   * texture and a single pooled one */
+  void applyEffects(const std::vector<BitmapEffect> &effects);
   enum TextAlign
   {
     Left = 0,
@@ -94,12 +134,22 @@ public:
   void ensureNonMega() const;
   // Binds the backing texture and sets the correct texture size uniform in shader
   void bindTex(ShaderBase &shader);
+  /* Small bitmaps rarely modified are drawn by sprites out of
+   * a shared atlas page. Brings the bitmap's copy in there
+   * up to date and returns the texture bindDrawTex() binds,
+   * with 'offset' set to where the bitmap lies in it.
+   * Call before rendering starts */
+  const TEXFBO &prepareDrawTex(Vec2i &offset);
+  // The texture bindDrawTex() binds
+  const TEXFBO &drawTex() const;
+  void bindDrawTex(ShaderBase &shader);
   // Adds 'rect' to tainted area
   void taintArea(const IntRect &rect);
   sigc::signal<void> modified;
 
 private:
   SDL_Surface* render_str(bool is_solid, const char *str, SDL_Color c);
+  void drawAtlasText(const IntRect &rect, const char *str, int align);
   void apply_this_shader(ShaderBase &shader, bool enable, Vec4 vec);
   void releaseResources();
   const char *klassName() const { return "Bitmap"; }
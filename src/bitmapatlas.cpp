@@ -0,0 +1,180 @@
+/*
+** bitmapatlas.cpp
+**
+** This file is part of HiddenChest
+*/
+
+#include "bitmapatlas.h"
+#include "gl-util.h"
+#include "glstate.h"
+#include <vector>
+#include <algorithm>
+
+#define ATLAS_PAGE_SIZE 1024
+#define ATLAS_PAGE_MAX  4
+/* Empty space kept to the right of and below every cell,
+ * so sampling across a cell's edge never hits a neighbour */
+#define ATLAS_PADDING   1
+
+/* A horizontal segment of the skyline, everything
+ * above 'y' between 'x' and 'x + w' is occupied */
+struct SkylineNode
+{
+  int x, y, w;
+  SkylineNode(int x, int y, int w) : x(x), y(y), w(w) {}
+};
+
+struct AtlasPage
+{
+  TEXFBO tex;
+  std::vector<SkylineNode> skyline;
+  /* Cells handed out and not released yet */
+  int live;
+};
+
+struct BitmapAtlasPrivate
+{
+  std::vector<AtlasPage> pages;
+  int pageSize;
+  int maxSize;
+
+  BitmapAtlasPrivate(int maxSize)
+  : pageSize(std::min<int>(ATLAS_PAGE_SIZE, glState.caps.maxTexSize)),
+    maxSize(std::min(maxSize, pageSize / 4))
+  {}
+
+  ~BitmapAtlasPrivate()
+  {
+    for (size_t i = 0; i < pages.size(); ++i)
+      TEXFBO::fini(pages[i].tex);
+  }
+
+  void reset(AtlasPage &page)
+  {
+    page.skyline.clear();
+    page.skyline.push_back(SkylineNode(0, 0, pageSize));
+    page.live = 0;
+    FBO::bind(page.tex.fbo);
+    glState.scissorTest.pushSet(false);
+    glState.clearColor.pushSet(Vec4());
+    FBO::clear();
+    glState.clearColor.pop();
+    glState.scissorTest.pop();
+  }
+
+  bool addPage()
+  {
+    if (pages.size() >= ATLAS_PAGE_MAX) return false;
+    pages.push_back(AtlasPage());
+    AtlasPage &page = pages.back();
+    TEXFBO::init(page.tex);
+    TEXFBO::allocEmpty(page.tex, pageSize, pageSize);
+    TEXFBO::linkFBO(page.tex);
+    reset(page);
+    return true;
+  }
+
+  /* Lowest y a w*h cell starting at node 'i' can sit at, or -1 */
+  int fit(const std::vector<SkylineNode> &skyline, size_t i, int w, int h)
+  {
+    if (skyline[i].x + w > pageSize) return -1;
+    int y = 0;
+    for (int left = w; left > 0; left -= skyline[i++].w) {
+      y = std::max(y, skyline[i].y);
+      if (y + h > pageSize) return -1;
+    }
+    return y;
+  }
+
+  void place(std::vector<SkylineNode> &skyline, size_t i, int x, int y, int w, int h)
+  {
+    skyline.insert(skyline.begin() + i, SkylineNode(x, y + h, w));
+    /* Cut away the segments now lying below the new one */
+    const int right = x + w;
+    while (i + 1 < skyline.size() && skyline[i+1].x < right) {
+      SkylineNode &n = skyline[i+1];
+      int shrink = right - n.x;
+      if (shrink < n.w) {
+        n.x += shrink;
+        n.w -= shrink;
+        break;
+      }
+      skyline.erase(skyline.begin() + i + 1);
+    }
+    /* Merge segments of equal height */
+    for (size_t j = 0; j + 1 < skyline.size();) {
+      if (skyline[j].y == skyline[j+1].y) {
+        skyline[j].w += skyline[j+1].w;
+        skyline.erase(skyline.begin() + j + 1);
+      } else {
+        ++j;
+      }
+    }
+  }
+
+  /* Bottom left rule: lowest resulting top edge,
+   * ties going to the narrowest segment */
+  bool allocIn(AtlasPage &page, int w, int h, IntRect &out)
+  {
+    std::vector<SkylineNode> &skyline = page.skyline;
+    int bestI = -1, bestBottom = pageSize + 1, bestW = pageSize + 1, bestY = 0;
+    for (size_t i = 0; i < skyline.size(); ++i) {
+      int y = fit(skyline, i, w, h);
+      if (y < 0) continue;
+      if (y + h < bestBottom || (y + h == bestBottom && skyline[i].w < bestW)) {
+        bestI = i;
+        bestBottom = y + h;
+        bestW = skyline[i].w;
+        bestY = y;
+      }
+    }
+    if (bestI < 0) return false;
+    out = IntRect(skyline[bestI].x, bestY, w, h);
+    place(skyline, bestI, out.x, out.y, w, h);
+    ++page.live;
+    return true;
+  }
+};
+
+BitmapAtlas::BitmapAtlas(int maxSize)
+{
+  p = new BitmapAtlasPrivate(maxSize);
+}
+
+BitmapAtlas::~BitmapAtlas()
+{
+  delete p;
+}
+
+bool BitmapAtlas::accepts(int width, int height) const
+{
+  return width <= p->maxSize && height <= p->maxSize;
+}
+
+bool BitmapAtlas::alloc(int width, int height, AtlasSlot &slot)
+{
+  if (!accepts(width, height)) return false;
+  const int w = width + ATLAS_PADDING, h = height + ATLAS_PADDING;
+  IntRect cell;
+  for (size_t i = 0; i <= p->pages.size(); ++i) {
+    if (i == p->pages.size() && !p->addPage()) return false;
+    if (!p->allocIn(p->pages[i], w, h, cell)) continue;
+    slot.page = i;
+    slot.rect = IntRect(cell.x, cell.y, width, height);
+    return true;
+  }
+  return false;
+}
+
+void BitmapAtlas::release(AtlasSlot &slot)
+{
+  if (!slot.valid()) return;
+  AtlasPage &page = p->pages[slot.page];
+  if (--page.live == 0) p->reset(page);
+  slot = AtlasSlot();
+}
+
+TEXFBO &BitmapAtlas::page(int index)
+{
+  return p->pages[index].tex;
+}
@@ -0,0 +1,47 @@
+/*
+** bitmapatlas.h
+**
+** This file is part of HiddenChest
+*/
+
+#ifndef BITMAPATLAS_H
+#define BITMAPATLAS_H
+
+#include "etc-internal.h"
+
+struct TEXFBO;
+struct BitmapAtlasPrivate;
+
+/* A cell of one of the atlas pages */
+struct AtlasSlot
+{
+  int page;
+  IntRect rect;
+
+  AtlasSlot() : page(-1) {}
+  bool valid() const { return page >= 0; }
+};
+
+/* Large shared textures small bitmaps are copied into,
+ * so sprites showing icons, faces and the like all sample
+ * from a handful of textures. Pages are packed skyline
+ * style; freed cells are only reclaimed once their whole
+ * page has been emptied */
+class BitmapAtlas
+{
+public:
+  /* 'maxSize' is the largest width and height accepted,
+   * 0 disables the atlas altogether */
+  BitmapAtlas(int maxSize);
+  ~BitmapAtlas();
+  bool accepts(int width, int height) const;
+  /* Returns false if no page has room left */
+  bool alloc(int width, int height, AtlasSlot &slot);
+  void release(AtlasSlot &slot);
+  TEXFBO &page(int index);
+
+private:
+  BitmapAtlasPrivate *p;
+};
+
+#endif // BITMAPATLAS_H
@@ -0,0 +1,104 @@
+/*
+** colormatrix.h
+**
+** This file is part of HiddenChest
+*/
+
+#ifndef COLORMATRIX_H
+#define COLORMATRIX_H
+
+#include <math.h>
+#include <string.h>
+
+/* Affine transformation of RGB colors (3x3 matrix plus offset),
+ * so any number of per pixel color effects can be folded
+ * together and applied in a single shader pass */
+struct ColorMatrix
+{
+  /* Rows map to output channels, column 3 is the offset */
+  float m[3][4];
+
+  ColorMatrix()
+  {
+    memset(m, 0, sizeof(m));
+    m[0][0] = m[1][1] = m[2][2] = 1;
+  }
+
+  /* Applies 'this' after 'other' */
+  ColorMatrix operator*(const ColorMatrix &other) const
+  {
+    ColorMatrix r;
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 4; ++j) {
+        float v = j == 3 ? m[i][3] : 0;
+        for (int k = 0; k < 3; ++k)
+          v += m[i][k] * other.m[k][j];
+        r.m[i][j] = v;
+      }
+    }
+    return r;
+  }
+
+  /* Column major 4x4, as expected by glUniformMatrix4fv */
+  void toGL(float out[16]) const
+  {
+    memset(out, 0, sizeof(float) * 16);
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 4; ++j)
+        out[j * 4 + i] = m[i][j];
+    out[15] = 1;
+  }
+
+  /* Blends towards luma by 'amount' (0 ~ 1) */
+  static ColorMatrix gray(float amount)
+  {
+    static const float luma[3] = { .299f, .587f, .114f };
+    ColorMatrix r;
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j)
+        r.m[i][j] = (i == j ? 1 - amount : 0) + amount * luma[j];
+    return r;
+  }
+
+  /* Same weights as sepia.frag */
+  static ColorMatrix sepia()
+  {
+    static const float tint[3] = { 1.2f, 1.0f, 0.8f };
+    ColorMatrix g = gray(1), r;
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j)
+        r.m[i][j] = (i == j ? 0.2f : 0) + 0.8f * tint[i] * g.m[i][j];
+    return r;
+  }
+
+  /* Luminance preserving rotation around the gray axis */
+  static ColorMatrix hue(float degrees)
+  {
+    float a = degrees * 3.141592654f / 180.0f;
+    float c = cos(a), s = sin(a);
+    ColorMatrix r;
+    r.m[0][0] = .213f + c * .787f - s * .213f;
+    r.m[0][1] = .715f - c * .715f - s * .715f;
+    r.m[0][2] = .072f - c * .072f + s * .928f;
+    r.m[1][0] = .213f - c * .213f + s * .143f;
+    r.m[1][1] = .715f + c * .285f + s * .140f;
+    r.m[1][2] = .072f - c * .072f - s * .283f;
+    r.m[2][0] = .213f - c * .213f - s * .787f;
+    r.m[2][1] = .715f - c * .715f + s * .715f;
+    r.m[2][2] = .072f + c * .928f + s * .072f;
+    return r;
+  }
+
+  /* Same as sprite.frag: gray first, then the color offset.
+   * Expects normalized values */
+  static ColorMatrix tone(float red, float green, float blue, float grayAmount)
+  {
+    ColorMatrix r = gray(grayAmount);
+    r.m[0][3] = red;
+    r.m[1][3] = green;
+    r.m[2][3] = blue;
+    return r;
+  }
+};
+
+#endif // COLORMATRIX_H
@@ -163,10 +163,24 @@ void Config::read(int argc, char *argv[])
 	PO_DESC(fixedFramerate, int, 0) \
 	PO_DESC(frameSkip, bool, true) \
 	PO_DESC(syncToRefreshrate, bool, false) \
+	PO_DESC(precisePacing, bool, true) \
+	PO_DESC(adaptiveVsync, bool, false) \
 	PO_DESC(solidFonts, bool, false) \
 	PO_DESC(subImageFix, bool, false) \
+	PO_DESC(glyphAtlas, bool, true) \
+	PO_DESC(textCacheSize, int, 512) \
 	PO_DESC(enableBlitting, bool, true) \
 	PO_DESC(maxTextureSize, int, 0) \
+	PO_DESC(texPoolSize, int, 20) \
+	PO_DESC(bitmapAtlas, bool, false) \
+	PO_DESC(bitmapAtlasMaxSize, int, 128) \
+	PO_DESC(staticTilemapSize, int, 200) \
+	PO_DESC(deferZSort, bool, true) \
+	PO_DESC(spriteBatching, bool, true) \
+	PO_DESC(skipIdleFrames, bool, true) \
+	PO_DESC(profiler, bool, false) \
+	PO_DESC(profilerOverlay, bool, false) \
+	PO_DESC(profilerTrace, std::string, "") \
 	PO_DESC(gameFolder, std::string, ".") \
 	PO_DESC(anyAltToggleFS, bool, false) \
 	PO_DESC(enableReset, bool, true) \
@@ -179,7 +193,14 @@ void Config::read(int argc, char *argv[])
 	PO_DESC(midi.soundFont, std::string, "") \
 	PO_DESC(midi.chorus, bool, false) \
 	PO_DESC(midi.reverb, bool, false) \
+	PO_DESC(midi.prerender, bool, false) \
+	PO_DESC(midi.prerenderCache, int, 128) \
 	PO_DESC(SE.sourceCount, int, 6) \
+	PO_DESC(SE.cacheSize, int, 10) \
+	PO_DESC(SE.pinPlays, int, 8) \
+	PO_DESC(SE.diskCache, bool, false) \
+	PO_DESC(SE.diskCacheCompress, bool, false) \
+	PO_DESC(SE.diskCacheSize, int, 256) \
 	PO_DESC(customScript, std::string, "") \
 	PO_DESC(pathCache, bool, true) \
 	PO_DESC(useScriptNames, bool, false)
@@ -251,6 +272,10 @@ void Config::read(int argc, char *argv[])
 #undef PO_DESC_ALL
   rgssVersion = clamp(rgssVersion, 0, 3);
   SE.sourceCount = clamp(SE.sourceCount, 1, 64);
+  SE.cacheSize = clamp(SE.cacheSize, 1, 1024);
+  SE.diskCacheSize = clamp(SE.diskCacheSize, 16, 65536);
+  midi.prerenderCache = clamp(midi.prerenderCache, 16, 2048);
+  if (SE.pinPlays < 0) SE.pinPlays = 0;
   if (!dataPathOrg.empty() && !dataPathApp.empty())
     customDataPath = prefPath(dataPathOrg.c_str(), dataPathApp.c_str());
   commonDataPath = prefPath(".", "hiddenchest");
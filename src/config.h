@@ -42,10 +42,24 @@ struct Config
   int fixedFramerate;
   bool frameSkip;
   bool syncToRefreshrate;
+  bool precisePacing;
+  bool adaptiveVsync;
   bool solidFonts;
   bool subImageFix;
+  bool glyphAtlas;
+  int textCacheSize;
   bool enableBlitting;
   int maxTextureSize;
+  int texPoolSize;
+  bool bitmapAtlas;
+  int bitmapAtlasMaxSize;
+  int staticTilemapSize;
+  bool deferZSort;
+  bool spriteBatching;
+  bool skipIdleFrames;
+  bool profiler;
+  bool profilerOverlay;
+  std::string profilerTrace;
   std::string gameFolder;
   bool anyAltToggleFS;
   bool enableReset;
@@ -62,11 +76,21 @@ struct Config
     std::string soundFont;
     bool chorus;
     bool reverb;
+    bool prerender;
+    /* In MB */
+    int prerenderCache;
   } midi;
 
   struct
   {
     int sourceCount;
+    /* In MB */
+    int cacheSize;
+    int pinPlays;
+    bool diskCache;
+    bool diskCacheCompress;
+    /* In MB */
+    int diskCacheSize;
   } SE;
 
   bool useScriptNames;
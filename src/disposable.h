@@ -36,6 +36,7 @@ public:
   Disposable() : disposed(false), link(this)
   {
     shState->graphics().addDisposable(this);
+    Graphics::markDirty();
   }
 
   virtual ~Disposable()
@@ -48,6 +49,7 @@ public:
     if (disposed) return;
     releaseResources();
     disposed = true;
+    Graphics::markDirty();
     wasDisposed();
   }
 
@@ -59,12 +61,27 @@ public:
   sigc::signal<void> wasDisposed;
 
 protected:
+  /* Getters, being const, only check. Any other member
+   * is taken to change what the next frame shows */
   void guardDisposed() const
   {
     if (isDisposed())
       throw Exception(Exception::RGSSError, "disposed %s", klassName());
   }
 
+  void guardDisposed()
+  {
+    guardDisposedQuiet();
+    Graphics::markDirty();
+  }
+
+  /* For members marking the frame dirty themselves,
+   * only when they actually change something */
+  void guardDisposedQuiet() const
+  {
+    guardDisposed();
+  }
+
 private:
   virtual void releaseResources() = 0;
   virtual const char *klassName() const = 0;
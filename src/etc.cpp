@@ -22,6 +22,7 @@
 #include "etc.h"
 #include "serial-util.h"
 #include "exception.h"
+#include "graphics.h"
 #include <SDL_types.h>
 #include <SDL_pixels.h>
 
@@ -56,6 +57,7 @@ const Color &Color::operator=(const Color &o)
   blue  = o.blue;
   alpha = o.alpha;
   norm  = o.norm;
+  Graphics::markDirty();
   return o;
 }
 
@@ -66,30 +68,35 @@ void Color::set(double red, double green, double blue, double alpha)
   this->blue  = blue;
   this->alpha = alpha;
   updateInternal();
+  Graphics::markDirty();
 }
 
 void Color::setRed(double value)
 {
   red = value;
   norm.x = clamp<double>(value, 0, 255) / 255;
+  Graphics::markDirty();
 }
 
 void Color::setGreen(double value)
 {
   green = value;
   norm.y = clamp<double>(value, 0, 255) / 255;
+  Graphics::markDirty();
 }
 
 void Color::setBlue(double value)
 {
   blue = value;
   norm.z = clamp<double>(value, 0, 255) / 255;
+  Graphics::markDirty();
 }
 
 void Color::setAlpha(double value)
 {
   alpha = value;
   norm.w = clamp<double>(value, 0, 255) / 255;
+  Graphics::markDirty();
 }
 // Serializable
 int Color::serialSize() const
@@ -169,6 +176,7 @@ void Tone::set(double red, double green, double blue, double gray)
   this->gray  = gray;
   updateInternal();
   valueChanged();
+  Graphics::markDirty();
 }
 
 const Tone& Tone::operator=(const Tone &o)
@@ -179,6 +187,7 @@ const Tone& Tone::operator=(const Tone &o)
   gray  = o.gray;
   norm  = o.norm;
   valueChanged();
+  Graphics::markDirty();
   return o;
 }
 
@@ -187,6 +196,7 @@ void Tone::setRed(double value)
   red = value;
   norm.x = (float) clamp<double>(value, -255, 255) / 255;
   valueChanged();
+  Graphics::markDirty();
 }
 
 void Tone::setGreen(double value)
@@ -194,6 +204,7 @@ void Tone::setGreen(double value)
   green = value;
   norm.y = (float) clamp<double>(value, -255, 255) / 255;
   valueChanged();
+  Graphics::markDirty();
 }
 
 void Tone::setBlue(double value)
@@ -201,6 +212,7 @@ void Tone::setBlue(double value)
   blue = value;
   norm.z = (float) clamp<double>(value, -255, 255) / 255;
   valueChanged();
+  Graphics::markDirty();
 }
 
 void Tone::setGray(double value)
@@ -208,6 +220,7 @@ void Tone::setGray(double value)
   gray = value;
   norm.w = (float) clamp<double>(value, 0, 255) / 255;
   valueChanged();
+  Graphics::markDirty();
 }
 // Serializable
 int Tone::serialSize() const
@@ -287,6 +300,7 @@ void Rect::set(int x, int y, int w, int h)
   width = w;
   height = h;
   valueChanged();
+  Graphics::markDirty();
 }
 
 const Rect &Rect::operator=(const Rect &o)
@@ -296,6 +310,7 @@ const Rect &Rect::operator=(const Rect &o)
   width  = o.width;
   height = o.height;
   valueChanged();
+  Graphics::markDirty();
   return o;
 }
 
@@ -304,6 +319,7 @@ void Rect::empty()
   if (!(x || y || width || height)) return;
   x = y = width = height = 0;
   valueChanged();
+  Graphics::markDirty();
 }
 
 bool Rect::isEmpty() const
@@ -316,6 +332,7 @@ void Rect::setX(int value)
   if (x == value) return;
   x = value;
   valueChanged();
+  Graphics::markDirty();
 }
 
 void Rect::setY(int value)
@@ -323,6 +340,7 @@ void Rect::setY(int value)
   if (y == value) return;
   y = value;
   valueChanged();
+  Graphics::markDirty();
 }
 
 void Rect::setWidth(int value)
@@ -330,6 +348,7 @@ void Rect::setWidth(int value)
   if (width == value) return;
   width = value;
   valueChanged();
+  Graphics::markDirty();
 }
 
 void Rect::setHeight(int value)
@@ -337,6 +356,7 @@ void Rect::setHeight(int value)
   if (height == value) return;
   height = value;
   valueChanged();
+  Graphics::markDirty();
 }
 
 int Rect::serialSize() const
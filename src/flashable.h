@@ -24,6 +24,7 @@
 
 #include "etc.h"
 #include "etc-internal.h"
+#include "graphics.h"
 
 class Flashable
 {
@@ -48,6 +49,7 @@ public:
   virtual void update()
   {
     if (!flashing) return;
+    Graphics::markDirty();
     if (++counter > duration) {
       // Flash finished. Cleanup
       flashColor = Vec4(0, 0, 0, 0);
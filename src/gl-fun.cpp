@@ -84,6 +84,7 @@ void initGLFunctions()
 
 	/* Assume single digit */
 	int glMajor = *ver - '0';
+	int glMinor = ver[1] == '.' ? ver[2] - '0' : 0;
 
 	if (glMajor < 2)
 		throw EXC("At least OpenGL (ES) 2.0 is required");
@@ -150,6 +151,43 @@ void initGLFunctions()
 		GL_VAO_FUN;
 	}
 
+	/* Pixel buffer readback entrypoints. Sync objects are only
+	 * core since GL 3.2 and ES 3.0, without them readback stays
+	 * synchronous. Unsupported entrypoints may still resolve
+	 * to something, so they are only loaded when supported */
+	bool pboSupport, syncSupport;
+	if (gles)
+	{
+		pboSupport = syncSupport = glMajor >= 3;
+	}
+	else
+	{
+		pboSupport = glMajor >= 3 || (HAVE_EXT(ARB_pixel_buffer_object) &&
+		                              HAVE_EXT(ARB_map_buffer_range));
+		syncSupport = glMajor > 3 || (glMajor == 3 && glMinor >= 2) ||
+		              HAVE_EXT(ARB_sync);
+	}
+	if (pboSupport && syncSupport)
+	{
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+		GL_PBO_FUN;
+	}
+
+	/* Timer query entrypoints */
+	if (!gles && (glMajor >= 4 || HAVE_EXT(ARB_timer_query)))
+	{
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+		GL_TIMER_QUERY_FUN;
+	}
+	else if (gles && HAVE_EXT(EXT_disjoint_timer_query))
+	{
+#undef EXT_SUFFIX
+#define EXT_SUFFIX "EXT"
+		GL_TIMER_QUERY_FUN;
+	}
+
 	/* Debug callback entrypoints */
 	if (HAVE_EXT(KHR_debug))
 	{
@@ -175,4 +213,10 @@ void initGLFunctions()
 		gl.unpack_subimage = true;
 	if (!gles || glMajor >= 3 || HAVE_EXT(OES_texture_npot))
 		gl.npot_repeat = true;
+	if (gl.MapBufferRange && gl.UnmapBuffer && gl.FenceSync &&
+	    gl.ClientWaitSync && gl.DeleteSync)
+		gl.pbo_readback = true;
+	if (gl.GenQueries && gl.DeleteQueries && gl.BeginQuery && gl.EndQuery &&
+	    gl.GetQueryObjectiv && gl.GetQueryObjectui64v)
+		gl.timer_query = true;
 }
@@ -29,6 +29,7 @@
 #else
 #include <SDL_opengl.h>
 #endif
+#include <stdint.h>
 
 /* Etc */
 typedef GLenum (APIENTRYP _PFNGLGETERRORPROC) (void);
@@ -67,6 +68,23 @@ typedef void (APIENTRYP _PFNGLDELETEBUFFERSPROC) (GLsizei n, const GLuint* buffe
 typedef void (APIENTRYP _PFNGLBINDBUFFERPROC) (GLenum target, GLuint buffer);
 typedef void (APIENTRYP _PFNGLBUFFERDATAPROC) (GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage);
 typedef void (APIENTRYP _PFNGLBUFFERSUBDATAPROC) (GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid* data);
+typedef void* (APIENTRYP _PFNGLMAPBUFFERRANGEPROC) (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (APIENTRYP _PFNGLUNMAPBUFFERPROC) (GLenum target);
+
+/* Sync object */
+typedef struct __GLsync *_GLsync;
+typedef uint64_t _GLuint64;
+typedef _GLsync (APIENTRYP _PFNGLFENCESYNCPROC) (GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRYP _PFNGLCLIENTWAITSYNCPROC) (_GLsync sync, GLbitfield flags, _GLuint64 timeout);
+typedef void (APIENTRYP _PFNGLDELETESYNCPROC) (_GLsync sync);
+
+/* Timer query */
+typedef void (APIENTRYP _PFNGLGENQUERIESPROC) (GLsizei n, GLuint *ids);
+typedef void (APIENTRYP _PFNGLDELETEQUERIESPROC) (GLsizei n, const GLuint *ids);
+typedef void (APIENTRYP _PFNGLBEGINQUERYPROC) (GLenum target, GLuint id);
+typedef void (APIENTRYP _PFNGLENDQUERYPROC) (GLenum target);
+typedef void (APIENTRYP _PFNGLGETQUERYOBJECTIVPROC) (GLuint id, GLenum pname, GLint *params);
+typedef void (APIENTRYP _PFNGLGETQUERYOBJECTUI64VPROC) (GLuint id, GLenum pname, _GLuint64 *params);
 
 /* Shader */
 typedef GLuint (APIENTRYP _PFNGLCREATESHADERPROC) (GLenum type);
@@ -122,6 +140,19 @@ typedef void (APIENTRYP _PFNGLRELEASESHADERCOMPILERPROC) (void);
 #define GL_UNPACK_ROW_LENGTH 0x0CF2
 #define GL_UNPACK_SKIP_PIXELS 0x0CF4
 #define GL_UNPACK_SKIP_ROWS 0x0CF3
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#define GL_STREAM_READ 0x88E1
+#define GL_MAP_READ_BIT 0x0001
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define GL_TIMEOUT_EXPIRED 0x911B
+#define GL_WAIT_FAILED 0x911D
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
 #endif
 
 #define GL_20_FUN \
@@ -203,6 +234,23 @@ typedef void (APIENTRYP _PFNGLRELEASESHADERCOMPILERPROC) (void);
   GL_FUN(DeleteVertexArrays, _PFNGLDELETEVERTEXARRAYSPROC) \
   GL_FUN(BindVertexArray, _PFNGLBINDVERTEXARRAYPROC)
 
+/* Asynchronous pixel readback */
+#define GL_PBO_FUN \
+  GL_FUN(MapBufferRange, _PFNGLMAPBUFFERRANGEPROC) \
+  GL_FUN(UnmapBuffer, _PFNGLUNMAPBUFFERPROC) \
+  GL_FUN(FenceSync, _PFNGLFENCESYNCPROC) \
+  GL_FUN(ClientWaitSync, _PFNGLCLIENTWAITSYNCPROC) \
+  GL_FUN(DeleteSync, _PFNGLDELETESYNCPROC)
+
+/* GPU timing, for the profiler */
+#define GL_TIMER_QUERY_FUN \
+  GL_FUN(GenQueries, _PFNGLGENQUERIESPROC) \
+  GL_FUN(DeleteQueries, _PFNGLDELETEQUERIESPROC) \
+  GL_FUN(BeginQuery, _PFNGLBEGINQUERYPROC) \
+  GL_FUN(EndQuery, _PFNGLENDQUERYPROC) \
+  GL_FUN(GetQueryObjectiv, _PFNGLGETQUERYOBJECTIVPROC) \
+  GL_FUN(GetQueryObjectui64v, _PFNGLGETQUERYOBJECTUI64VPROC)
+
 #define GL_DEBUG_KHR_FUN \
   GL_FUN(DebugMessageCallback, _PFNGLDEBUGMESSAGECALLBACKPROC)
 
@@ -218,11 +266,15 @@ struct GLFunctions
   GL_FBO_FUN
   GL_FBO_BLIT_FUN
   GL_VAO_FUN
+  GL_PBO_FUN
+  GL_TIMER_QUERY_FUN
   GL_DEBUG_KHR_FUN
   GL_GREMEMDY_FUN
   bool glsles;
   bool unpack_subimage;
   bool npot_repeat;
+  bool pbo_readback;
+  bool timer_query;
 #undef GL_FUN
 };
 
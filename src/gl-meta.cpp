@@ -144,7 +144,7 @@ void blitSource(TEXFBO &source)
     return;
   }
   SimpleShader &shader = shState->shaders().simple;
-  shader.setTexSize(Vec2i(source.width, source.height));
+  shader.setTexSize(Vec2i(source.texW, source.texH));
   TEX::bind(source.tex);
 }
 
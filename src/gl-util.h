@@ -195,8 +195,11 @@ struct TEXFBO
   TEX::ID tex;
   FBO::ID fbo;
   int width, height;
+  /* Size the texture storage was allocated with, which
+   * might exceed the used area (eg. for pooled objects) */
+  int texW, texH;
 
-  TEXFBO() : tex(0), fbo(0), width(0), height(0) {}
+  TEXFBO() : tex(0), fbo(0), width(0), height(0), texW(0), texH(0) {}
 
   bool operator==(const TEXFBO &other) const
   {
@@ -216,8 +219,8 @@ struct TEXFBO
   {
     TEX::bind(obj.tex);
     TEX::allocEmpty(width, height);
-    obj.width = width;
-    obj.height = height;
+    obj.width = obj.texW = width;
+    obj.height = obj.texH = height;
   }
 
   static inline void linkFBO(TEXFBO &obj)
@@ -237,6 +240,7 @@ struct TEXFBO
     obj.tex = TEX::ID(0);
     obj.fbo = FBO::ID(0);
     obj.width = obj.height = 0;
+    obj.texW = obj.texH = 0;
   }
 };
 
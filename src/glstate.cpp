@@ -117,6 +117,7 @@ GLState::GLState(const Config &conf)
   scissorTest.init(false);
   scissorBox.init(IntRect(0, 0, WIDTH_MAX, HEIGHT_MAX)); // Implement a real higher resolution than usual
   program.init(0);
+  drawCalls = 0;
   if (conf.maxTextureSize > 0) caps.maxTexSize = conf.maxTextureSize;
 }
 
@@ -124,6 +124,9 @@ public:
   GLBlend blend;
   GLViewport viewport;
   GLProgram program;
+  /* DrawElements calls issued, reset every frame
+   * to get Graphics.draw_calls */
+  unsigned int drawCalls;
 
   struct Caps
   {
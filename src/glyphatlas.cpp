@@ -0,0 +1,345 @@
+/*
+** glyphatlas.cpp
+**
+** This file is part of HiddenChest
+*/
+
+#include "glyphatlas.h"
+#include "gl-util.h"
+#include "glstate.h"
+#include "shader.h"
+#include "sharedstate.h"
+#include "quadarray.h"
+#include "quad.h"
+#include "boost-hash.h"
+#include "util.h"
+#include <boost/functional/hash.hpp>
+#include <SDL_ttf.h>
+
+#define ATLAS_PAGE_SIZE 1024
+#define ATLAS_PAGE_MAX  8
+/* Empty space kept around every glyph so smoothed
+ * (squeezed) sampling never bleeds into a neighbour */
+#define ATLAS_PADDING   1
+
+struct GlyphKey
+{
+  TTF_Font *font;
+  int style;
+  int outline;
+  uint16_t ch;
+
+  bool operator==(const GlyphKey &o) const
+  {
+    return font == o.font && style == o.style &&
+           outline == o.outline && ch == o.ch;
+  }
+};
+
+static size_t hash_value(const GlyphKey &k)
+{
+  size_t seed = 0;
+  boost::hash_combine(seed, k.font);
+  boost::hash_combine(seed, k.style);
+  boost::hash_combine(seed, k.outline);
+  boost::hash_combine(seed, k.ch);
+  return seed;
+}
+
+struct Glyph
+{
+  uint8_t page;
+  IntRect src;
+  /* Distance from the left cell edge to the pen position */
+  int offset;
+  int advance;
+};
+
+/* Pages are filled shelf by shelf, top to bottom */
+struct AtlasPage
+{
+  TEX::ID tex;
+  int shelfY, shelfH, cursorX;
+};
+
+struct GlyphAtlasPrivate
+{
+  BoostHash<GlyphKey, Glyph> glyphs;
+  std::vector<AtlasPage> pages;
+  int pageSize;
+  unsigned int generation;
+  /* Render target the layers get composed in */
+  TEXFBO staging;
+  ColorQuadArray quads;
+
+  GlyphAtlasPrivate()
+  {
+    pageSize = std::min<int>(ATLAS_PAGE_SIZE, glState.caps.maxTexSize);
+    generation = 0;
+    TEXFBO::init(staging);
+    TEXFBO::allocEmpty(staging, 256, 64);
+    TEXFBO::linkFBO(staging);
+  }
+
+  ~GlyphAtlasPrivate()
+  {
+    freePages();
+    TEXFBO::fini(staging);
+  }
+
+  void freePages()
+  {
+    for (size_t i = 0; i < pages.size(); ++i)
+      TEX::del(pages[i].tex);
+    pages.clear();
+  }
+
+  bool newPage()
+  {
+    if (pages.size() >= ATLAS_PAGE_MAX) return false;
+    AtlasPage page;
+    page.tex = TEX::gen();
+    page.shelfY = page.shelfH = page.cursorX = 0;
+    TEX::bind(page.tex);
+    TEX::setRepeat(false);
+    TEX::setSmooth(false);
+    std::vector<uint8_t> zero(pageSize * pageSize * 4, 0);
+    TEX::uploadImage(pageSize, pageSize, &zero[0], GL_RGBA);
+    pages.push_back(page);
+    return true;
+  }
+
+  /* Finds room for a w*h cell; false if all pages are exhausted */
+  bool pack(int w, int h, uint8_t &pageOut, Vec2i &posOut)
+  {
+    w += ATLAS_PADDING;
+    h += ATLAS_PADDING;
+    if (w > pageSize || h > pageSize) return false;
+    if (pages.empty() && !newPage()) return false;
+    AtlasPage *page = &pages.back();
+    if (page->cursorX + w > pageSize) {
+      page->shelfY += page->shelfH;
+      page->shelfH = 0;
+      page->cursorX = 0;
+    }
+    if (page->shelfY + h > pageSize) {
+      if (!newPage()) return false;
+      page = &pages.back();
+    }
+    pageOut = pages.size() - 1;
+    posOut = Vec2i(page->cursorX, page->shelfY);
+    page->cursorX += w;
+    page->shelfH = std::max(page->shelfH, h);
+    return true;
+  }
+
+  /* Returns false if the glyph couldn't be packed */
+  bool rasterize(const GlyphKey &key, Glyph &glyph)
+  {
+    static const SDL_Color white = { 255, 255, 255, 255 };
+    int minx, maxx, miny, maxy, advance;
+    if (TTF_GlyphMetrics(key.font, key.ch, &minx, &maxx, &miny, &maxy, &advance) != 0)
+      minx = advance = 0;
+    TTF_SetFontOutline(key.font, key.outline);
+    SDL_Surface *surf = TTF_RenderGlyph_Blended(key.font, key.ch, white);
+    TTF_SetFontOutline(key.font, 0);
+    glyph.offset = minx < 0 ? -minx : 0;
+    glyph.advance = advance;
+    glyph.page = 0;
+    glyph.src = IntRect();
+    // Blank glyphs (eg. spaces) only contribute their advance
+    if (!surf) return true;
+    SDL_Surface *conv = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ABGR8888, 0);
+    SDL_FreeSurface(surf);
+    Vec2i pos;
+    if (!pack(conv->w, conv->h, glyph.page, pos)) {
+      SDL_FreeSurface(conv);
+      return false;
+    }
+    glyph.src = IntRect(pos.x, pos.y, conv->w, conv->h);
+    TEX::bind(pages[glyph.page].tex);
+    TEX::uploadSubImage(pos.x, pos.y, conv->w, conv->h, conv->pixels, GL_RGBA);
+    SDL_FreeSurface(conv);
+    return true;
+  }
+
+  bool getGlyph(const GlyphKey &key, Glyph &out)
+  {
+    if (glyphs.contains(key)) {
+      out = glyphs[key];
+      return true;
+    }
+    if (!rasterize(key, out)) return false;
+    glyphs.insert(key, out);
+    return true;
+  }
+
+  bool layout(TTF_Font *font, int outline, const char *str, GlyphRun &run)
+  {
+    run.fill.clear();
+    run.line.clear();
+    run.outline = outline;
+    run.width = 0;
+    run.height = TTF_FontHeight(font);
+    GlyphKey key;
+    key.font = font;
+    key.style = TTF_GetFontStyle(font);
+    bool kerning = TTF_GetFontKerning(font) != 0;
+    uint16_t prev = 0;
+    int pen = 0;
+    const char *end;
+    for (uint16_t ch = utf8_to_ucs2(str, &end); end != str;
+         ch = utf8_to_ucs2(str, &end))
+    {
+      str = end;
+      key.ch = ch;
+      key.outline = 0;
+      Glyph glyph;
+      if (!getGlyph(key, glyph)) return false;
+      if (prev == 0)
+        pen = glyph.offset;
+      else if (kerning)
+        pen += TTF_GetFontKerningSizeGlyphs(font, prev, ch);
+      prev = ch;
+      GlyphRun::Cell cell;
+      cell.pos = Vec2i(pen - glyph.offset, 0);
+      if (glyph.src.w > 0) {
+        cell.page = glyph.page;
+        cell.src = glyph.src;
+        run.fill.push_back(cell);
+        run.width = std::max(run.width, cell.pos.x + cell.src.w);
+      }
+      if (outline > 0) {
+        key.outline = outline;
+        Glyph line;
+        if (!getGlyph(key, line)) return false;
+        if (line.src.w > 0) {
+          cell.page = line.page;
+          cell.src = line.src;
+          run.line.push_back(cell);
+        }
+      }
+      pen += glyph.advance;
+    }
+    run.width = std::max(run.width, pen);
+    return true;
+  }
+
+  void ensureStaging(int minW, int minH)
+  {
+    if (minW <= staging.width && minH <= staging.height) return;
+    TEXFBO::allocEmpty(staging, std::max(staging.width, findNextPow2(minW)),
+                       std::max(staging.height, findNextPow2(minH)));
+  }
+};
+
+GlyphAtlas::GlyphAtlas()
+{
+  p = new GlyphAtlasPrivate;
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+  delete p;
+}
+
+void GlyphAtlas::layout(TTF_Font *font, int outline, const char *str, GlyphRun &run)
+{
+  if (p->layout(font, outline, str, run)) return;
+  /* Out of atlas space; start over with empty pages.
+   * A single string can't possibly fill all of them */
+  clear();
+  p->layout(font, outline, str, run);
+}
+
+TEXFBO &GlyphAtlas::render(const GlyphRun &run, const std::vector<GlyphLayer> &layers)
+{
+  TEXFBO &target = p->staging;
+  Vec2i extent;
+  for (size_t i = 0; i < layers.size(); ++i) {
+    const int grow = layers[i].outline ? run.outline * 2 : 0;
+    extent.x = std::max(extent.x, layers[i].offset.x + run.width + grow);
+    extent.y = std::max(extent.y, layers[i].offset.y + run.height + grow);
+  }
+  p->ensureStaging(extent.x, extent.y);
+  /* Sort quads by layer first (draw order), page second */
+  ColorQuadArray &quads = p->quads;
+  size_t total = 0;
+  for (size_t i = 0; i < layers.size(); ++i)
+    total += layers[i].outline ? run.line.size() : run.fill.size();
+  quads.resize(total);
+  std::vector<size_t> batches;
+  std::vector<uint8_t> batchPages;
+  size_t n = 0;
+  for (size_t i = 0; i < layers.size(); ++i) {
+    const GlyphLayer &layer = layers[i];
+    const std::vector<GlyphRun::Cell> &cells = layer.outline ? run.line : run.fill;
+    for (size_t pg = 0; pg < p->pages.size(); ++pg) {
+      size_t start = n;
+      for (size_t c = 0; c < cells.size(); ++c) {
+        const GlyphRun::Cell &cell = cells[c];
+        if (cell.page != pg) continue;
+        Vertex *vert = &quads.vertices[n*4];
+        FloatRect pos(cell.pos.x + layer.offset.x, cell.pos.y + layer.offset.y,
+                      cell.src.w, cell.src.h);
+        Quad::setTexPosRect(vert, cell.src, pos);
+        Quad::setColor(vert, layer.color);
+        ++n;
+      }
+      if (n == start) continue;
+      batches.push_back(n - start);
+      batchPages.push_back(pg);
+    }
+    /* Layer boundary marker */
+    batches.push_back(0);
+    batchPages.push_back(0);
+  }
+  quads.commit();
+  FBO::bind(target.fbo);
+  glState.viewport.pushSet(IntRect(0, 0, target.width, target.height));
+  glState.clearColor.pushSet(Vec4());
+  FBO::clear();
+  GlyphShader &shader = shState->shaders().glyph;
+  shader.bind();
+  shader.applyViewportProj();
+  shader.setTranslation(Vec2i());
+  shader.setTexSize(Vec2i(p->pageSize, p->pageSize));
+  /* The bottom layer replaces the color of the cleared target
+   * outright, so uncovered texels carry the glyph color the way
+   * a blended SDL_ttf surface would; every layer above it is
+   * blended on top just like SDL_BlitSurface does */
+  glState.blend.pushSet(true);
+  gl.BlendEquation(GL_FUNC_ADD);
+  gl.BlendFuncSeparate(GL_ONE, GL_ZERO, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  bool firstLayer = true;
+  size_t offset = 0;
+  for (size_t i = 0; i < batches.size(); ++i) {
+    if (batches[i] == 0) {
+      if (firstLayer && offset > 0) {
+        glState.blendMode.refresh();
+        firstLayer = false;
+      }
+      continue;
+    }
+    TEX::bind(p->pages[batchPages[i]].tex);
+    quads.draw(offset, batches[i]);
+    offset += batches[i];
+  }
+  if (firstLayer) glState.blendMode.refresh();
+  glState.blend.pop();
+  glState.clearColor.pop();
+  glState.viewport.pop();
+  return target;
+}
+
+void GlyphAtlas::clear()
+{
+  p->glyphs = BoostHash<GlyphKey, Glyph>();
+  p->freePages();
+  p->generation++;
+}
+
+unsigned int GlyphAtlas::generation() const
+{
+  return p->generation;
+}
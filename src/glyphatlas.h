@@ -0,0 +1,76 @@
+/*
+** glyphatlas.h
+**
+** This file is part of HiddenChest
+*/
+
+#ifndef GLYPHATLAS_H
+#define GLYPHATLAS_H
+
+#include "etc-internal.h"
+#include <vector>
+#include <stdint.h>
+
+struct _TTF_Font;
+struct TEXFBO;
+struct GlyphAtlasPrivate;
+
+/* A laid out string; every glyph cell references a
+ * sub rectangle of one of the atlas pages */
+struct GlyphRun
+{
+  struct Cell
+  {
+    uint8_t page;
+    IntRect src;
+    Vec2i pos;
+  };
+  /* Plain glyphs and their outlined variants ('line'),
+   * the latter only filled in if an outline was requested */
+  std::vector<Cell> fill;
+  std::vector<Cell> line;
+  int width, height;
+  int outline;
+
+  GlyphRun() : width(0), height(0), outline(0) {}
+};
+
+/* One pass over a run: which variant to draw,
+ * where to put it and how to tint it */
+struct GlyphLayer
+{
+  bool outline;
+  Vec2i offset;
+  Vec4 color;
+
+  GlyphLayer(bool outline, const Vec2i &offset, const Vec4 &color)
+  : outline(outline), offset(offset), color(color)
+  {}
+};
+
+/* Persistent cache of rasterized glyphs, keyed by
+ * (font handle, style, outline size, codepoint).
+ * Font handles are pooled per family and size by
+ * SharedFontState and never closed, so they are
+ * stable identifiers for the lifetime of the program */
+class GlyphAtlas
+{
+public:
+  GlyphAtlas();
+  ~GlyphAtlas();
+  /* Lays out the UTF-8 'str' using the current style of 'font',
+   * rasterizing only those glyphs not present in the atlas yet */
+  void layout(_TTF_Font *font, int outline, const char *str, GlyphRun &run);
+  /* Draws 'layers' of 'run' in order into the staging texture,
+   * which is cleared beforehand; returns the staging texture */
+  TEXFBO &render(const GlyphRun &run, const std::vector<GlyphLayer> &layers);
+  /* Drops every cached glyph */
+  void clear();
+  /* Bumped by every clear(), invalidating laid out runs */
+  unsigned int generation() const;
+
+private:
+  GlyphAtlasPrivate *p;
+};
+
+#endif // GLYPHATLAS_H
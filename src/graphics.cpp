@@ -37,12 +37,17 @@
 #include "intrulist.h"
 #include "binding.h"
 #include "debugwriter.h"
+#include "profiler.h"
 #include <SDL_video.h>
 #include <SDL_timer.h>
 #include <SDL_image.h>
+#include <SDL_platform.h>
 #include <time.h>
 #include <sys/time.h>
 #include <errno.h>
+#ifndef __WINDOWS__
+#include <sched.h>
+#endif
 #include <algorithm>
 #include <iostream>
 // Increased Screen Resolution for RGSS1
@@ -122,7 +127,8 @@ private:
 class ScreenScene : public Scene
 {
 public:
-  ScreenScene(int width, int height) : pp(width, height)
+  ScreenScene(int width, int height, Profiler &profiler)
+  : pp(width, height), profiler(profiler)
   {
     updateReso(width, height);
     brightEffect = false;
@@ -133,17 +139,26 @@ public:
   {
     const int w = geometry.rect.w;
     const int h = geometry.rect.h;
+    profiler.push(Profiler::Composite);
+    /* Elements get their final order before anything prepares */
+    Scene::sortAll();
+    profiler.push(Profiler::Prepare);
     shState->prepareDraw();
+    profiler.pop(Profiler::Prepare);
     pp.startRender();
     glState.viewport.set(IntRect(0, 0, w, h));
     FBO::clear();
     Scene::composite();
-    if (!brightEffect) return;
-    SimpleColorShader &shader = shState->shaders().simpleColor;
-    shader.bind();
-    shader.applyViewportProj();
-    shader.setTranslation(Vec2i());
-    brightnessQuad.draw();
+    if (brightEffect) {
+      profiler.push(Profiler::Effects);
+      SimpleColorShader &shader = shState->shaders().simpleColor;
+      shader.bind();
+      shader.applyViewportProj();
+      shader.setTranslation(Vec2i());
+      brightnessQuad.draw();
+      profiler.pop(Profiler::Effects);
+    }
+    profiler.pop(Profiler::Composite);
   }
 
   void apply_scissors()
@@ -207,6 +222,13 @@ public:
   }
 
   void requestViewportRender(const Vec4 &c, const Vec4 &f, const Vec4 &t)
+  {
+    profiler.push(Profiler::Effects);
+    renderViewportEffects(c, f, t);
+    profiler.pop(Profiler::Effects);
+  }
+
+  void renderViewportEffects(const Vec4 &c, const Vec4 &f, const Vec4 &t)
   {
     const IntRect &viewpRect = glState.scissorBox.get();
     const IntRect &screenRect = geometry.rect;
@@ -297,6 +319,7 @@ public:
     screenQuad.setTexPosRect(geometry.rect, geometry.rect);
     brightnessQuad.setTexPosRect(geometry.rect, geometry.rect);
     notifyGeometryChange();
+    Graphics::markDirty();
   }
 
   void setResolution(int width, int height)
@@ -312,6 +335,7 @@ public:
 
 private:
   PingPong pp;
+  Profiler &profiler;
   Quad screenQuad;
   Quad brightnessQuad;
   bool brightEffect;
@@ -319,6 +343,8 @@ private:
 
 /* Nanoseconds per second */
 #define NS_PER_S 1000000000
+/* Frame durations kept around for Graphics.frame_times */
+#define FRAME_TIME_SAMPLES 240
 
 struct FPSLimiter
 {
@@ -332,6 +358,10 @@ struct FPSLimiter
   /* Ticks per nanosecond */
   const double tickFreqNS;
   bool disabled;
+  /* Sleep only until close to the deadline, then spin */
+  bool precise;
+  /* How late SDL_Delay tends to wake us up, in ticks */
+  int64_t sleepSlack;
   /* Data for frame timing adjustment */
   struct
   {
@@ -341,18 +371,27 @@ struct FPSLimiter
     int64_t idealDiff;
     bool resetFlag;
   } adj;
+  /* Ring buffer of the latest frame durations, in microseconds */
+  struct
+  {
+    uint32_t samples[FRAME_TIME_SAMPLES];
+    int next, count;
+  } times;
 
   FPSLimiter(uint16_t desiredFPS)
       : lastTickCount(SDL_GetPerformanceCounter()),
         tickFreq(SDL_GetPerformanceFrequency()),
         tickFreqMS(tickFreq / 1000),
         tickFreqNS((double) tickFreq / NS_PER_S),
-        disabled(false)
+        disabled(false),
+        precise(true),
+        sleepSlack(tickFreqMS)
   { // std::cout << "SDL Frequency " << SDL_GetPerformanceFrequency() << std::endl;
     setDesiredFPS(desiredFPS);
     adj.last = SDL_GetPerformanceCounter();
     adj.idealDiff = 0;
     adj.resetFlag = false;
+    times.next = times.count = 0;
   }
 
   void setDesiredFPS(uint16_t value)
@@ -362,18 +401,20 @@ struct FPSLimiter
 
   void delay()
   {
-    if (disabled) return;
-    int64_t tickDelta = SDL_GetPerformanceCounter() - lastTickCount;
-    int64_t toDelay = tpf - tickDelta;
-    /* Compensate for the last delta
-     * to the ideal timestep */
-    toDelay -= adj.idealDiff;
-    if (toDelay < 0)
-      toDelay = 0;
-    delayTicks(toDelay);
+    if (!disabled) {
+      int64_t tickDelta = SDL_GetPerformanceCounter() - lastTickCount;
+      int64_t toDelay = tpf - tickDelta;
+      /* Compensate for the last delta
+       * to the ideal timestep */
+      toDelay -= adj.idealDiff;
+      if (toDelay < 0)
+        toDelay = 0;
+      delayTicks(toDelay);
+    }
     uint64_t now = lastTickCount = SDL_GetPerformanceCounter();
     int64_t diff = now - adj.last;
     adj.last = now;
+    recordFrameTime(diff);
     // Recalculate our temporal position relative to the ideal timestep
     adj.idealDiff = diff - tpf + adj.idealDiff;
     if (adj.resetFlag) {
@@ -395,13 +436,68 @@ struct FPSLimiter
     return adj.idealDiff > tpf;
   }
 
+  /* Latest frame durations in milliseconds, oldest first */
+  void frameTimes(std::vector<float> &out) const
+  {
+    out.clear();
+    int first = times.next - times.count + FRAME_TIME_SAMPLES;
+    for (int i = 0; i < times.count; ++i)
+      out.push_back(times.samples[(first + i) % FRAME_TIME_SAMPLES] / 1000.0f);
+  }
+
 private:
+  void recordFrameTime(int64_t ticks)
+  {
+    times.samples[times.next] = ticks * 1000000 / tickFreq;
+    times.next = (times.next + 1) % FRAME_TIME_SAMPLES;
+    times.count = std::min(times.count + 1, FRAME_TIME_SAMPLES);
+  }
+
   void delayTicks(uint64_t ticks)
   {
-    SDL_Delay(ticks / tickFreqMS);
+    if (!precise) {
+      SDL_Delay(ticks / tickFreqMS);
+      return;
+    }
+    const uint64_t deadline = SDL_GetPerformanceCounter() + ticks;
+    /* Sleep while even a late wake up can't overshoot
+     * the deadline, learning how late that is on the way */
+    for (;;) {
+      uint64_t now = SDL_GetPerformanceCounter();
+      if (now >= deadline) return;
+      int64_t left = deadline - now - sleepSlack;
+      if (left < (int64_t) tickFreqMS) break;
+      uint32_t ms = left / tickFreqMS;
+      SDL_Delay(ms);
+      int64_t late = SDL_GetPerformanceCounter() - now - ms * tickFreqMS;
+      /* Follow lateness up at once, but back off slowly */
+      if (late > sleepSlack)
+        sleepSlack = late;
+      else
+        sleepSlack -= (sleepSlack - late) / 8;
+      /* Capped so the spin below stays short, even if
+       * that lets an unusually late wake up overshoot */
+      sleepSlack = clamp<int64_t>(sleepSlack, tickFreqMS / 4, tickFreqMS * 2);
+    }
+    /* Spin through the last stretch, letting
+     * other threads run in the meantime */
+    while (SDL_GetPerformanceCounter() < deadline)
+      yieldThread();
+  }
+
+  static void yieldThread()
+  {
+#ifdef __WINDOWS__
+    SDL_Delay(0);
+#else
+    sched_yield();
+#endif
   }
 };
 
+/* See Graphics::markDirty */
+static unsigned int frameGeneration = 0;
+
 struct GraphicsPrivate
 {
   /* Screen resolution, ie. the resolution at which
@@ -417,12 +513,17 @@ struct GraphicsPrivate
   /* Offset in the game window at which the scaled game screen
    * is blitted inside the game window */
   Vec2i scOffset;
+  Profiler profiler;
   ScreenScene screen;
   RGSSThreadData *threadData;
   SDL_GLContext glCtx;
   int frameRate;
   int frameCount;
   int brightness;
+  // Draw calls the last composited frame took
+  unsigned int drawCalls;
+  // frameGeneration the screen was last composited at
+  unsigned int composedGeneration;
   FPSLimiter fpsLimiter;
   bool block_fullscreen;
   bool block_ftwelve;
@@ -438,12 +539,15 @@ struct GraphicsPrivate
   : scRes(START_WIDTH, START_HEIGHT),// scRes(WIDTH_MAX, HEIGHT_MAX),
     scSize(scRes),
     winSize(rtData->config.defScreenW, rtData->config.defScreenH),
-    screen(scRes.x, scRes.y),
+    profiler(rtData->config.profiler, rtData->config.profilerTrace),
+    screen(scRes.x, scRes.y, profiler),
     threadData(rtData),
     glCtx(SDL_GL_GetCurrentContext()),
     frameRate(DEF_FRAMERATE),
     frameCount(0),
     brightness(255),
+    drawCalls(0),
+    composedGeneration(frameGeneration - 1),
     fpsLimiter(frameRate),
     frozen(false),
     block_fullscreen(false),
@@ -519,14 +623,22 @@ struct GraphicsPrivate
 
   void swapGLBuffer()
   {
+    profiler.push(Profiler::Idle);
     fpsLimiter.delay();
+    profiler.pop(Profiler::Idle);
+    profiler.push(Profiler::Swap);
     SDL_GL_SwapWindow(threadData->window);
+    profiler.pop(Profiler::Swap);
     ++frameCount;
     threadData->ethread->notifyFrame();
+    profiler.frameDone();
   }
 
+  /* Effect passes leave their result in the screen
+   * buffers, so the next frame is composited anew */
   void set_buffer(TEXFBO &buffer)
   {
+    Graphics::markDirty();
     GLMeta::blitBegin(buffer);
     GLMeta::blitSource(screen.getPP().frontBuffer());
     GLMeta::blitRectangle(IntRect(0, 0, scRes.x, scRes.y), Vec2i());
@@ -570,14 +682,26 @@ struct GraphicsPrivate
         threadData->config.smoothScaling);
   }
 
+  /* Idle frames present the previous result again */
   void redrawScreen()
   {
-    screen.composite();
+    glState.drawCalls = 0;
+    if (!threadData->config.skipIdleFrames ||
+        composedGeneration != frameGeneration) {
+      /* Changes made while compositing get picked up next frame */
+      composedGeneration = frameGeneration;
+      screen.composite();
+    }
+    drawCalls = glState.drawCalls;
+    profiler.push(Profiler::Swap);
     GLMeta::blitBeginScreen(winSize);
     GLMeta::blitSource(screen.getPP().frontBuffer());
     FBO::clear();
     metaBlitBufferFlippedScaled();
     GLMeta::blitEnd();
+    profiler.pop(Profiler::Swap);
+    if (threadData->config.profilerOverlay)
+      profiler.drawOverlay(winSize, 1000.0f / frameRate);
     swapGLBuffer();
   }
 
@@ -598,6 +722,7 @@ Graphics::Graphics(RGSSThreadData *data) :
   screenshot_format(0), screenshot_dir(""), screenshot_fn("")
 {
   p = new GraphicsPrivate(data);
+  p->fpsLimiter.precise = data->config.precisePacing;
   if (data->config.syncToRefreshrate) {
     p->frameRate = data->refreshRate;
     p->fpsLimiter.disabled = true;
@@ -633,11 +758,16 @@ void Graphics::update()
   p->checkShutDownReset();
   p->checkSyncLock();
   if (p->frozen) return;
+  p->profiler.pop(Profiler::Script);
+  Bitmap::flushPrefetches();
   if (p->fpsLimiter.frameSkipRequired()) {
     if (p->threadData->config.frameSkip) { // Skip frame
+      p->profiler.push(Profiler::Idle);
       p->fpsLimiter.delay();
+      p->profiler.pop(Profiler::Idle);
       ++p->frameCount;
       p->threadData->ethread->notifyFrame();
+      p->profiler.frameDone();
       return;
     } else { // Just reset frame adjust counter
       p->fpsLimiter.resetFrameAdjust();
@@ -662,7 +792,8 @@ void Graphics::transition(int duration, const char *filename, int vague)
   vague = clamp(vague, 1, 256);
   Bitmap *transMap = *filename ? new Bitmap(filename) : 0;
   setBrightness(255);
-  // Capture new scene
+  // Capture new scene, the back buffer gets drawn over below
+  markDirty();
   p->screen.composite();
   /* The PP frontbuffer will hold the current scene after the
    * composition step. Since the backbuffer is unused during
@@ -679,7 +810,10 @@ void Graphics::transition(int duration, const char *filename, int vague)
     shader.applyViewportProj();
     shader.setFrozenScene(p->frozenScene.tex);
     shader.setCurrentScene(currentScene.tex);
-    shader.setTransMap(transMap->getGLTypes().tex);
+    TEXFBO &mapTex = transMap->getGLTypes();
+    shader.setTransMap(mapTex.tex);
+    shader.setTransMapScale(Vec2((float) mapTex.width / mapTex.texW,
+                                 (float) mapTex.height / mapTex.texH));
     shader.setVague(vague / 256.0f);
     shader.setTexSize(p->scRes);
   } else {
@@ -750,6 +884,26 @@ int Graphics::getFrameRate() const
 
 DEF_ATTR_SIMPLE(Graphics, FrameCount, int, p->frameCount)
 
+void Graphics::frame_times(std::vector<float> &out) const
+{
+  p->fpsLimiter.frameTimes(out);
+}
+
+unsigned int Graphics::draw_calls() const
+{
+  return p->drawCalls;
+}
+
+const Profiler &Graphics::profiler() const
+{
+  return p->profiler;
+}
+
+void Graphics::markDirty()
+{
+  ++frameGeneration;
+}
+
 void Graphics::setFrameRate(int value)
 {
   p->frameRate = clamp(value, 10, 120);
@@ -913,6 +1067,7 @@ void Graphics::setBrightness(int value)
   if (p->brightness == value) return;
   p->brightness = value;
   p->screen.setBrightness(value / 255.0);
+  markDirty();
 }
 
 void Graphics::reset()
@@ -929,6 +1084,7 @@ void Graphics::reset()
   p->fpsLimiter.resetFrameAdjust();
   p->frozen = false;
   p->screen.getPP().clearBuffers();
+  markDirty();
   setFrameRate(DEF_FRAMERATE);
   setBrightness(255);
 }
@@ -24,10 +24,12 @@
 #define GRAPHICS_H
 
 #include "util.h"
+#include <vector>
 
 class Scene;
 class Bitmap;
 class Disposable;
+class Profiler;
 struct RGSSThreadData;
 struct GraphicsPrivate;
 struct AtomicFlag;
@@ -76,6 +78,16 @@ public:
   void set_block_ftwelve(bool value);
   void set_block_fone(bool value);
   void set_show_cursor(bool value);
+  // Durations of the latest frames in milliseconds, oldest first
+  void frame_times(std::vector<float> &out) const;
+  /* Called by anything changing what the next frame would
+   * show; frames nothing was changed for since the last one
+   * aren't composited again (see skipIdleFrames) */
+  static void markDirty();
+  // Draw calls issued compositing the latest frame
+  unsigned int draw_calls() const;
+  // Per subsystem timings of the latest frames (see profiler.h)
+  const Profiler &profiler() const;
   /* <internal> */
   Scene *getScreen() const;
   /* Repaint screen with static image until exitCond
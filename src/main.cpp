@@ -94,7 +94,10 @@ int rgssThreadFun(void *userdata)
   SDL_GL_SwapWindow(win);
   printGLInfo();
   bool vsync = conf.vsync || conf.syncToRefreshrate;
-  SDL_GL_SetSwapInterval(vsync ? 1 : 0);
+  /* Adaptive vsync lets late frames tear instead of
+   * waiting for the next refresh; not supported everywhere */
+  if (!vsync || !conf.adaptiveVsync || SDL_GL_SetSwapInterval(-1) != 0)
+    SDL_GL_SetSwapInterval(vsync ? 1 : 0);
   GLDebugLogger dLogger;
   /* Setup AL context */
   ALCcontext *alcCtx = alcCreateContext(threadData->alcDev, 0);
@@ -0,0 +1,137 @@
+/*
+** midirender.cpp
+**
+** This file is part of HiddenChest
+*/
+
+#include "midirender.h"
+#include <algorithm>
+
+MidiRenderCache::MidiRenderCache(uint32_t budget)
+: budget(budget),
+  cachedBytes(0),
+  termReq(false)
+{
+  mut = SDL_CreateMutex();
+  cond = SDL_CreateCond();
+  thread = createSDLThread<MidiRenderCache, &MidiRenderCache::renderSongs>(this, "midi_render");
+}
+
+MidiRenderCache::~MidiRenderCache()
+{
+  SDL_LockMutex(mut);
+  termReq = true;
+  RenderHash::const_iterator iter;
+  for (iter = renders.cbegin(); iter != renders.cend(); ++iter)
+    iter->second->cancelled.set();
+  SDL_CondSignal(cond);
+  SDL_UnlockMutex(mut);
+  SDL_WaitThread(thread, 0);
+  /* The worker took care of the one it was rendering */
+  for (iter = renders.cbegin(); iter != renders.cend(); ++iter)
+    delete iter->second;
+  SDL_DestroyCond(cond);
+  SDL_DestroyMutex(mut);
+}
+
+MidiRender *MidiRenderCache::acquire(const std::vector<uint8_t> &midi,
+                                     bool looped, int8_t pitchShift)
+{
+  std::string key(midi.begin(), midi.end());
+  key += looped ? 'l' : 'o';
+  key += (char) pitchShift;
+  SDL_LockMutex(mut);
+  MidiRender *render = renders.value(key, 0);
+  /* Abandoned ones still rendering get deleted by the worker */
+  if (render && render->cancelled) {
+    renders.remove(key);
+    render = 0;
+  }
+  if (!render) {
+    render = new MidiRender;
+    render->key = key;
+    render->looped = looped;
+    render->pitchShift = pitchShift;
+    renders.insert(key, render);
+    queue.push_back(render);
+    SDL_CondSignal(cond);
+  } else if (render->done) {
+    finished.remove(render->link);
+    finished.prepend(render->link);
+  }
+  ++render->refCount;
+  SDL_UnlockMutex(mut);
+  return render;
+}
+
+void MidiRenderCache::release(MidiRender *render)
+{
+  SDL_LockMutex(mut);
+  /* Failed renders stay around, so they aren't tried over and over */
+  if (--render->refCount == 0 && !render->done && !render->failed) {
+    render->cancelled.set();
+    std::deque<MidiRender*>::iterator queued = std::find(queue.begin(), queue.end(), render);
+    if (queued != queue.end()) {
+      queue.erase(queued);
+      renders.remove(render->key);
+      delete render;
+    }
+  }
+  evict();
+  SDL_UnlockMutex(mut);
+}
+
+bool MidiRenderCache::ready(MidiRender *render)
+{
+  return render->done;
+}
+
+void MidiRenderCache::renderSongs()
+{
+  SDL_LockMutex(mut);
+  while (true) {
+    while (!termReq && queue.empty())
+      SDL_CondWait(cond, mut);
+    if (termReq) break;
+    MidiRender *render = queue.front();
+    queue.pop_front();
+    SDL_UnlockMutex(mut);
+    const bool rendered = renderMidi(*render, budget);
+    SDL_LockMutex(mut);
+    if (render->cancelled) {
+      if (renders.value(render->key, 0) == render)
+        renders.remove(render->key);
+      delete render;
+      continue;
+    }
+    if (!rendered) {
+      render->failed = true;
+      std::vector<int16_t>().swap(render->pcm);
+      continue;
+    }
+    cachedBytes += render->bytes();
+    finished.prepend(render->link);
+    render->done.set();
+    evict();
+  }
+  SDL_UnlockMutex(mut);
+}
+
+void MidiRenderCache::evict()
+{
+  IntruListLink<MidiRender> *iter = finished.end()->prev;
+  while (cachedBytes > budget && iter != finished.end()) {
+    MidiRender *render = iter->data;
+    iter = iter->prev;
+    if (render->refCount == 0)
+      drop(render);
+  }
+}
+
+void MidiRenderCache::drop(MidiRender *render)
+{
+  finished.remove(render->link);
+  renders.remove(render->key);
+  cachedBytes -= render->bytes();
+  delete render;
+}
@@ -0,0 +1,84 @@
+/*
+** midirender.h
+**
+** This file is part of HiddenChest
+*/
+
+#ifndef MIDIRENDER_H
+#define MIDIRENDER_H
+
+#include "boost-hash.h"
+#include "intrulist.h"
+#include "sdl-util.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+
+/* A MIDI song synthesized to PCM ahead of its playback */
+struct MidiRender
+{
+  /* Song data, looping and pitch shift, which
+   * the PCM only matches all together */
+  std::string key;
+  bool looped;
+  int8_t pitchShift;
+  /* Interleaved stereo frames, left alone once done */
+  std::vector<int16_t> pcm;
+  /* Looped songs play [loopStart, frames) over and over once
+   * reaching their end, loopStart is negative for all others */
+  int64_t loopStart;
+  uint32_t frames;
+  AtomicFlag done;
+  AtomicFlag cancelled;
+  /* Owned by MidiRenderCache */
+  bool failed;
+  uint32_t refCount;
+  IntruListLink<MidiRender> link;
+
+  MidiRender() : looped(false), pitchShift(0), loopStart(-1), frames(0),
+    failed(false), refCount(0), link(this) {}
+  uint32_t bytes() const { return pcm.size() * sizeof(int16_t); }
+};
+
+/* Renders songs one after another on a worker thread and keeps
+ * the finished ones around, dropping the least recently played
+ * unused ones once they take up more than the budget */
+class MidiRenderCache
+{
+public:
+  MidiRenderCache(uint32_t budget);
+  ~MidiRenderCache();
+  /* Returns the render of 'midi', queueing it up if needed */
+  MidiRender *acquire(const std::vector<uint8_t> &midi, bool looped, int8_t pitchShift);
+  /* Renders still in progress get cancelled once unused */
+  void release(MidiRender *render);
+  /* True once 'render' finished successfully */
+  bool ready(MidiRender *render);
+
+private:
+  void renderSongs();
+  void evict();
+  void drop(MidiRender *render);
+
+  typedef BoostHash<std::string, MidiRender*> RenderHash;
+  const uint32_t budget;
+  uint32_t cachedBytes;
+  RenderHash renders;
+  /* Finished renders, most recently acquired first */
+  IntruList<MidiRender> finished;
+  std::deque<MidiRender*> queue;
+  bool termReq;
+  SDL_mutex *mut;
+  SDL_cond *cond;
+  SDL_Thread *thread;
+};
+
+/* Synthesizes 'render' the same way MidiSource plays it, giving
+ * up once it would take up more than 'maxBytes'. Defined in
+ * midisource.cpp, returns false on failure or cancellation */
+bool renderMidi(MidiRender &render, uint32_t maxBytes);
+
+#endif // MIDIRENDER_H
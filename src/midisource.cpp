@@ -27,6 +27,7 @@
 #include "util.h"
 #include "debugwriter.h"
 #include "fluid-fun.h"
+#include "midirender.h"
 #include <SDL_rwops.h>
 #include <assert.h>
 #include <math.h>
@@ -610,14 +611,45 @@ struct MidiSource : ALDataSource, MidiReadHandler
 	/* MidiReadHandler (track that's currently being read) */
 	int16_t curTrack;
 
+	/* Song length, in deltas */
+	uint64_t songDeltas;
+
+	/* Deltas and frames synthesized since the last reset */
+	uint64_t playedDeltas;
+	uint64_t renderedFrames;
+
+	/* Frame count once 'playedDeltas' reached 'markDeltas' */
+	uint64_t markDeltas;
+	int64_t markFrame;
+
+	/* Pre-rendered PCM of the song, played instead
+	 * of synthesizing it live once it is done */
+	MidiRenderCache *renderCache;
+	std::vector<uint8_t> midiData;
+	MidiRender *render;
+	int8_t renderPitch;
+	bool playingRender;
+	uint32_t renderPos;
+
 	MidiSource(SDL_RWops &ops,
-	           bool looped)
+	           bool looped,
+	           bool live = true)
 	    : freq(SYNTH_SAMPLERATE),
 	      looped(looped),
+	      loopDelta(0),
 	      dpb(480),
 	      pitchShift(0),
 	      genDeltasCarry(0),
-	      curTrack(-1)
+	      curTrack(-1),
+	      playedDeltas(0),
+	      renderedFrames(0),
+	      markDeltas((uint64_t) -1),
+	      markFrame(-1),
+	      renderCache(live ? shState->midiState().renderCache : 0),
+	      render(0),
+	      renderPitch(0),
+	      playingRender(false),
+	      renderPos(0)
 	{
 		size_t dataLen = SDL_RWsize(&ops);
 		std::vector<uint8_t> data(dataLen);
@@ -638,6 +670,9 @@ struct MidiSource : ALDataSource, MidiReadHandler
 			throw;
 		}
 
+		if (renderCache)
+			midiData.swap(data);
+
 		synth = shState->midiState().allocateSynth();
 
 		uint64_t longest = 0;
@@ -652,6 +687,8 @@ struct MidiSource : ALDataSource, MidiReadHandler
 		for (size_t i = 0; i < tracks.size(); ++i)
 			tracks[i].loopOffsetEnd = longest - tracks[i].length;
 
+		songDeltas = longest;
+
 		/* Enterbrain likes to be funny and put loop markers at
 		 * the very end of ME tracks */
 		if (loopDelta >= longest)
@@ -690,6 +727,9 @@ struct MidiSource : ALDataSource, MidiReadHandler
 
 	~MidiSource()
 	{
+		if (render)
+			renderCache->release(render);
+
 		shState->midiState().releaseSynth(synth);
 	}
 
@@ -785,8 +825,8 @@ struct MidiSource : ALDataSource, MidiReadHandler
 			loopDelta = absDelta;
 	}
 
-	/* ALDataSource */
-	Status fillBuffer(AL::Buffer::ID buf)
+	/* Synthesizes the next buffer's worth of ticks into 'synthBuf' */
+	void synthesize()
 	{
 		/* In case there is no currently scheduled one */
 		for (size_t i = 0; i < tracks.size(); ++i)
@@ -871,7 +911,92 @@ struct MidiSource : ALDataSource, MidiReadHandler
 			for (size_t i = 0; i < tracks.size(); ++i)
 				if (tracks[i].valid)
 					tracks[i].remDeltas -= intDeltas;
+
+			playedDeltas += intDeltas;
+			renderedFrames += genTicks * TICK_FRAMES;
+
+			if (markFrame < 0 && playedDeltas >= markDeltas)
+				markFrame = renderedFrames;
 		}
+	}
+
+	/* Only looping songs wrap around at their end */
+	bool canLoop() const
+	{
+		const Track &track = tracks[longestI];
+
+		return looped && track.loopI >= 0 && track.length > 0;
+	}
+
+	/* Maps a frame of the live synthesized song onto the render */
+	uint32_t renderFrame(uint64_t frame) const
+	{
+		if (frame < render->frames)
+			return frame;
+
+		if (render->loopStart < 0)
+			return render->frames;
+
+		uint32_t loopFrames = render->frames - render->loopStart;
+
+		return render->loopStart + (frame - render->loopStart) % loopFrames;
+	}
+
+	Status fillFromRender(AL::Buffer::ID buf)
+	{
+		if (!playingRender)
+		{
+			/* Carry on from where live synthesis got to */
+			renderPos = renderFrame(renderedFrames);
+			playingRender = true;
+		}
+
+		uint32_t count = std::min<uint32_t>(BUF_TICKS * TICK_FRAMES,
+		                                    render->frames - renderPos);
+
+		if (count == 0)
+		{
+			memset(synthBuf, 0, sizeof(synthBuf));
+			AL::Buffer::uploadData(buf, AL_FORMAT_STEREO16, synthBuf, sizeof(synthBuf), freq);
+
+			return EndOfStream;
+		}
+
+		AL::Buffer::uploadData(buf, AL_FORMAT_STEREO16, &render->pcm[renderPos*2],
+		                       count * 2 * sizeof(int16_t), freq);
+		renderPos += count;
+
+		if (renderPos < render->frames)
+			return NoError;
+
+		if (render->loopStart < 0)
+			return EndOfStream;
+
+		renderPos = render->loopStart;
+
+		return WrapAround;
+	}
+
+	/* ALDataSource */
+	Status fillBuffer(AL::Buffer::ID buf)
+	{
+		/* Renders depend on the pitch, which only
+		 * changes while the stream is stopped */
+		if (renderCache && (!render || renderPitch != pitchShift))
+		{
+			if (render)
+				renderCache->release(render);
+
+			render = renderCache->acquire(midiData, looped, pitchShift);
+			renderPitch = pitchShift;
+			playingRender = false;
+		}
+
+		/* Live synthesis only fills in until the render is done */
+		if (render && renderCache->ready(render))
+			return fillFromRender(buf);
+
+		synthesize();
 
 		/* Fill AL buffer */
 		AL::Buffer::uploadData(buf, AL_FORMAT_STEREO16, synthBuf, sizeof(synthBuf), freq);
@@ -887,22 +1012,36 @@ struct MidiSource : ALDataSource, MidiReadHandler
 		return freq;
 	}
 
-	/* Midi sources cannot seek, and so always reset to beginning */
-	void seekToOffset(float)
+	/* Midi sources cannot seek, and so always reset to beginning,
+	 * unless they already play their render */
+	void seekToOffset(float seconds)
 	{
 		/* Reset synth */
 		fluid.synth_system_reset(synth);
 
 		/* Reset runtime variables */
 		genDeltasCarry = 0;
+		playedDeltas = 0;
+		renderedFrames = 0;
 		updatePlaybackSpeed(DEFAULT_BPM);
 
 		/* Reset tracks */
 		for (size_t i = 0; i < tracks.size(); ++i)
 			tracks[i].reset();
+
+		playingRender = false;
+
+		if (render && renderPitch == pitchShift && renderCache->ready(render))
+		{
+			renderPos = renderFrame(seconds * freq);
+			playingRender = true;
+		}
 	}
 
-	uint32_t loopStartFrames() { return 0; }
+	uint32_t loopStartFrames()
+	{
+		return playingRender ? render->loopStart : 0;
+	}
 
 	bool setPitch(float value)
 	{
@@ -918,3 +1057,84 @@ ALDataSource *createMidiSource(SDL_RWops &ops,
 {
 	return new MidiSource(ops, looped);
 }
+
+/* Looped songs are rendered through their end and then once
+ * more through their looping part, which then holds the notes
+ * decaying past the end just like live playback does */
+bool renderMidi(MidiRender &render, uint32_t maxBytes)
+{
+	/* The key starts out with the midi data */
+	SDL_RWops *ops = SDL_RWFromConstMem(render.key.data(), render.key.size() - 2);
+	MidiSource *source;
+
+	try
+	{
+		source = new MidiSource(*ops, render.looped, false);
+	}
+	catch (const Exception &)
+	{
+		/* Closed by the constructor already */
+		return false;
+	}
+
+	SDL_RWclose(ops);
+
+	source->pitchShift = render.pitchShift;
+
+	const bool looping = source->canLoop();
+	const size_t blockSamples = BUF_TICKS * TICK_FRAMES * 2;
+	int64_t loopStart = -1;
+	bool rendered = false;
+
+	source->markDeltas = source->songDeltas;
+
+	while (!render.cancelled)
+	{
+		if ((render.pcm.size() + blockSamples) * sizeof(int16_t) > maxBytes)
+			break;
+
+		source->synthesize();
+		render.pcm.insert(render.pcm.end(), source->synthBuf,
+		                  source->synthBuf + blockSamples);
+
+		if (!looping)
+		{
+			if (!source->tracks[source->longestI].atEnd)
+				continue;
+
+			render.frames = render.pcm.size() / 2;
+			rendered = true;
+
+			break;
+		}
+
+		if (source->markFrame < 0)
+			continue;
+
+		if (loopStart < 0)
+		{
+			/* Reached the end for the first time */
+			loopStart = source->markFrame;
+			source->markDeltas = source->songDeltas * 2 - source->loopDelta;
+			source->markFrame = -1;
+
+			continue;
+		}
+
+		render.frames = source->markFrame;
+		render.loopStart = loopStart;
+		render.pcm.resize(render.frames * 2);
+		rendered = true;
+
+		break;
+	}
+
+	delete source;
+
+	/* Growing the buffer left spare capacity behind, which
+	 * the cache budget wouldn't account for */
+	if (rendered)
+		std::vector<int16_t>(render.pcm).swap(render.pcm);
+
+	return rendered;
+}
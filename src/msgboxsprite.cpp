@@ -453,7 +453,7 @@ void MsgBoxSprite::setBlendType(int type)
 
 int MsgBoxSprite::getReduceSpeed()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   return p->reduceSpeed;
 }
 
@@ -511,31 +511,31 @@ void MsgBoxSprite::reduceWidthHeight()
 
 bool MsgBoxSprite::isWidthIncreased()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   return p->reducedWidth == 0;
 }
 
 bool MsgBoxSprite::isHeightIncreased()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   return p->reducedHeight == 0;
 }
 
 bool MsgBoxSprite::isWidthReduced()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   return p->reducedWidth == p->bitmap->width();
 }
 
 bool MsgBoxSprite::isHeightReduced()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   return p->reducedHeight == p->bitmap->height();
 }
 
 bool MsgBoxSprite::isMouseInside()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   if (!p->isVisible) return false;
   int mx = shState->input().mouseX();
   int x = p->trans.getPosition().x;
@@ -549,7 +549,7 @@ bool MsgBoxSprite::isMouseInside()
 
 bool MsgBoxSprite::isMouseAboveColorFound()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   if (!p->isVisible) return false;
   int mx = shState->input().mouseX();
   int x = p->trans.getPosition().x;
@@ -564,7 +564,7 @@ bool MsgBoxSprite::isMouseAboveColorFound()
 
 bool MsgBoxSprite::isMouseAboveCloseIcon()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   if (!p->isVisible) return false;
   int mx = shState->input().mouseX();
   int x = p->trans.getPosition().x + p->srcRect->width - 26;
@@ -0,0 +1,246 @@
+/*
+** pcmcache.cpp
+**
+** This file is part of HiddenChest
+*/
+
+#include "pcmcache.h"
+#include "config.h"
+#include <SDL_platform.h>
+#include <SDL_thread.h>
+#include <zlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <vector>
+#include <algorithm>
+#ifdef __WINDOWS__
+#include <direct.h>
+#include <process.h>
+#include <sys/utime.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#define PCM_CACHE_DIR "secache"
+#define PCM_CACHE_VERSION 1
+/* Larger entries can only be corrupt, no sound
+ * effect gets anywhere near this */
+#define PCM_ENTRY_MAX (256*1024*1024)
+
+struct PCMHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t rate;
+  uint8_t sampleSize;
+  uint8_t channels;
+  uint8_t compressed;
+  uint8_t padding;
+  /* Size of the decoded PCM and of what follows the header */
+  uint32_t bytes;
+  uint32_t stored;
+};
+
+static const char pcmMagic[4] = { 'H', 'C', 'P', 'C' };
+
+/* FNV-1a, good enough to tell sounds apart */
+static uint64_t hashData(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+  const uint8_t *p = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i)
+    hash = (hash ^ p[i]) * 1099511628211ULL;
+  return hash;
+}
+
+/* Fails harmlessly if it exists already */
+static void makeDir(const std::string &path)
+{
+#ifdef __WINDOWS__
+  _mkdir(path.c_str());
+#else
+  mkdir(path.c_str(), 0755);
+#endif
+}
+
+struct DiskEntry
+{
+  std::string path;
+  uint64_t size;
+  time_t used;
+  DiskEntry(const std::string &path, uint64_t size, time_t used)
+  : path(path), size(size), used(used) {}
+  bool operator<(const DiskEntry &o) const { return used < o.used; }
+};
+
+PCMCache::PCMCache(const Config &conf)
+: compressEntries(conf.SE.diskCacheCompress),
+  budget((uint64_t) conf.SE.diskCacheSize * 1024 * 1024),
+  diskBytes(0)
+{
+  mut = SDL_CreateMutex();
+  if (!conf.SE.diskCache) return;
+  /* Entries that can't be written just get decoded every time */
+  const std::string &base = conf.customDataPath.empty() ?
+                            conf.commonDataPath : conf.customDataPath;
+  if (base.empty()) return;
+  dir = base + PCM_CACHE_DIR "/";
+  makeDir(dir);
+  prune();
+}
+
+PCMCache::~PCMCache()
+{
+  SDL_DestroyMutex(mut);
+}
+
+bool PCMCache::enabled() const
+{
+  return !dir.empty();
+}
+
+std::string PCMCache::entryPath(const std::string &path,
+                                const void *data, size_t size) const
+{
+  char name[48];
+  snprintf(name, sizeof(name), "%016llx-%016llx.pcm",
+           (unsigned long long) hashData(path.c_str(), path.size()),
+           (unsigned long long) hashData(data, size));
+  return dir + name;
+}
+
+bool PCMCache::load(const std::string &entry, PCM &pcm) const
+{
+  FILE *f = fopen(entry.c_str(), "rb");
+  if (!f) return false;
+  long size = -1;
+  if (fseek(f, 0, SEEK_END) == 0) {
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+  }
+  PCMHeader hd;
+  bool ok = size > (long) sizeof(hd)
+         && fread(&hd, sizeof(hd), 1, f) == 1
+         && memcmp(hd.magic, pcmMagic, sizeof(pcmMagic)) == 0
+         && hd.version == PCM_CACHE_VERSION
+         && (hd.sampleSize == 1 || hd.sampleSize == 2)
+         && (hd.channels == 1 || hd.channels == 2)
+         && hd.rate > 0
+         && hd.bytes > 0 && hd.bytes <= PCM_ENTRY_MAX
+         && hd.bytes % (hd.sampleSize * hd.channels) == 0
+         && hd.stored == (unsigned long) size - sizeof(hd)
+         && (hd.compressed ? hd.stored <= compressBound(hd.bytes)
+                           : hd.stored == hd.bytes);
+  std::vector<uint8_t> stored;
+  if (ok) {
+    stored.resize(hd.stored);
+    ok = fread(&stored[0], 1, hd.stored, f) == hd.stored;
+  }
+  fclose(f);
+  if (ok && hd.compressed) {
+    pcm.data.resize(hd.bytes);
+    uLongf len = hd.bytes;
+    ok = uncompress(&pcm.data[0], &len, &stored[0], stored.size()) == Z_OK
+      && len == hd.bytes;
+  } else if (ok) {
+    pcm.data.swap(stored);
+  }
+  if (!ok) {
+    remove(entry.c_str());
+    return false;
+  }
+  pcm.sampleSize = hd.sampleSize;
+  pcm.channels = hd.channels;
+  pcm.rate = hd.rate;
+  /* Pruning goes by the modification time */
+  utime(entry.c_str(), 0);
+  return true;
+}
+
+void PCMCache::store(const std::string &entry, uint8_t sampleSize, uint8_t channels,
+                     uint32_t rate, const void *data, uint32_t bytes)
+{
+  if (bytes > PCM_ENTRY_MAX) return;
+  PCMHeader hd;
+  memcpy(hd.magic, pcmMagic, sizeof(pcmMagic));
+  hd.version = PCM_CACHE_VERSION;
+  hd.rate = rate;
+  hd.sampleSize = sampleSize;
+  hd.channels = channels;
+  hd.compressed = 0;
+  hd.padding = 0;
+  hd.bytes = bytes;
+  hd.stored = bytes;
+  std::vector<uint8_t> packed;
+  const void *payload = data;
+  if (compressEntries) {
+    /* Higher levels gain next to nothing on PCM */
+    uLongf len = compressBound(bytes);
+    packed.resize(len);
+    if (compress2(&packed[0], &len, static_cast<const Bytef*>(data), bytes, 1) == Z_OK
+        && len < bytes) {
+      hd.compressed = 1;
+      hd.stored = len;
+      payload = &packed[0];
+    }
+  }
+  /* Written under a temporary name first, so an interrupted
+   * write never leaves a truncated entry behind. The name is
+   * unique to this process and thread, as other instances
+   * of the game might be writing the same entry */
+  char suffix[48];
+  snprintf(suffix, sizeof(suffix), ".%d-%lu.tmp",
+           (int) getpid(), (unsigned long) SDL_ThreadID());
+  const std::string temp = entry + suffix;
+  FILE *f = fopen(temp.c_str(), "wb");
+  if (!f) return;
+  bool ok = fwrite(&hd, sizeof(hd), 1, f) == 1
+         && fwrite(payload, 1, hd.stored, f) == hd.stored;
+  ok = fclose(f) == 0 && ok;
+  if (ok) {
+    remove(entry.c_str());
+    ok = rename(temp.c_str(), entry.c_str()) == 0;
+  }
+  if (!ok) {
+    remove(temp.c_str());
+    return;
+  }
+  SDL_LockMutex(mut);
+  diskBytes += sizeof(hd) + hd.stored;
+  if (diskBytes > budget)
+    prune();
+  SDL_UnlockMutex(mut);
+}
+
+/* Deletes the least recently used entries until they take up
+ * no more than part of the budget. Leftover temporary files of
+ * crashed writes are old, so they go first */
+void PCMCache::prune()
+{
+  DIR *d = opendir(dir.c_str());
+  if (!d) return;
+  std::vector<DiskEntry> entries;
+  diskBytes = 0;
+  while (struct dirent *e = readdir(d)) {
+    if (e->d_name[0] == '.') continue;
+    const std::string path = dir + e->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+    entries.push_back(DiskEntry(path, st.st_size, st.st_mtime));
+    diskBytes += st.st_size;
+  }
+  closedir(d);
+  if (diskBytes <= budget) return;
+  std::sort(entries.begin(), entries.end());
+  /* Frees up a quarter of the budget, so pruning
+   * doesn't have to run again right away */
+  const uint64_t keep = budget - budget / 4;
+  for (size_t i = 0; i < entries.size() && diskBytes > keep; ++i) {
+    if (remove(entries[i].path.c_str()) == 0)
+      diskBytes -= entries[i].size;
+  }
+}
@@ -0,0 +1,58 @@
+/*
+** pcmcache.h
+**
+** This file is part of HiddenChest
+*/
+
+#ifndef PCMCACHE_H
+#define PCMCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <SDL_mutex.h>
+
+struct Config;
+
+/* Decoded sound effects kept on disk across runs, so later
+ * launches upload them without decoding them again. Entries
+ * are named after the sound's path and the hash of its encoded
+ * data, so an edited sound never picks up its stale entry.
+ * Entries used least recently get deleted once all of them
+ * take up more than the budget. The decode workers can
+ * use it all at once */
+class PCMCache
+{
+public:
+  struct PCM
+  {
+    uint8_t sampleSize;
+    uint8_t channels;
+    uint32_t rate;
+    std::vector<uint8_t> data;
+  };
+
+  PCMCache(const Config &conf);
+  ~PCMCache();
+  bool enabled() const;
+  /* 'data' is the encoded sound file found at 'path' */
+  std::string entryPath(const std::string &path,
+                        const void *data, size_t size) const;
+  /* Invalid entries are deleted, so the sound gets decoded anew */
+  bool load(const std::string &entry, PCM &pcm) const;
+  void store(const std::string &entry, uint8_t sampleSize, uint8_t channels,
+             uint32_t rate, const void *data, uint32_t bytes);
+
+private:
+  void prune();
+
+  std::string dir;
+  bool compressEntries;
+  const uint64_t budget;
+  /* Size of all entries, as of the last prune plus stores since */
+  uint64_t diskBytes;
+  SDL_mutex *mut;
+};
+
+#endif // PCMCACHE_H
@@ -50,6 +50,8 @@ struct PlanePrivate
   float zoomX, zoomY;
   Scene::Geometry sceneGeo;
   bool quadSourceDirty;
+  /* Whether qArray holds a single GL_REPEAT quad */
+  bool repeat;
   SimpleQuadArray qArray;
   EtcTemps tmp;
   sigc::connection prepareCon;
@@ -61,7 +63,8 @@ struct PlanePrivate
         tone(&tmp.tone),
         ox(0), oy(0),
         zoomX(1), zoomY(1),
-        quadSourceDirty(false)
+        quadSourceDirty(false),
+        repeat(false)
   {
     prepareCon = shState->prepareDraw.connect
             (sigc::mem_fun(this, &PlanePrivate::prepare));
@@ -73,15 +76,26 @@ struct PlanePrivate
     prepareCon.disconnect();
   }
 
+  /* GL_REPEAT wraps around the whole texture, which only
+   * matches the bitmap if the pool didn't round its size up */
+  bool canRepeat()
+  {
+    if (!gl.npot_repeat || nullOrDisposed(bitmap)) return false;
+    const TEXFBO &tex = bitmap->getGLTypes();
+    return tex.texW == tex.width && tex.texH == tex.height;
+  }
+
   void updateQuadSource()
   {
-    if (gl.npot_repeat) {
+    repeat = canRepeat();
+    if (repeat) {
       FloatRect srcRect;
       srcRect.x = (sceneGeo.orig.x + ox) / zoomX;
       srcRect.y = (sceneGeo.orig.y + oy) / zoomY;
       srcRect.w = sceneGeo.rect.w / zoomX;
       srcRect.h = sceneGeo.rect.h / zoomY;
-      Quad::setTexRect(&qArray.vertices[0], srcRect);
+      qArray.resize(1);
+      Quad::setTexPosRect(&qArray.vertices[0], srcRect, FloatRect(sceneGeo.rect));
       qArray.commit();
       return;
     }
@@ -143,6 +157,7 @@ void Plane::setBitmap(Bitmap *value)
 {
   guardDisposed();
   p->bitmap = value;
+  p->quadSourceDirty = true;
   if (!value) return;
   value->ensureNonMega();
 }
@@ -226,18 +241,16 @@ void Plane::draw()
   }
   glState.blendMode.pushSet(p->blendType);
   p->bitmap->bindTex(*base);
-  if (gl.npot_repeat)
+  if (p->repeat)
           TEX::setRepeat(true);
   p->qArray.draw();
-  if (gl.npot_repeat)
+  if (p->repeat)
           TEX::setRepeat(false);
   glState.blendMode.pop();
 }
 
 void Plane::onGeometryChange(const Scene::Geometry &geo)
 {
-  if (gl.npot_repeat)
-    Quad::setPosRect(&p->qArray.vertices[0], FloatRect(geo.rect));
   p->sceneGeo = geo;
   p->quadSourceDirty = true;
 }
@@ -0,0 +1,357 @@
+/*
+** profiler.cpp
+**
+** This file is part of HiddenChest
+*/
+
+#include "profiler.h"
+#include "gl-fun.h"
+#include "glstate.h"
+#include "gl-util.h"
+#include "quad.h"
+#include "quadarray.h"
+#include "shader.h"
+#include "sharedstate.h"
+#include "debugwriter.h"
+#include <SDL_timer.h>
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+
+/* Frames a record waits for its GPU results */
+#define PROFILER_LATENCY 4
+/* Query segments a single frame may use up */
+#define PROFILER_MAX_SEGMENTS 256
+#define PROFILER_MAX_DEPTH 8
+/* Frames shown by the overlay */
+#define OVERLAY_FRAMES 120
+#define OVERLAY_BAR_W 3
+#define OVERLAY_MARGIN 8
+#define OVERLAY_PX_PER_MS 4
+
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+/* Part of a frame timed by one query */
+struct QuerySegment
+{
+  GLuint query;
+  int section;
+  QuerySegment(GLuint query, int section) : query(query), section(section) {}
+};
+
+struct FrameRecord
+{
+  bool used;
+  uint64_t number;
+  float cpu[Profiler::SectionCount];
+  std::vector<QuerySegment> segments;
+  /* Cleared when the frame ran out of segments */
+  bool gpuComplete;
+};
+
+struct FrameSample
+{
+  float cpu[Profiler::SectionCount];
+  float gpu[Profiler::SectionCount];
+};
+
+static const char *sectionNames[Profiler::SectionCount] =
+{
+  "script", "prepare", "composite", "effects", "idle", "swap"
+};
+
+static const Vec4 sectionColors[Profiler::SectionCount] =
+{
+  Vec4(0.3f, 0.5f, 1.0f, 0.8f),
+  Vec4(1.0f, 0.6f, 0.1f, 0.8f),
+  Vec4(0.2f, 0.9f, 0.3f, 0.8f),
+  Vec4(0.9f, 0.3f, 0.9f, 0.8f),
+  Vec4(0.4f, 0.4f, 0.4f, 0.5f),
+  Vec4(1.0f, 0.9f, 0.2f, 0.8f)
+};
+
+struct ProfilerPrivate
+{
+  bool enabled;
+  bool gpu;
+  const uint64_t tickFreq;
+  uint64_t lastTick;
+  Profiler::Section stack[PROFILER_MAX_DEPTH];
+  int depth;
+  bool queryOpen;
+  std::vector<GLuint> freeQueries;
+  FrameRecord frames[PROFILER_LATENCY];
+  int current;
+  uint64_t frameNumber;
+  FrameSample latest;
+  FrameSample history[OVERLAY_FRAMES];
+  int historyNext, historyCount;
+  FILE *trace;
+  ColorQuadArray *overlay;
+
+  ProfilerPrivate(bool enabled)
+  : enabled(enabled),
+    gpu(enabled && gl.timer_query),
+    tickFreq(SDL_GetPerformanceFrequency()),
+    lastTick(SDL_GetPerformanceCounter()),
+    depth(0),
+    queryOpen(false),
+    current(0),
+    frameNumber(0),
+    historyNext(0),
+    historyCount(0),
+    trace(0),
+    overlay(0)
+  {
+    for (int i = 0; i < PROFILER_LATENCY; ++i)
+      frames[i].used = false;
+    for (int i = 0; i < Profiler::SectionCount; ++i)
+      latest.cpu[i] = latest.gpu[i] = -1;
+  }
+
+  ~ProfilerPrivate()
+  {
+    if (queryOpen)
+      gl.EndQuery(GL_TIME_ELAPSED);
+    for (int i = 0; i < PROFILER_LATENCY; ++i)
+      releaseQueries(frames[i]);
+    if (!freeQueries.empty())
+      gl.DeleteQueries(freeQueries.size(), &freeQueries[0]);
+    if (trace)
+      fclose(trace);
+    delete overlay;
+  }
+
+  /* Charges the time since the last call to the innermost section */
+  void charge()
+  {
+    const uint64_t now = SDL_GetPerformanceCounter();
+    if (depth > 0)
+      frames[current].cpu[stack[depth-1]] += (now - lastTick) * 1000.0 / tickFreq;
+    lastTick = now;
+  }
+
+  /* Timer queries can't nest, so each change of the innermost
+   * section ends the running query and starts a new one */
+  void switchQuery()
+  {
+    if (!gpu) return;
+    if (queryOpen) {
+      gl.EndQuery(GL_TIME_ELAPSED);
+      queryOpen = false;
+    }
+    FrameRecord &frame = frames[current];
+    if (depth == 0 || !frame.gpuComplete) return;
+    if (frame.segments.size() >= PROFILER_MAX_SEGMENTS) {
+      frame.gpuComplete = false;
+      return;
+    }
+    GLuint query;
+    if (freeQueries.empty()) {
+      gl.GenQueries(1, &query);
+    } else {
+      query = freeQueries.back();
+      freeQueries.pop_back();
+    }
+    gl.BeginQuery(GL_TIME_ELAPSED, query);
+    frame.segments.push_back(QuerySegment(query, stack[depth-1]));
+    queryOpen = true;
+  }
+
+  void releaseQueries(FrameRecord &frame)
+  {
+    for (size_t i = 0; i < frame.segments.size(); ++i)
+      freeQueries.push_back(frame.segments[i].query);
+    frame.segments.clear();
+  }
+
+  /* Queries finish in order, so once the last one of a frame
+   * has its result all others have theirs too */
+  bool gpuResultsReady(const FrameRecord &frame)
+  {
+    if (!gpu || !frame.gpuComplete || frame.segments.empty()) return false;
+    GLint available = 0;
+    gl.GetQueryObjectiv(frame.segments.back().query,
+                        GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) return false;
+    /* Results are garbage if the GPU was reset or
+     * changed its clock in the meantime */
+    GLint disjoint = 0;
+    if (gl.glsles)
+      gl.GetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    return !disjoint;
+  }
+
+  void resolve(FrameRecord &frame)
+  {
+    if (!frame.used) return;
+    FrameSample sample;
+    const bool ready = gpuResultsReady(frame);
+    for (int i = 0; i < Profiler::SectionCount; ++i) {
+      sample.cpu[i] = frame.cpu[i];
+      sample.gpu[i] = ready ? 0 : -1;
+    }
+    for (size_t i = 0; ready && i < frame.segments.size(); ++i) {
+      _GLuint64 ns = 0;
+      gl.GetQueryObjectui64v(frame.segments[i].query, GL_QUERY_RESULT, &ns);
+      sample.gpu[frame.segments[i].section] += ns / 1000000.0;
+    }
+    releaseQueries(frame);
+    frame.used = false;
+    latest = sample;
+    history[historyNext] = sample;
+    historyNext = (historyNext + 1) % OVERLAY_FRAMES;
+    historyCount = std::min(historyCount + 1, OVERLAY_FRAMES);
+    if (trace)
+      writeTrace(frame.number, sample);
+  }
+
+  void startFrame()
+  {
+    FrameRecord &frame = frames[current];
+    frame.used = true;
+    frame.number = ++frameNumber;
+    frame.gpuComplete = true;
+    for (int i = 0; i < Profiler::SectionCount; ++i)
+      frame.cpu[i] = 0;
+  }
+
+  void openTrace(const std::string &path)
+  {
+    trace = fopen(path.c_str(), "w");
+    if (!trace) {
+      Debug() << "Cannot open profiler trace" << path;
+      return;
+    }
+    fprintf(trace, "frame");
+    for (int i = 0; i < Profiler::SectionCount; ++i)
+      fprintf(trace, ",%s_cpu", sectionNames[i]);
+    for (int i = 0; i < Profiler::SectionCount; ++i)
+      fprintf(trace, ",%s_gpu", sectionNames[i]);
+    fprintf(trace, "\n");
+  }
+
+  /* Unavailable GPU times are left empty */
+  void writeTrace(uint64_t number, const FrameSample &sample)
+  {
+    fprintf(trace, "%llu", (unsigned long long) number);
+    for (int i = 0; i < Profiler::SectionCount; ++i)
+      fprintf(trace, ",%.3f", sample.cpu[i]);
+    for (int i = 0; i < Profiler::SectionCount; ++i) {
+      if (sample.gpu[i] < 0)
+        fprintf(trace, ",");
+      else
+        fprintf(trace, ",%.3f", sample.gpu[i]);
+    }
+    fprintf(trace, "\n");
+  }
+};
+
+Profiler::Profiler(bool enabled, const std::string &tracePath)
+{
+  p = new ProfilerPrivate(enabled);
+  if (!enabled) return;
+  if (!tracePath.empty())
+    p->openTrace(tracePath);
+  p->startFrame();
+  push(Script);
+}
+
+Profiler::~Profiler()
+{
+  delete p;
+}
+
+bool Profiler::enabled() const
+{
+  return p->enabled;
+}
+
+void Profiler::push(Section section)
+{
+  if (!p->enabled || p->depth == PROFILER_MAX_DEPTH) return;
+  p->charge();
+  p->stack[p->depth++] = section;
+  p->switchQuery();
+}
+
+void Profiler::pop(Section section)
+{
+  if (!p->enabled || p->depth == 0 || p->stack[p->depth-1] != section)
+    return;
+  p->charge();
+  --p->depth;
+  p->switchQuery();
+}
+
+void Profiler::frameDone()
+{
+  if (!p->enabled) return;
+  p->charge();
+  p->depth = 0;
+  p->switchQuery();
+  /* The slot to be reused holds the oldest pending frame */
+  p->current = (p->current + 1) % PROFILER_LATENCY;
+  p->resolve(p->frames[p->current]);
+  p->startFrame();
+  push(Script);
+}
+
+float Profiler::cpuTime(Section section) const
+{
+  return p->latest.cpu[section];
+}
+
+float Profiler::gpuTime(Section section) const
+{
+  return p->latest.gpu[section];
+}
+
+void Profiler::drawOverlay(const Vec2i &winSize, float budget)
+{
+  if (!p->enabled || p->historyCount == 0) return;
+  if (!p->overlay)
+    p->overlay = new ColorQuadArray;
+  ColorQuadArray &quads = *p->overlay;
+  quads.resize(p->historyCount * SectionCount + 1);
+  Vertex *vert = &quads.vertices[0];
+  const int first = p->historyNext - p->historyCount + OVERLAY_FRAMES;
+  /* The window framebuffer isn't flipped, y grows upwards */
+  for (int i = 0; i < p->historyCount; ++i) {
+    const FrameSample &sample = p->history[(first + i) % OVERLAY_FRAMES];
+    const float x = OVERLAY_MARGIN + i * OVERLAY_BAR_W;
+    float y = OVERLAY_MARGIN;
+    for (int j = 0; j < SectionCount; ++j) {
+      const float h = sample.cpu[j] * OVERLAY_PX_PER_MS;
+      Quad::setPosRect(vert, FloatRect(x, y, OVERLAY_BAR_W - 1, h));
+      Quad::setColor(vert, sectionColors[j]);
+      vert += 4;
+      y += h;
+    }
+  }
+  Quad::setPosRect(vert, FloatRect(OVERLAY_MARGIN, OVERLAY_MARGIN + budget * OVERLAY_PX_PER_MS,
+                                   OVERLAY_FRAMES * OVERLAY_BAR_W, 1));
+  Quad::setColor(vert, Vec4(1, 1, 1, 0.8f));
+  quads.commit();
+  FBO::unbind();
+  glState.viewport.pushSet(IntRect(0, 0, winSize.x, winSize.y));
+  glState.scissorTest.pushSet(false);
+  glState.blend.pushSet(true);
+  glState.blendMode.pushSet(BlendNormal);
+  SimpleColorShader &shader = shState->shaders().simpleColor;
+  shader.bind();
+  shader.applyViewportProj();
+  shader.setTranslation(Vec2i());
+  quads.draw();
+  glState.blendMode.pop();
+  glState.blend.pop();
+  glState.scissorTest.pop();
+  glState.viewport.pop();
+}
+
+const char *Profiler::sectionName(Section section)
+{
+  return sectionNames[section];
+}
@@ -0,0 +1,60 @@
+/*
+** profiler.h
+**
+** This file is part of HiddenChest
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "etc-internal.h"
+#include <string>
+
+struct ProfilerPrivate;
+
+/* Splits up every frame's time by the subsystem spending it.
+ * Sections nest, time always goes to the innermost open one,
+ * so a frame's sections add up to its whole duration.
+ * GPU times come from timer queries read back a few frames
+ * later, so all results lag behind by that many frames */
+class Profiler
+{
+public:
+  enum Section
+  {
+    /* Ruby code running between Graphics.update calls */
+    Script,
+    /* prepareDraw handlers, ie. tilemap and window rebuilds */
+    Prepare,
+    Composite,
+    /* Viewport tone, color and flash and screen brightness */
+    Effects,
+    /* Frame limiter waiting for the next frame to be due */
+    Idle,
+    /* Final blit to the window and buffer swap */
+    Swap,
+    SectionCount
+  };
+
+  Profiler(bool enabled, const std::string &tracePath);
+  ~Profiler();
+  bool enabled() const;
+  void push(Section section);
+  /* Does nothing unless 'section' is the innermost open one */
+  void pop(Section section);
+  /* Closes the current frame and starts timing scripts */
+  void frameDone();
+  /* Milliseconds spent in the latest complete frame,
+   * GPU times are negative when unavailable */
+  float cpuTime(Section section) const;
+  float gpuTime(Section section) const;
+  /* Stacked CPU time bars of the latest frames in the lower
+   * left corner of the window, 'budget' ms marked by a line */
+  void drawOverlay(const Vec2i &winSize, float budget);
+  static const char *sectionName(Section section);
+
+private:
+  ProfilerPrivate *p;
+};
+
+#endif // PROFILER_H
@@ -26,6 +26,7 @@
 #include "gl-util.h"
 #include "gl-meta.h"
 #include "sharedstate.h"
+#include "glstate.h"
 #include "global-ibo.h"
 #include "shader.h"
 
@@ -127,6 +128,7 @@ struct Quad
       vboDirty = false;
     }
     GLMeta::vaoBind(vao);
+    ++glState.drawCalls;
     gl.DrawElements(GL_TRIANGLES, 6, _GL_INDEX_TYPE, 0);
     GLMeta::vaoUnbind(vao);
   }
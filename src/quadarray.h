@@ -26,6 +26,7 @@
 #include "gl-util.h"
 #include "gl-meta.h"
 #include "sharedstate.h"
+#include "glstate.h"
 #include "global-ibo.h"
 #include "shader.h"
 #include <vector>
@@ -83,10 +84,27 @@ struct QuadArray
     VBO::unbind();
   }
 
+  /* Like commit(), for arrays refilled several times a frame.
+   * Orphans the VBO storage first, so the upload doesn't have
+   * to wait for draws still reading the previous contents */
+  void commitStream()
+  {
+    VBO::bind(vbo);
+    GLsizeiptr size = vertices.size() * sizeof(VertexType);
+    if (size > vboSize) {
+      vboSize = size;
+      shState->ensureQuadIBO(quadCount);
+    }
+    VBO::allocEmpty(vboSize, GL_STREAM_DRAW);
+    VBO::uploadSubData(0, size, dataPtr(vertices));
+    VBO::unbind();
+  }
+
   void draw(size_t offset, size_t count)
   {
     GLMeta::vaoBind(vao);
     const char *_offset = (const char*) 0 + offset * 6 * sizeof(index_t);
+    ++glState.drawCalls;
     gl.DrawElements(GL_TRIANGLES, count * 6, _GL_INDEX_TYPE, _offset);
     GLMeta::vaoUnbind(vao);
   }
@@ -21,6 +21,11 @@
 
 #include "rgssad.h"
 #include "boost-hash.h"
+#include "rgssadmagic.h"
+#include "sdl-util.h"
+#include <SDL_cpuinfo.h>
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -31,16 +36,20 @@ struct RGSS_entryData
   uint32_t startMagic;
 };
 
+class DecryptPool;
+
 struct RGSS_entryHandle
 {
   const RGSS_entryData data;
   uint32_t currentMagic;
   uint64_t currentOffset;
   PHYSFS_Io *io;
-  RGSS_entryHandle(const RGSS_entryData &data, PHYSFS_Io *archIo)
+  DecryptPool *pool;
+  RGSS_entryHandle(const RGSS_entryData &data, PHYSFS_Io *archIo, DecryptPool *pool)
       : data(data),
         currentMagic(data.startMagic),
-        currentOffset(0)
+        currentOffset(0),
+        pool(pool)
   {
     io = archIo->duplicate(archIo);
   }
@@ -59,6 +68,7 @@ struct RGSS_archiveData
   /* Maps: directory path,
    * to:   list of contained entries */
   BoostHash<std::string, BoostSet<std::string> > dirHash;
+  DecryptPool *decryptPool;
 };
 
 static bool
@@ -81,13 +91,130 @@ readUint32(PHYSFS_Io *io, uint32_t &result)
 
 #define IO_READ(io, dest, size) (io->read(io, dest, size) == size)
 
-static inline uint32_t
-advanceMagic(uint32_t &magic)
+/* Reads of at least this many bytes get their
+ * decryption split across worker threads */
+#define DECRYPT_SPLIT_SIZE (1 << 20)
+#define DECRYPT_THREADS_MAX 4
+
+struct DecryptJob
 {
-  uint32_t old = magic;
-  magic = magic * 7 + 3;
-  return old;
-}
+  uint32_t *dwords;
+  uint64_t count;
+  uint32_t magic;
+};
+
+/* Worker threads shared by all entries of an archive. They are
+ * started on the first big read and then wait for the next one,
+ * as spawning threads for every read costs about as much as
+ * the split saves on reads of a few MB */
+class DecryptPool
+{
+public:
+  DecryptPool()
+  : workerCount(0),
+    jobCount(0),
+    nextJob(0),
+    pending(0),
+    termReq(false)
+  {
+    mut = SDL_CreateMutex();
+    batchMut = SDL_CreateMutex();
+    workCond = SDL_CreateCond();
+    doneCond = SDL_CreateCond();
+  }
+
+  ~DecryptPool()
+  {
+    SDL_LockMutex(mut);
+    termReq = true;
+    SDL_CondBroadcast(workCond);
+    SDL_UnlockMutex(mut);
+    for (int i = 0; i < workerCount; ++i)
+      SDL_WaitThread(workers[i], 0);
+    SDL_DestroyCond(doneCond);
+    SDL_DestroyCond(workCond);
+    SDL_DestroyMutex(batchMut);
+    SDL_DestroyMutex(mut);
+  }
+
+  /* Xors 'count' dwords, splitting big batches into chunks
+   * decrypted in parallel; every chunk jumps the magic
+   * straight to its first dword */
+  void decrypt(uint32_t *dwords, uint64_t count, uint32_t &magic)
+  {
+    int chunks = std::min<uint64_t>(count * 4 / DECRYPT_SPLIT_SIZE + 1,
+                                    std::min(SDL_GetCPUCount(), DECRYPT_THREADS_MAX));
+    /* Another entry being read in parallel has the workers busy */
+    if (chunks < 2 || SDL_TryLockMutex(batchMut) != 0) {
+      magic = xorMagic(dwords, count, magic);
+      return;
+    }
+    startWorkers(chunks - 1);
+    chunks = std::min(chunks, workerCount + 1);
+    SDL_LockMutex(mut);
+    for (int i = 0; i < chunks; ++i) {
+      uint64_t start = count * i / chunks;
+      jobs[i].dwords = dwords + start;
+      jobs[i].count = count * (i+1) / chunks - start;
+      jobs[i].magic = jumpMagic(magic, start);
+    }
+    /* The calling thread takes on the first chunk itself */
+    jobCount = chunks;
+    nextJob = 1;
+    pending = chunks - 1;
+    SDL_CondBroadcast(workCond);
+    SDL_UnlockMutex(mut);
+    xorMagic(jobs[0].dwords, jobs[0].count, jobs[0].magic);
+    SDL_LockMutex(mut);
+    while (pending > 0)
+      SDL_CondWait(doneCond, mut);
+    jobCount = 0;
+    SDL_UnlockMutex(mut);
+    SDL_UnlockMutex(batchMut);
+    magic = jumpMagic(magic, count);
+  }
+
+private:
+  /* Only called with batchMut held */
+  void startWorkers(int count)
+  {
+    while (workerCount < count) {
+      SDL_Thread *thread = createSDLThread<DecryptPool, &DecryptPool::work>(this, "rgssad");
+      if (!thread) break;
+      workers[workerCount++] = thread;
+    }
+  }
+
+  void work()
+  {
+    SDL_LockMutex(mut);
+    while (true) {
+      while (!termReq && nextJob >= jobCount)
+        SDL_CondWait(workCond, mut);
+      if (termReq) break;
+      const DecryptJob job = jobs[nextJob++];
+      SDL_UnlockMutex(mut);
+      xorMagic(job.dwords, job.count, job.magic);
+      SDL_LockMutex(mut);
+      if (--pending == 0)
+        SDL_CondSignal(doneCond);
+    }
+    SDL_UnlockMutex(mut);
+  }
+
+  SDL_Thread *workers[DECRYPT_THREADS_MAX - 1];
+  int workerCount;
+  DecryptJob jobs[DECRYPT_THREADS_MAX];
+  int jobCount;
+  int nextJob;
+  int pending;
+  bool termReq;
+  /* Guards the jobs, held by one batch at a time */
+  SDL_mutex *batchMut;
+  SDL_mutex *mut;
+  SDL_cond *workCond;
+  SDL_cond *doneCond;
+};
 
 static PHYSFS_sint64
 RGSS_ioRead(PHYSFS_Io *self, void *buffer, PHYSFS_uint64 len)
@@ -164,8 +291,7 @@ RGSS_ioRead(PHYSFS_Io *self, void *buffer, PHYSFS_uint64 len)
 		io->read(io, bBufferP, align);
 
 		/* Then xor them */
-		for (uint64_t i = 0; i < (align / 4); ++i)
-			dwBufferP[i] ^= advanceMagic(entry->currentMagic);
+		entry->pool->decrypt(dwBufferP, align / 4, entry->currentMagic);
 
 		bBufferP += align;
 	}
@@ -208,8 +334,7 @@ RGSS_ioSeek(PHYSFS_Io *self, PHYSFS_uint64 offset)
 	uint64_t targetDword  = offset / 4;
 	uint64_t dwordsSought = targetDword - currentDword;
 
-	for (uint64_t i = 0; i < dwordsSought; ++i)
-		advanceMagic(entry->currentMagic);
+	entry->currentMagic = jumpMagic(entry->currentMagic, dwordsSought);
 
 	entry->currentOffset = offset;
 	entry->io->seek(entry->io, entry->data.offset + entry->currentOffset);
@@ -381,6 +506,8 @@ RGSS_openArchive(PHYSFS_Io *io, const char *, int forWrite, int *claimed)
 		io->seek(io, entry.offset + entry.size);
 	}
 
+	data->decryptPool = new DecryptPool;
+
 	return data;
 }
 
@@ -414,7 +541,8 @@ RGSS_openRead(void *opaque, const char *filename)
 		return 0;
 
 	RGSS_entryHandle *entry =
-	        new RGSS_entryHandle(data->entryHash[filename], data->archiveIo);
+	        new RGSS_entryHandle(data->entryHash[filename], data->archiveIo,
+	                         data->decryptPool);
 
 	PHYSFS_Io *io = PHYSFS_ALLOC(PHYSFS_Io);
 
@@ -464,6 +592,7 @@ RGSS_closeArchive(void *opaque)
 {
 	RGSS_archiveData *data = static_cast<RGSS_archiveData*>(opaque);
 
+	delete data->decryptPool;
 	delete data;
 }
 
@@ -607,6 +736,8 @@ RGSS3_openArchive(PHYSFS_Io *io, const char *, int forWrite, int *claimed)
 		return NULL;
 	}
 
+	data->decryptPool = new DecryptPool;
+
 	return data;
 }
 
@@ -0,0 +1,68 @@
+/*
+** rgssadmagic.h
+**
+** This file is part of HiddenChest
+*/
+
+#ifndef RGSSADMAGIC_H
+#define RGSSADMAGIC_H
+
+#include <stdint.h>
+
+/* The xor key chain RGSSAD archives are encrypted with */
+
+static inline uint32_t
+advanceMagic(uint32_t &magic)
+{
+  uint32_t old = magic;
+  magic = magic * 7 + 3;
+  return old;
+}
+
+/* Advancing the magic is the affine map m -> 7m + 3, so
+ * advancing it n times is an affine map as well, which
+ * we build by repeated squaring in O(log n) */
+static inline uint32_t
+jumpMagic(uint32_t magic, uint64_t steps)
+{
+  /* Map for all steps so far, and for the current bit */
+  uint32_t a = 1, b = 0;
+  uint32_t bitA = 7, bitB = 3;
+  while (steps > 0) {
+    if (steps & 1) {
+      a = bitA * a;
+      b = bitA * b + bitB;
+    }
+    bitB = bitA * bitB + bitB;
+    bitA = bitA * bitA;
+    steps >>= 1;
+  }
+  return a * magic + b;
+}
+
+/* Xors 'count' dwords with the magic chain starting at 'magic'
+ * and returns the magic following them. The chain is run as
+ * four independent ones (each step being m -> 7^4 m + 1200),
+ * which the compiler can keep in a single vector register */
+static inline uint32_t
+xorMagic(uint32_t *dwords, uint64_t count, uint32_t magic)
+{
+  uint64_t i = 0;
+  if (count >= 8) {
+    uint32_t lane[4];
+    for (int k = 0; k < 4; ++k)
+      lane[k] = advanceMagic(magic);
+    for (; i + 4 <= count; i += 4) {
+      for (int k = 0; k < 4; ++k) {
+        dwords[i+k] ^= lane[k];
+        lane[k] = lane[k] * 2401 + 1200;
+      }
+    }
+    magic = lane[0];
+  }
+  for (; i < count; ++i)
+    dwords[i] ^= advanceMagic(magic);
+  return magic;
+}
+
+#endif // RGSSADMAGIC_H
@@ -21,6 +21,13 @@
 
 #include "scene.h"
 #include "sharedstate.h"
+#include "spritebatch.h"
+#include "graphics.h"
+#include "config.h"
+#include <algorithm>
+
+/* Scenes holding elements that wait for the sort pass */
+static std::vector<Scene*> unsortedScenes;
 
 Scene::Scene()
 {}
@@ -28,42 +35,115 @@ Scene::Scene()
 Scene::~Scene()
 {// Ensure elements don't unlink from a destructed Scene
   IntruListLink<SceneElement> *iter;
-  for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
+  for (iter = elements.begin(); iter != elements.end(); iter = iter->next) {
     iter->data->scene = 0;
+    iter->data->sortPending = false;
+  }
+  if (!pending.empty())
+    unsortedScenes.erase(std::find(unsortedScenes.begin(), unsortedScenes.end(), this));
+}
+
+void Scene::sortAll()
+{
+  while (!unsortedScenes.empty())
+    unsortedScenes.back()->sortPending();
+}
+
+bool Scene::ElementOrder::operator()(const SceneElement *a, const SceneElement *b) const
+{
+  return *a < *b;
 }
 
 void Scene::insert(SceneElement &element)
 {
-  IntruListLink<SceneElement> *iter;
-  for (iter = elements.begin(); iter != elements.end(); iter = iter->next) {
-    SceneElement *e = iter->data;
-    if (element < *e) {
-      elements.insertBefore(element.link, *iter);
-      return;
-    }
-  }
-  elements.append(element.link);
+  linkAt(element, index.insert(&element));
+  Graphics::markDirty();
 }
 
 void Scene::insertAfter(SceneElement &element, SceneElement &after)
 {
-  IntruListLink<SceneElement> *iter;
-  for (iter = &after.link; iter != elements.end(); iter = iter->next) {
-    SceneElement *e = iter->data;
-    if (element < *e) {
-      elements.insertBefore(element.link, *iter);
-      return;
-    }
+  if (after.sortPending) {
+    insert(element);
+    return;
   }
-  elements.append(element.link);
+  /* The final spot usually follows 'after' right away */
+  ElementIndex::iterator hint = after.indexPos;
+  linkAt(element, index.insert(++hint, &element));
+}
+
+/* Whether 'element' still lies between its neighbours in the index */
+bool Scene::inPlace(SceneElement &element)
+{
+  ElementIndex::iterator pos = element.indexPos;
+  ElementIndex::iterator next = pos;
+  ++next;
+  bool afterPrev = pos == index.begin() || !(element < **--pos);
+  bool beforeNext = next == index.end() || element < **next;
+  return afterPrev && beforeNext;
 }
 
 void Scene::reinsert(SceneElement &element)
 {
-  elements.remove(element.link);
+  if (element.link.next && !element.sortPending) {
+    /* Nothing to do if the neighbours still enclose it */
+    if (inPlace(element)) return;
+  }
+  remove(element);
   insert(element);
 }
 
+void Scene::reorder(SceneElement &element)
+{
+  Graphics::markDirty();
+  if (!shState->config().deferZSort || !element.link.next) {
+    reinsert(element);
+    return;
+  }
+  if (element.sortPending || inPlace(element)) return;
+  /* Keep drawing it at its old spot until the sort pass */
+  index.erase(element.indexPos);
+  element.sortPending = true;
+  if (pending.empty()) unsortedScenes.push_back(this);
+  pending.push_back(&element);
+}
+
+void Scene::sortPending()
+{
+  if (pending.empty()) return;
+  unsortedScenes.erase(std::find(unsortedScenes.begin(), unsortedScenes.end(), this));
+  for (size_t i = 0; i < pending.size(); ++i) {
+    SceneElement &element = *pending[i];
+    element.sortPending = false;
+    elements.remove(element.link);
+    insert(element);
+  }
+  pending.clear();
+}
+
+void Scene::remove(SceneElement &element)
+{
+  if (!element.link.next) return;
+  Graphics::markDirty();
+  if (element.sortPending) {
+    pending.erase(std::find(pending.begin(), pending.end(), &element));
+    element.sortPending = false;
+    if (pending.empty())
+      unsortedScenes.erase(std::find(unsortedScenes.begin(), unsortedScenes.end(), this));
+  } else {
+    index.erase(element.indexPos);
+  }
+  elements.remove(element.link);
+}
+
+void Scene::linkAt(SceneElement &element, ElementIndex::iterator pos)
+{/* Mirror the index position in the list */
+  element.indexPos = pos;
+  if (++pos == index.end())
+    elements.append(element.link);
+  else
+    elements.insertBefore(element.link, (*pos)->link);
+}
+
 void Scene::notifyGeometryChange()
 {
   IntruListLink<SceneElement> *iter;
@@ -73,16 +153,23 @@ void Scene::notifyGeometryChange()
 
 void Scene::composite()
 {
+  sortPending();// Catch changes made while preparing the frame
+  SpriteBatch &batch = shState->spriteBatch();
   IntruListLink<SceneElement> *iter;
   for (iter = elements.begin(); iter != elements.end(); iter = iter->next) {
     SceneElement *e = iter->data;
-    if (e->visible) e->draw();
+    if (!e->visible) continue;
+    if (batch.enabled() && e->drawBatched(batch)) continue;
+    batch.flush();
+    e->draw();
   }
+  batch.flush();
 }
 
 
 SceneElement::SceneElement(Scene &scene, int z, int spriteY)
 : link(this),
+  sortPending(false),
   creationStamp(shState->genTimeStamp()),
   z(z),
   visible(true),
@@ -116,7 +203,7 @@ void SceneElement::setZ(int value)
   aboutToAccess();
   if (z == value) return;
   z = value;
-  scene->reinsert(*this);
+  scene->reorder(*this);
 }
 
 bool SceneElement::getVisible() const
@@ -128,7 +215,9 @@ bool SceneElement::getVisible() const
 void SceneElement::setVisible(bool value)
 {
   aboutToAccess();
+  if (visible == value) return;
   visible = value;
+  Graphics::markDirty();
 }
 
 bool SceneElement::operator<(const SceneElement &o) const
@@ -152,10 +241,10 @@ bool SceneElement::operator<(const SceneElement &o) const
 void SceneElement::setSpriteY(int value)
 {
   spriteY = value;
-  scene->reinsert(*this);
+  scene->reorder(*this);
 }
 
 void SceneElement::unlink()
 {
-  if (scene) scene->elements.remove(link);
+  if (scene) scene->remove(*this);
 }
@@ -27,7 +27,11 @@
 #include "etc.h"
 #include "etc-internal.h"
 
+#include <set>
+#include <vector>
+
 class SceneElement;
+class SpriteBatch;
 class Viewport;
 class WindowVX;
 class Window;
@@ -56,13 +60,36 @@ public:
                                      const Vec4& /* flash */,
                                      const Vec4& /* tone */) {}
   const Geometry &getGeometry() const { return geometry; }
+  /* Puts the elements of every scene whose order changed
+   * since the last call in their place */
+  static void sortAll();
 
 protected:
+  /* Same order as SceneElement::operator< */
+  struct ElementOrder
+  {
+    bool operator()(const SceneElement *a, const SceneElement *b) const;
+  };
+  typedef std::multiset<SceneElement*, ElementOrder> ElementIndex;
   void insert(SceneElement &element);
+  /* 'element' is expected to be placed somewhere after 'after' */
   void insertAfter(SceneElement &element, SceneElement &after);
   void reinsert(SceneElement &element);
+  /* Like reinsert, but may wait for the next sort pass */
+  void reorder(SceneElement &element);
+  bool inPlace(SceneElement &element);
+  void sortPending();
+  void remove(SceneElement &element);
+  /* Links 'element' into the list where 'pos' has it in the index */
+  void linkAt(SceneElement &element, ElementIndex::iterator pos);
   void notifyGeometryChange();
   IntruList<SceneElement> elements;
+  /* Balanced tree holding the same elements in the same order,
+   * so finding a spot doesn't take a walk through the list */
+  ElementIndex index;
+  /* Elements waiting for the sort pass, linked but left
+   * out of the index until then */
+  std::vector<SceneElement*> pending;
   Geometry geometry;
   friend class SceneElement;
   friend class Window;
@@ -100,6 +127,9 @@ protected:
    * will fire immediately before each frame draw.
    */
   virtual void draw() = 0;
+  /* Queues the element in 'batch' in place of drawing it
+   * right away; false if it has to go through 'draw()' */
+  virtual bool drawBatched(SpriteBatch &) { return false; }
   // FIXME: This should be a signal
   virtual void onGeometryChange(const Scene::Geometry &) {}
   /* Compares two elements in terms of their display priority;
@@ -108,6 +138,10 @@ protected:
   void setSpriteY(int value);
   void unlink();
   IntruListLink<SceneElement> link;
+  /* Position inside of the scene's index while linked */
+  Scene::ElementIndex::iterator indexPos;
+  /* Waiting in the scene's 'pending' list */
+  bool sortPending;
   const unsigned int creationStamp;
   int z;
   bool visible;
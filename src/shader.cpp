@@ -28,6 +28,7 @@
 #include <iostream>
 #include "common.h.xxd"
 #include "sprite.frag.xxd"
+#include "spriteBatch.frag.xxd"
 #include "hue.frag.xxd"
 #include "trans.frag.xxd"
 #include "transSimple.frag.xxd"
@@ -37,6 +38,8 @@
 #include "basic_color.frag.xxd"
 #include "sepia.frag.xxd"
 #include "pixel.frag.xxd"
+#include "invert.frag.xxd"
+#include "colorMatrix.frag.xxd"
 #include "tex_comb.frag.xxd"
 //#include "oil.frag.xxd"
 #include "flatColor.frag.xxd"
@@ -44,19 +47,20 @@
 #include "simpleColor.frag.xxd"
 #include "simpleAlpha.frag.xxd"
 #include "simpleAlphaUni.frag.xxd"
+#include "glyph.frag.xxd"
 #include "flashMap.frag.xxd"
 #include "minimal.vert.xxd"
 #include "simple.vert.xxd"
 #include "simpleColor.vert.xxd"
-#include "invert.vert.xxd"
 #include "sprite.vert.xxd"
+#include "spriteBatch.vert.xxd"
+#include "spriteWave.vert.xxd"
 #include "tilemap.vert.xxd"
 #include "blur.frag.xxd"
 #include "simpleMatrix.vert.xxd"
 #include "blurH.vert.xxd"
 #include "blurV.vert.xxd"
 #include "tilemapvx.vert.xxd"
-#include "tex.vert.xxd"
 #include "tex_comb.vert.xxd"
 
 #define INIT_SHADER(vert, frag, name) \
@@ -168,6 +172,9 @@ void Shader::init(const unsigned char *vert, int vertSize,
   gl.BindAttribLocation(program, Position, "position");
   gl.BindAttribLocation(program, TexCoord, "texCoord");
   gl.BindAttribLocation(program, Color, "color");
+  gl.BindAttribLocation(program, Tone, "tone");
+  gl.BindAttribLocation(program, Effect, "effect");
+  gl.BindAttribLocation(program, WaveY, "waveY");
   gl.LinkProgram(program);
   gl.GetProgramiv(program, GL_LINK_STATUS, &success);
   if (!success) {
@@ -278,6 +285,12 @@ SimpleAlphaShader::SimpleAlphaShader()
   ShaderBase::init();
 }
 
+GlyphShader::GlyphShader()
+{
+  INIT_SHADER(simpleColor, glyph, GlyphShader);
+  ShaderBase::init();
+}
+
 SimpleSpriteShader::SimpleSpriteShader()
 {
   INIT_SHADER(sprite, simple, SimpleSpriteShader);
@@ -315,6 +328,7 @@ TransShader::TransShader()
   GET_U(currentScene);
   GET_U(frozenScene);
   GET_U(transMap);
+  GET_U(transMapScale);
   GET_U(prog);
   GET_U(vague);
 }
@@ -334,6 +348,11 @@ void TransShader::setTransMap(TEX::ID tex)
   setTexUniform(u_transMap, 3, tex);
 }
 
+void TransShader::setTransMapScale(const Vec2 &value)
+{
+  gl.Uniform2f(u_transMapScale, value.x, value.y);
+}
+
 void TransShader::setProg(float value)
 {
   gl.Uniform1f(u_prog, value);
@@ -371,6 +390,11 @@ void SimpleTransShader::setProg(float value)
 SpriteShader::SpriteShader()
 {
   INIT_SHADER(sprite, sprite, SpriteShader);
+  initUniforms();
+}
+
+void SpriteShader::initUniforms()
+{
   ShaderBase::init();
   GET_U(spriteMat);
   GET_U(tone);
@@ -410,6 +434,28 @@ void SpriteShader::setBushOpacity(float value)
   gl.Uniform1f(u_bushOpacity, value);
 }
 
+SpriteWaveShader::SpriteWaveShader() : SpriteShader(Variant())
+{
+  INIT_SHADER(spriteWave, sprite, SpriteWaveShader);
+  initUniforms();
+  GET_U(waveAmp);
+  GET_U(waveLength);
+  GET_U(wavePhase);
+}
+
+void SpriteWaveShader::setWave(float amp, float length, float phase)
+{
+  gl.Uniform1f(u_waveAmp, amp);
+  gl.Uniform1f(u_waveLength, length);
+  gl.Uniform1f(u_wavePhase, phase);
+}
+
+SpriteBatchShader::SpriteBatchShader()
+{
+  INIT_SHADER(spriteBatch, spriteBatch, SpriteBatchShader);
+  ShaderBase::init();
+}
+
 PlaneShader::PlaneShader()
 {
   INIT_SHADER(simple, plane, PlaneShader);
@@ -467,10 +513,40 @@ BasicColorShader::BasicColorShader()
   GET_U(blue);
 }
 
+ColorMatrixShader::ColorMatrixShader()
+{
+  INIT_SHADER(simple, colorMatrix, ColorMatrixShader);
+  ShaderBase::init();
+  GET_U(colorMat);
+}
+
+void ColorMatrixShader::setColorMatrix(const float value[16])
+{
+  gl.UniformMatrix4fv(u_colorMat, 1, GL_FALSE, value);
+}
+
+InvertShader::InvertShader()
+{
+  INIT_SHADER(simple, invert, InvertShader);
+  ShaderBase::init();
+}
+
 PixelateShader::PixelateShader()
 {
-  INIT_SHADER(tex, pixel, PixelateShader);
+  INIT_SHADER(simple, pixel, PixelateShader);
   ShaderBase::init();
+  GET_U(blockSize);
+  GET_U(limit);
+}
+
+void PixelateShader::setBlockSize(const Vec2 &value)
+{
+  gl.Uniform2f(u_blockSize, value.x, value.y);
+}
+
+void PixelateShader::setLimit(const Vec2 &value)
+{
+  gl.Uniform2f(u_limit, value.x, value.y);
 }
 
 TexCombShader::TexCombShader()
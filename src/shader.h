@@ -36,7 +36,10 @@ public:
   {
     Position = 0,
     TexCoord = 1,
-    Color = 2
+    Color = 2,
+    Tone = 3,
+    Effect = 4,
+    WaveY = 5
   };
 
 protected:
@@ -113,6 +116,12 @@ public:
   SimpleAlphaShader();
 };
 
+class GlyphShader : public ShaderBase
+{
+public:
+  GlyphShader();
+};
+
 class SimpleSpriteShader : public ShaderBase
 {
 public:
@@ -141,11 +150,12 @@ public:
   void setCurrentScene(TEX::ID tex);
   void setFrozenScene(TEX::ID tex);
   void setTransMap(TEX::ID tex);
+  void setTransMapScale(const Vec2 &value);
   void setProg(float value);
   void setVague(float value);
 
 private:
-  GLint u_currentScene, u_frozenScene, u_transMap, u_prog, u_vague;
+  GLint u_currentScene, u_frozenScene, u_transMap, u_transMapScale, u_prog, u_vague;
 };
 
 class SimpleTransShader : public ShaderBase
@@ -171,10 +181,35 @@ public:
   void setBushDepth(float value);
   void setBushOpacity(float value);
 
+protected:
+  /* Lets variants link their own program */
+  struct Variant {};
+  SpriteShader(Variant) {}
+  void initUniforms();
+
 private:
   GLint u_spriteMat, u_tone, u_opacity, u_color, u_bushDepth, u_bushOpacity;
 };
 
+/* SpriteShader swaying 8 pixel chunks sideways, for
+ * the wave effect; 'phase' is given in radians */
+class SpriteWaveShader : public SpriteShader
+{
+public:
+  SpriteWaveShader();
+  void setWave(float amp, float length, float phase);
+
+private:
+  GLint u_waveAmp, u_waveLength, u_wavePhase;
+};
+
+/* SpriteShader taking its parameters per vertex */
+class SpriteBatchShader : public ShaderBase
+{
+public:
+  SpriteBatchShader();
+};
+
 class PlaneShader : public ShaderBase
 {
 public:
@@ -214,10 +249,31 @@ private:
   GLint u_red, u_green, u_blue;
 };
 
+class ColorMatrixShader : public ShaderBase
+{
+public:
+  ColorMatrixShader();
+  void setColorMatrix(const float value[16]);
+
+private:
+  GLint u_colorMat;
+};
+
+class InvertShader : public ShaderBase
+{
+public:
+  InvertShader();
+};
+
 class PixelateShader : public ShaderBase
 {
 public:
   PixelateShader();
+  void setBlockSize(const Vec2 &value);
+  void setLimit(const Vec2 &value);
+
+private:
+  GLint u_blockSize, u_limit;
 };
 
 class TexCombShader : public ShaderBase
@@ -331,14 +387,19 @@ struct ShaderSet
   SimpleShader simple;
   SimpleColorShader simpleColor;
   SimpleAlphaShader simpleAlpha;
+  GlyphShader glyph;
   SimpleSpriteShader simpleSprite;
   AlphaSpriteShader alphaSprite;
   SpriteShader sprite;
+  SpriteWaveShader spriteWave;
+  SpriteBatchShader spriteBatch;
   PlaneShader plane;
   GrayShader gray;
   SepiaShader sepia;
   BasicColorShader basic_color;
   PixelateShader pixel;
+  InvertShader invert;
+  ColorMatrixShader colorMatrix;
   TexCombShader tex_comb;
   //OilShader oil;
   TilemapShader tilemap;
@@ -25,6 +25,7 @@
 #include "config.h"
 #include "debugwriter.h"
 #include "fluid-fun.h"
+#include "midirender.h"
 
 #include <assert.h>
 #include <vector>
@@ -46,13 +47,26 @@ struct SharedMidiState
 	const std::string &soundFont;
 	fluid_settings_t *flSettings;
 
+	/* Only set up if pre-rendering is enabled */
+	MidiRenderCache *renderCache;
+
+	/* Synths are also allocated by the render worker */
+	SDL_mutex *synthMut;
+
 	SharedMidiState(const Config &conf)
 	    : inited(false),
-	      soundFont(conf.midi.soundFont)
-	{}
+	      soundFont(conf.midi.soundFont),
+	      renderCache(0)
+	{
+		synthMut = SDL_CreateMutex();
+	}
 
 	~SharedMidiState()
 	{
+		/* Stops the render worker, which might hold a synth */
+		delete renderCache;
+		SDL_DestroyMutex(synthMut);
+
 		/* We might have initialized, but if the consecutive libfluidsynth
 		 * load failed, no resources will have been allocated */
 		if (!inited || !HAVE_FLUID)
@@ -87,6 +101,9 @@ struct SharedMidiState
 
 		for (size_t i = 0; i < SYNTH_INIT_COUNT; ++i)
 			addSynth(false);
+
+		if (conf.midi.prerender)
+			renderCache = new MidiRenderCache(conf.midi.prerenderCache * 1024u * 1024u);
 	}
 
 	fluid_synth_t *allocateSynth()
@@ -94,28 +111,36 @@ struct SharedMidiState
 		assert(HAVE_FLUID);
 		assert(inited);
 
+		SDL_LockMutex(synthMut);
+
 		size_t i;
 
 		for (i = 0; i < synths.size(); ++i)
 			if (!synths[i].inUse)
 				break;
 
+		fluid_synth_t *syn;
+
 		if (i < synths.size())
 		{
-			fluid_synth_t *syn = synths[i].synth;
+			syn = synths[i].synth;
 			fluid.synth_system_reset(syn);
 			synths[i].inUse = true;
-
-			return syn;
 		}
 		else
 		{
-			return addSynth(true);
+			syn = addSynth(true);
 		}
+
+		SDL_UnlockMutex(synthMut);
+
+		return syn;
 	}
 
 	void releaseSynth(fluid_synth_t *synth)
 	{
+		SDL_LockMutex(synthMut);
+
 		size_t i;
 
 		for (i = 0; i < synths.size(); ++i)
@@ -125,6 +150,8 @@ struct SharedMidiState
 		assert(i < synths.size());
 
 		synths[i].inUse = false;
+
+		SDL_UnlockMutex(synthMut);
 	}
 
 private:
@@ -28,6 +28,10 @@
 #include "glstate.h"
 #include "shader.h"
 #include "texpool.h"
+#include "glyphatlas.h"
+#include "bitmapatlas.h"
+#include "spritebatch.h"
+#include "textcache.h"
 #include "font.h"
 #include "eventthread.h"
 #include "gl-util.h"
@@ -74,6 +78,10 @@ struct SharedStatePrivate
   GLState _glState;
   ShaderSet shaders;
   TexPool texPool;
+  GlyphAtlas glyphAtlas;
+  BitmapAtlas bitmapAtlas;
+  SpriteBatch spriteBatch;
+  TextCache textCache;
   SharedFontState fontState;
   Font *defaultFont;
   TEX::ID globalTex;
@@ -95,6 +103,11 @@ struct SharedStatePrivate
         input(*threadData),
         audio(*threadData),
         _glState(threadData->config),
+        texPool(std::max(threadData->config.texPoolSize, 0) * 1000000u),
+        bitmapAtlas(threadData->config.bitmapAtlas ?
+                    threadData->config.bitmapAtlasMaxSize : 0),
+        spriteBatch(threadData->config.spriteBatching),
+        textCache(threadData->config.textCacheSize),
         fontState(threadData->config),
         stampCounter(0)
   { // Shaders have been compiled in ShaderSet's constructor
@@ -242,6 +255,26 @@ TexPool& SharedState::texPool() const
   return p->texPool;
 }
 
+GlyphAtlas& SharedState::glyphAtlas() const
+{
+  return p->glyphAtlas;
+}
+
+BitmapAtlas& SharedState::bitmapAtlas() const
+{
+  return p->bitmapAtlas;
+}
+
+SpriteBatch& SharedState::spriteBatch() const
+{
+  return p->spriteBatch;
+}
+
+TextCache& SharedState::textCache() const
+{
+  return p->textCache;
+}
+
 Quad& SharedState::gpQuad() const
 {
   return p->gpQuad;
@@ -308,6 +341,8 @@ TEXFBO &SharedState::gpTexFBO(int minW, int minH)
   if (needResize) {
     TEX::bind(p->gpTexFBO.tex);
     TEX::allocEmpty(p->gpTexFBO.width, p->gpTexFBO.height);
+    p->gpTexFBO.texW = p->gpTexFBO.width;
+    p->gpTexFBO.texH = p->gpTexFBO.height;
   }
   return p->gpTexFBO;
 }
@@ -44,6 +44,10 @@ class Input;
 class Audio;
 class GLState;
 class TexPool;
+class GlyphAtlas;
+class BitmapAtlas;
+class SpriteBatch;
+class TextCache;
 class Font;
 class SharedFontState;
 struct GlobalIBO;
@@ -76,6 +80,10 @@ struct SharedState
 	ShaderSet &shaders() const;
 
 	TexPool &texPool() const;
+	GlyphAtlas &glyphAtlas() const;
+	BitmapAtlas &bitmapAtlas() const;
+	SpriteBatch &spriteBatch() const;
+	TextCache &textCache() const;
 
 	SharedFontState &fontState() const;
 	Font &defaultFont() const;
@@ -27,10 +27,16 @@
 #include "config.h"
 #include "util.h"
 #include "debugwriter.h"
+#include "sdl-util.h"
 
 #include <SDL_sound.h>
+#include <SDL_timer.h>
 
-#define SE_CACHE_MEM (10*1024*1024) // 10 MB
+#include <algorithm>
+
+#define SE_DECODE_THREADS 2
+/* Largest share of the cache a pinned buffer may take up */
+#define SE_PIN_SHARE 16
 
 struct SoundBuffer
 {
@@ -45,11 +51,23 @@ struct SoundBuffer
 	/* Buffer byte count */
 	uint32_t bytes;
 
+	/* Microseconds it took to decode and upload */
+	uint32_t decodeUs;
+
+	/* Plays since it was cached */
+	uint32_t uses;
+
+	/* Eviction order, lowest first */
+	double priority;
+
 	/* Reference count */
 	uint8_t refCount;
 
 	SoundBuffer()
 	    : link(this),
+	      decodeUs(0),
+	      uses(1),
+	      priority(0),
 	      refCount(1)
 
 	{
@@ -76,6 +94,56 @@ private:
 	}
 };
 
+/* A sound read into memory and handed to the decode workers */
+struct SoundDecode
+{
+	struct Play
+	{
+		float volume;
+		float pitch;
+
+		Play(float volume, float pitch)
+		    : volume(volume),
+		      pitch(pitch)
+		{}
+	};
+
+	std::string key;
+
+	/* Extension the file was found with */
+	std::string ext;
+
+	/* Encoded file data, 'sample' decodes from it */
+	std::string data;
+	Sound_Sample *sample;
+
+	/* Set by the decoding worker, 'pcm' points into either
+	 * the sample's buffer or the disk cache's entry */
+	uint32_t decodeUs;
+	const void *pcm;
+	uint32_t pcmBytes;
+	uint8_t sampleSize;
+	uint8_t channels;
+	uint32_t rate;
+	PCMCache::PCM disk;
+
+	/* Plays requested before decoding finished */
+	std::vector<Play> plays;
+
+	SoundDecode()
+	    : sample(0),
+	      decodeUs(0),
+	      pcm(0),
+	      pcmBytes(0)
+	{}
+
+	~SoundDecode()
+	{
+		if (sample)
+			Sound_FreeSample(sample);
+	}
+};
+
 /* Before: [a][b][c][d], After (index=1): [a][c][d][b] */
 static void
 arrayPushBack(std::vector<size_t> &array, size_t size, size_t index)
@@ -89,7 +157,12 @@ arrayPushBack(std::vector<size_t> &array, size_t size, size_t index)
 }
 
 SoundEmitter::SoundEmitter(const Config &conf)
-    : bufferBytes(0),
+    : decodeTermReq(false),
+      bufferBytes(0),
+      cacheCapacity(conf.SE.cacheSize * 1024 * 1024),
+      pinPlays(conf.SE.pinPlays),
+      cacheAge(0),
+      pcmCache(conf),
       srcCount(conf.SE.sourceCount),
       alSrcs(srcCount),
       atchBufs(srcCount),
@@ -101,10 +174,32 @@ SoundEmitter::SoundEmitter(const Config &conf)
 		atchBufs[i] = 0;
 		srcPrio[i] = i;
 	}
+
+	memset(&stats, 0, sizeof(stats));
+	stats.capacity = cacheCapacity;
+
+	mut = SDL_CreateMutex();
+	decodeCond = SDL_CreateCond();
+
+	for (int i = 0; i < SE_DECODE_THREADS; ++i)
+		decodeThreads.push_back(createSDLThread
+			<SoundEmitter, &SoundEmitter::decodeWorker>(this, "se_decode"));
 }
 
 SoundEmitter::~SoundEmitter()
 {
+	SDL_LockMutex(mut);
+	decodeTermReq = true;
+	SDL_CondBroadcast(decodeCond);
+	SDL_UnlockMutex(mut);
+
+	for (size_t i = 0; i < decodeThreads.size(); ++i)
+		SDL_WaitThread(decodeThreads[i], 0);
+
+	/* Whatever is left never got picked up by a worker */
+	for (size_t i = 0; i < decodeQueue.size(); ++i)
+		delete decodeQueue[i];
+
 	for (size_t i = 0; i < srcCount; ++i)
 	{
 		AL::Source::stop(alSrcs[i]);
@@ -117,6 +212,9 @@ SoundEmitter::~SoundEmitter()
 	BufferHash::const_iterator iter;
 	for (iter = bufferHash.cbegin(); iter != bufferHash.cend(); ++iter)
 		SoundBuffer::deref(iter->second);
+
+	SDL_DestroyCond(decodeCond);
+	SDL_DestroyMutex(mut);
 }
 
 void SoundEmitter::play(const std::string &filename,
@@ -126,11 +224,89 @@ void SoundEmitter::play(const std::string &filename,
 	float _volume = clamp<int>(volume, 0, 100) / 100.0f;
 	float _pitch  = clamp<int>(pitch, 50, 150) / 100.0f;
 
-	SoundBuffer *buffer = allocateBuffer(filename);
+	SDL_LockMutex(mut);
+	bool known = playKnown(filename, _volume, _pitch);
+	SDL_UnlockMutex(mut);
 
-	if (!buffer)
+	if (known)
+		return;
+
+	/* Only this thread queues up decodes, so nobody
+	 * else can have done so in the meantime */
+	SoundDecode *decode = readSound(filename);
+
+	if (!decode)
+		return;
+
+	decode->plays.push_back(SoundDecode::Play(_volume, _pitch));
+
+	SDL_LockMutex(mut);
+	queueDecode(decode);
+	SDL_UnlockMutex(mut);
+}
+
+void SoundEmitter::preload(const std::string &filename)
+{
+	SDL_LockMutex(mut);
+	bool known = bufferHash.contains(filename) || decodeHash.contains(filename);
+	SDL_UnlockMutex(mut);
+
+	if (known)
 		return;
 
+	SoundDecode *decode = readSound(filename);
+
+	if (!decode)
+		return;
+
+	SDL_LockMutex(mut);
+	queueDecode(decode);
+	SDL_UnlockMutex(mut);
+}
+
+void SoundEmitter::stop()
+{
+	SDL_LockMutex(mut);
+
+	for (size_t i = 0; i < srcCount; i++)
+		AL::Source::stop(alSrcs[i]);
+
+	/* Sounds still decoding shouldn't start anymore either */
+	DecodeHash::const_iterator iter;
+	for (iter = decodeHash.cbegin(); iter != decodeHash.cend(); ++iter)
+		iter->second->plays.clear();
+
+	SDL_UnlockMutex(mut);
+}
+
+/* Plays 'filename' right away if it is cached, or once
+ * its decode in progress finishes. Returns false if
+ * it still has to be read and decoded */
+bool SoundEmitter::playKnown(const std::string &filename, float volume, float pitch)
+{
+	SoundBuffer *buffer = cachedBuffer(filename);
+
+	if (buffer)
+	{
+		++stats.hits;
+		startSound(buffer, volume, pitch);
+
+		return true;
+	}
+
+	++stats.misses;
+	SoundDecode *decode = decodeHash.value(filename, 0);
+
+	if (!decode)
+		return false;
+
+	decode->plays.push_back(SoundDecode::Play(volume, pitch));
+
+	return true;
+}
+
+void SoundEmitter::startSound(SoundBuffer *buffer, float volume, float pitch)
+{
 	/* Try to find first free source */
 	size_t i;
 	for (i = 0; i < srcCount; ++i)
@@ -172,107 +348,339 @@ void SoundEmitter::play(const std::string &filename,
 	if (switchBuffer)
 		AL::Source::attachBuffer(src, buffer->alBuffer);
 
-	AL::Source::setVolume(src, _volume * GLOBAL_VOLUME);
-	AL::Source::setPitch(src, _pitch);
+	AL::Source::setVolume(src, volume * GLOBAL_VOLUME);
+	AL::Source::setPitch(src, pitch);
 
 	AL::Source::play(src);
 }
 
-void SoundEmitter::stop()
-{
-	for (size_t i = 0; i < srcCount; i++)
-		AL::Source::stop(alSrcs[i]);
-}
-
 struct SoundOpenHandler : FileSystem::OpenHandler
 {
-	SoundBuffer *buffer;
+	SoundDecode *decode;
 
-	SoundOpenHandler()
-	    : buffer(0)
+	SoundOpenHandler(SoundDecode *decode)
+	    : decode(decode)
 	{}
 
 	bool tryRead(SDL_RWops &ops, const char *ext)
 	{
-		Sound_Sample *sample = Sound_NewSample(&ops, ext, 0, STREAM_BUF_SIZE);
+		/* Read the whole file so the workers never touch
+		 * the game's filesystem, decoding happens from memory */
+		Sint64 size = SDL_RWsize(&ops);
+		decode->data.resize(size > 0 ? size : 0);
 
-		if (!sample)
-		{
-			SDL_RWclose(&ops);
-			return false;
-		}
+		if (size > 0)
+			SDL_RWread(&ops, &decode->data[0], 1, size);
 
-		/* Do all of the decoding in the handler so we don't have
-		 * to keep the source ops around */
-		uint32_t decBytes = Sound_DecodeAll(sample);
-		uint8_t sampleSize = formatSampleSize(sample->actual.format);
-		uint32_t sampleCount = decBytes / sampleSize;
+		SDL_RWclose(&ops);
 
-		buffer = new SoundBuffer;
-		buffer->bytes = sampleSize * sampleCount;
+		if (decode->data.empty())
+			return false;
 
-		ALenum alFormat = chooseALFormat(sampleSize, sample->actual.channels);
+		/* Only looks at the header, so files of the wrong
+		 * format still get turned down here */
+		SDL_RWops *mem = SDL_RWFromConstMem(decode->data.data(), decode->data.size());
+		decode->sample = Sound_NewSample(mem, ext, 0, STREAM_BUF_SIZE);
 
-		AL::Buffer::uploadData(buffer->alBuffer, alFormat, sample->buffer,
-							   buffer->bytes, sample->actual.rate);
+		if (!decode->sample)
+			return false;
 
-		Sound_FreeSample(sample);
+		decode->ext = ext ? ext : "";
 
 		return true;
 	}
 };
 
-SoundBuffer *SoundEmitter::allocateBuffer(const std::string &filename)
+/* Reads 'filename' and readies it for decoding,
+ * runs on the RGSS thread */
+SoundDecode *SoundEmitter::readSound(const std::string &filename)
 {
-	SoundBuffer *buffer = bufferHash.value(filename, 0);
+	SoundDecode *decode = new SoundDecode;
+	decode->key = filename;
 
-	if (buffer)
+	SoundOpenHandler handler(decode);
+
+	try
+	{
+		shState->fileSystem().openRead(handler, filename.c_str());
+	}
+	catch (const Exception &e)
 	{
-		/* Buffer still in cashe.
-		 * Move to front of priority list */
-		buffers.remove(buffer->link);
-		buffers.append(buffer->link);
+		delete decode;
+		throw;
+	}
 
-		return buffer;
+	if (!decode->sample)
+	{
+		char buf[512];
+		snprintf(buf, sizeof(buf), "Unable to decode sound: %s: %s",
+		         filename.c_str(), Sound_GetError());
+		Debug() << buf;
+
+		delete decode;
+
+		return 0;
+	}
+
+	return decode;
+}
+
+void SoundEmitter::queueDecode(SoundDecode *decode)
+{
+	decodeHash.insert(decode->key, decode);
+	decodeQueue.push_back(decode);
+	SDL_CondSignal(decodeCond);
+}
+
+void SoundEmitter::decodeWorker()
+{
+	SDL_LockMutex(mut);
+
+	while (true)
+	{
+		while (!decodeTermReq && decodeQueue.empty())
+			SDL_CondWait(decodeCond, mut);
+
+		if (decodeTermReq)
+			break;
+
+		SoundDecode *decode = decodeQueue.front();
+		decodeQueue.pop_front();
+
+		SDL_UnlockMutex(mut);
+		uint64_t start = SDL_GetPerformanceCounter();
+		bool decoded = decodeSound(decode);
+		decode->decodeUs = (SDL_GetPerformanceCounter() - start) * 1000000
+		                 / SDL_GetPerformanceFrequency();
+		SDL_LockMutex(mut);
+
+		finishDecode(decode, decoded);
 	}
-	else
+
+	SDL_UnlockMutex(mut);
+}
+
+/* Fetches the sound's PCM from the disk cache or decodes it,
+ * runs on a worker without the emitter lock held */
+bool SoundEmitter::decodeSound(SoundDecode *decode)
+{
+	std::string entry;
+
+	if (pcmCache.enabled())
 	{
-		/* Buffer not in cache, needs to be loaded */
-		SoundOpenHandler handler;
-		shState->fileSystem().openRead(handler, filename.c_str());
-		buffer = handler.buffer;
+		entry = pcmCache.entryPath(decode->key + "." + decode->ext,
+		                           decode->data.data(), decode->data.size());
 
-		if (!buffer)
+		if (pcmCache.load(entry, decode->disk))
 		{
-			char buf[512];
-			snprintf(buf, sizeof(buf), "Unable to decode sound: %s: %s",
-			         filename.c_str(), Sound_GetError());
-			Debug() << buf;
+			decode->pcm = &decode->disk.data[0];
+			decode->pcmBytes = decode->disk.data.size();
+			decode->sampleSize = decode->disk.sampleSize;
+			decode->channels = decode->disk.channels;
+			decode->rate = decode->disk.rate;
 
-			return 0;
+			return true;
 		}
+	}
+
+	Sound_Sample *sample = decode->sample;
+	uint32_t decBytes = Sound_DecodeAll(sample);
+
+	if (decBytes == 0)
+	{
+		char buf[512];
+		snprintf(buf, sizeof(buf), "Unable to decode sound: %s: %s",
+		         decode->key.c_str(), Sound_GetError());
+		Debug() << buf;
+
+		return false;
+	}
+
+	decode->sampleSize = formatSampleSize(sample->actual.format);
+	decode->channels = sample->actual.channels;
+	decode->rate = sample->actual.rate;
+	decode->pcm = sample->buffer;
+	decode->pcmBytes = decBytes - decBytes % decode->sampleSize;
+
+	if (!entry.empty())
+		pcmCache.store(entry, decode->sampleSize, decode->channels,
+		               decode->rate, decode->pcm, decode->pcmBytes);
+
+	return true;
+}
+
+/* Uploads the decoded sound, caches it and starts
+ * the plays waiting for it */
+void SoundEmitter::finishDecode(SoundDecode *decode, bool decoded)
+{
+	decodeHash.remove(decode->key);
+
+	if (!decoded)
+	{
+		delete decode;
+
+		return;
+	}
+
+	SoundBuffer *buffer = new SoundBuffer;
+	buffer->key = decode->key;
+	buffer->bytes = decode->pcmBytes;
+	buffer->decodeUs = decode->decodeUs;
+	buffer->uses = std::max<size_t>(decode->plays.size(), 1);
+
+	ALenum alFormat = chooseALFormat(decode->sampleSize, decode->channels);
+
+	AL::Buffer::uploadData(buffer->alBuffer, alFormat, decode->pcm,
+						   buffer->bytes, decode->rate);
+
+	bool cached = insertBuffer(buffer);
+
+	for (size_t i = 0; i < decode->plays.size(); ++i)
+		startSound(buffer, decode->plays[i].volume, decode->plays[i].pitch);
+
+	/* Lives on only as long as sources play it */
+	if (!cached)
+		SoundBuffer::deref(buffer);
+
+	delete decode;
+}
+
+SoundBuffer *SoundEmitter::cachedBuffer(const std::string &filename)
+{
+	SoundBuffer *buffer = bufferHash.value(filename, 0);
+
+	if (!buffer)
+		return 0;
+
+	/* Buffer still in cache, played once more */
+	++buffer->uses;
+	updatePriority(buffer);
+
+	return buffer;
+}
 
-		buffer->key = filename;
-		uint32_t wouldBeBytes = bufferBytes + buffer->bytes;
+/* Greedy Dual Size Frequency: what is played often and costly
+ * to decode for its size is worth the most. The cache age
+ * rises with every eviction, so that buffers going unused
+ * for long fall behind ones played lately */
+void SoundEmitter::updatePriority(SoundBuffer *buffer)
+{
+	double cost = buffer->decodeUs + 1.0;
+	double bytes = std::max<uint32_t>(buffer->bytes, 1);
+
+	buffer->priority = cacheAge + buffer->uses * cost / bytes;
+}
+
+bool SoundEmitter::isPinned(const SoundBuffer *buffer) const
+{
+	return pinPlays > 0 && buffer->uses >= pinPlays
+	    && buffer->bytes <= cacheCapacity / SE_PIN_SHARE;
+}
+
+struct EvictionOrder
+{
+	const SoundEmitter *emitter;
+
+	EvictionOrder(const SoundEmitter *emitter)
+	    : emitter(emitter)
+	{}
+
+	/* Pinned buffers go last */
+	bool operator()(const SoundBuffer *a, const SoundBuffer *b) const
+	{
+		bool pinA = emitter->isPinned(a);
+		bool pinB = emitter->isPinned(b);
+
+		if (pinA != pinB)
+			return pinB;
+
+		return a->priority < b->priority;
+	}
+};
+
+/* Makes room for 'buffer' out of buffers worth less than it,
+ * pinned ones only once nothing else is left. Returns false
+ * if 'buffer' is worth too little to be cached itself */
+bool SoundEmitter::insertBuffer(SoundBuffer *buffer)
+{
+	updatePriority(buffer);
+
+	if (buffer->bytes > cacheCapacity)
+	{
+		cacheAge = std::max(cacheAge, buffer->priority);
+
+		return false;
+	}
+
+	uint32_t wouldBeBytes = bufferBytes + buffer->bytes;
+	std::vector<SoundBuffer*> victims;
 
-		/* If memory limit is reached, delete lowest priority buffer
-		 * until there is room or no buffers left */
-		while (wouldBeBytes > SE_CACHE_MEM && !buffers.isEmpty())
+	if (wouldBeBytes > cacheCapacity)
+	{
+		std::vector<SoundBuffer*> order;
+		IntruListLink<SoundBuffer> *iter;
+
+		for (iter = buffers.begin(); iter != buffers.end(); iter = iter->next)
+			order.push_back(iter->data);
+
+		std::sort(order.begin(), order.end(), EvictionOrder(this));
+
+		uint32_t freed = 0;
+
+		for (size_t i = 0; i < order.size() && wouldBeBytes - freed > cacheCapacity; ++i)
 		{
-			SoundBuffer *last = buffers.tail();
-			bufferHash.remove(last->key);
-			buffers.remove(last->link);
+			if (!isPinned(order[i]) && order[i]->priority > buffer->priority)
+				break;
+
+			victims.push_back(order[i]);
+			freed += order[i]->bytes;
+		}
 
-			wouldBeBytes -= last->bytes;
+		if (wouldBeBytes - freed > cacheCapacity)
+		{
+			cacheAge = std::max(cacheAge, buffer->priority);
 
-			SoundBuffer::deref(last);
+			return false;
 		}
+	}
 
-		bufferHash.insert(filename, buffer);
-		buffers.prepend(buffer->link);
+	for (size_t i = 0; i < victims.size(); ++i)
+	{
+		SoundBuffer *victim = victims[i];
+		bufferHash.remove(victim->key);
+		buffers.remove(victim->link);
 
-		bufferBytes = wouldBeBytes;
+		wouldBeBytes -= victim->bytes;
+		cacheAge = std::max(cacheAge, victim->priority);
+		++stats.evictions;
 
-		return buffer;
+		SoundBuffer::deref(victim);
 	}
+
+	bufferHash.insert(buffer->key, buffer);
+	buffers.prepend(buffer->link);
+
+	bufferBytes = wouldBeBytes;
+
+	return true;
+}
+
+SECacheStats SoundEmitter::cacheStats()
+{
+	SDL_LockMutex(mut);
+
+	SECacheStats result = stats;
+	result.count = buffers.getSize();
+	result.pinned = 0;
+	result.bytes = bufferBytes;
+
+	IntruListLink<SoundBuffer> *iter;
+
+	for (iter = buffers.begin(); iter != buffers.end(); iter = iter->next)
+		if (isPinned(iter->data))
+			++result.pinned;
+
+	SDL_UnlockMutex(mut);
+
+	return result;
 }
@@ -25,22 +25,64 @@
 #include "intrulist.h"
 #include "al-util.h"
 #include "boost-hash.h"
+#include "pcmcache.h"
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
 
 struct SoundBuffer;
+struct SoundDecode;
 struct Config;
 
+struct SECacheStats
+{
+	/* Plays served from the cache / needing a decode */
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;
+
+	/* Buffers currently cached */
+	uint32_t count;
+	uint32_t pinned;
+	uint32_t bytes;
+	uint32_t capacity;
+};
+
+/* Sounds missing from the cache are decoded by a pool of worker
+ * threads, each one starts playing as soon as it is ready.
+ * Everything but the workers' decoding happens with
+ * the emitter lock held */
 struct SoundEmitter
 {
 	typedef BoostHash<std::string, SoundBuffer*> BufferHash;
+	typedef BoostHash<std::string, SoundDecode*> DecodeHash;
 
 	IntruList<SoundBuffer> buffers;
 	BufferHash bufferHash;
 
+	/* Sounds waiting for or being decoded, by file name */
+	DecodeHash decodeHash;
+	std::deque<SoundDecode*> decodeQueue;
+	std::vector<SDL_Thread*> decodeThreads;
+	bool decodeTermReq;
+	SDL_mutex *mut;
+	SDL_cond *decodeCond;
+
 	/* Byte count sum of all cached / playing buffers */
 	uint32_t bufferBytes;
+	const uint32_t cacheCapacity;
+	const uint32_t pinPlays;
+
+	/* Priority of the latest evicted buffer, which
+	 * all later priorities get added on top of */
+	double cacheAge;
+	SECacheStats stats;
+
+	/* Decoded sounds kept across runs */
+	PCMCache pcmCache;
 
 	const size_t srcCount;
 	std::vector<AL::Source::ID> alSrcs;
@@ -56,10 +98,27 @@ struct SoundEmitter
 	          int volume,
 	          int pitch);
 
+	/* Decodes 'filename' ahead of its first play */
+	void preload(const std::string &filename);
+
 	void stop();
 
+	SECacheStats cacheStats();
+
+	/* Pinned buffers are only evicted once nothing else is left */
+	bool isPinned(const SoundBuffer *buffer) const;
+
 private:
-	SoundBuffer *allocateBuffer(const std::string &filename);
+	SoundBuffer *cachedBuffer(const std::string &filename);
+	bool playKnown(const std::string &filename, float volume, float pitch);
+	SoundDecode *readSound(const std::string &filename);
+	void queueDecode(SoundDecode *decode);
+	bool decodeSound(SoundDecode *decode);
+	void finishDecode(SoundDecode *decode, bool decoded);
+	bool insertBuffer(SoundBuffer *buffer);
+	void updatePriority(SoundBuffer *buffer);
+	void startSound(SoundBuffer *buffer, float volume, float pitch);
+	void decodeWorker();
 };
 
 #endif // SOUNDEMITTER_H
@@ -33,7 +33,10 @@
 #include "shader.h"
 #include "glstate.h"
 #include "quadarray.h"
+#include "alphamask.h"
+#include "spritebatch.h"
 #include <math.h>
+#include <algorithm>
 #include <SDL_rect.h>
 #include <sigc++/connection.h>
 
@@ -63,6 +66,9 @@ struct SpritePrivate
   IntRect sceneRect;
   Vec2i sceneOrig;
   bool isVisible;// Would this sprite be visible on the screen if drawn?
+  // Where the bitmap lies in the texture it's drawn from (see Bitmap::prepareDrawTex)
+  Vec2i texOffset;
+  int texHeight;
   Color *color;
   Tone *tone;
   struct
@@ -73,9 +79,9 @@ struct SpritePrivate
     float phase;
     // Wave effect is active (amp != 0)
     bool active;
-    // qArray needs updating
+    // qArray needs rebuilding; the phase alone is left to the shader
     bool dirty;
-    SimpleQuadArray qArray;
+    QuadArray<WVertex> qArray;
   } wave;
   EtcTemps tmp;
   sigc::connection prepareCon;
@@ -97,6 +103,7 @@ struct SpritePrivate
     reducedHeight(0),
     reduceSpeed(ROWH),
     isVisible(false),
+    texHeight(0),
     color(&tmp.color),
     tone(&tmp.tone)
   {
@@ -156,12 +163,13 @@ struct SpritePrivate
 
   void recomputeBushDepth()
   {
-    if (nullOrDisposed(bitmap)) return;
+    if (nullOrDisposed(bitmap) || !texHeight) return;
     // Calculate effective (normalized) bush depth
     float texBushDepth = (bushDepth / trans.getScale().y) -
                          (srcRect->y + srcRect->height) +
                          bitmap->height();
-    efBushDepth = 1.0f - texBushDepth / bitmap->height();
+    // Normalize by the texture, which might be taller than the bitmap
+    efBushDepth = (texOffset.y + bitmap->height() - texBushDepth) / texHeight;
   }
 
   void onSrcRectChange()
@@ -173,6 +181,8 @@ struct SpritePrivate
     // Clamp the rectangle so it doesn't reach outside the bitmap bounds
     rect.w = clamp<int>(rect.w, 0, bmSize.x-rect.x);
     rect.h = clamp<int>(rect.h, 0, bmSize.y-rect.y);
+    rect.x += texOffset.x;
+    rect.y += texOffset.y;
     quad.setTexRect(mirrored ? rect.hFlipped() : rect);
     quad.setTexRect(mirroredY ? rect.wFlipped() : rect);
     quad.setPosRect(FloatRect(0, 0, rect.w, rect.h));
@@ -180,6 +190,60 @@ struct SpritePrivate
     wave.dirty = true;
   }
 
+  /* Bitmap area the sprite shows, clamped the same way
+   * as in onSrcRectChange; false if it's empty */
+  bool maskArea(IntRect &area)
+  {
+    if (nullOrDisposed(bitmap)) return false;
+    area = srcRect->toIntRect();
+    area.w = clamp<int>(area.w, 0, bitmap->width() - reducedWidth - area.x);
+    area.h = clamp<int>(area.h, 0, bitmap->height() - reducedHeight - area.y);
+    return area.w > 0 && area.h > 0;
+  }
+
+  bool isTransformed()
+  {
+    const Vec2 &scale = trans.getScale();
+    return scale.x != 1 || scale.y != 1 || trans.getRotation() != 0 ||
+           mirrored || mirroredY;
+  }
+
+  /* Maps a point on the sprite's plane to a pixel of its
+   * source area by inverting the transformation */
+  bool toLocal(float x, float y, const IntRect &area, Vec2i &out)
+  {
+    const Vec2 &scale = trans.getScale();
+    if (scale.x == 0 || scale.y == 0) return false;
+    const Vec2 &pos = trans.getPosition();
+    const Vec2 &orig = trans.getOrigin();
+    float angle = trans.getRotation() * 3.141592654f / 180.0f;
+    float c = cos(angle), s = sin(angle);
+    float u = x - pos.x, v = y - pos.y;
+    float lx = (c * u - s * v) / scale.x + orig.x;
+    float ly = (s * u + c * v) / scale.y + orig.y;
+    if (lx < 0 || ly < 0 || lx >= area.w || ly >= area.h) return false;
+    int ix = lx, iy = ly;
+    if (mirrored) ix = area.w - 1 - ix;
+    if (mirroredY) iy = area.h - 1 - iy;
+    out = Vec2i(area.x + ix, area.y + iy);
+    return true;
+  }
+
+  // Inverse of toLocal, for pixel centers of the source area
+  Vec2 toPlane(int ix, int iy, const IntRect &area)
+  {
+    if (mirrored) ix = area.w - 1 - ix;
+    if (mirroredY) iy = area.h - 1 - iy;
+    const Vec2 &scale = trans.getScale();
+    const Vec2 &pos = trans.getPosition();
+    const Vec2 &orig = trans.getOrigin();
+    float angle = trans.getRotation() * 3.141592654f / 180.0f;
+    float c = cos(angle), s = sin(angle);
+    float dx = (ix + 0.5f - orig.x) * scale.x;
+    float dy = (iy + 0.5f - orig.y) * scale.y;
+    return Vec2(c * dx + s * dy + pos.x, -s * dx + c * dy + pos.y);
+  }
+
   void updateSrcRectCon()
   { // Cut old connection and Create new one
     srcRectCon.disconnect();
@@ -210,14 +274,16 @@ struct SpritePrivate
     isVisible = SDL_HasIntersection(&self, &sceneRect);
   }
 
-  void emitWaveChunk(SVertex *&vert, float phase, int width, float zoomY, int chunkY, int chunkLength)
+  /* The sideways shift is added by SpriteWaveShader */
+  void emitWaveChunk(WVertex *&vert, int width, float zoomY, int chunkY, int chunkLength)
   {
-    float wavePos = phase + (chunkY / (float) wave.length) * (float) (M_PI * 2);
-    float chunkX = sin(wavePos) * wave.amp;
     FloatRect tex(0, chunkY / zoomY, width, chunkLength / zoomY);
     FloatRect pos = tex;
-    pos.x = chunkX;
+    tex.x += texOffset.x;
+    tex.y += texOffset.y;
     Quad::setTexPosRect(vert, tex, pos);
+    for (int i = 0; i < 4; ++i)
+      vert[i].waveY = chunkY;
     vert += 4;
   }
 
@@ -242,8 +308,13 @@ struct SpritePrivate
       wave.qArray.resize(1);
       int x = -wave.amp;
       int w = width - x * 2;
-      FloatRect tex(x, srcRect->y, w, srcRect->height);
-      Quad::setTexPosRect(&wave.qArray.vertices[0], tex, tex);
+      FloatRect pos(x, srcRect->y, w, srcRect->height);
+      FloatRect tex = pos;
+      tex.x += texOffset.x;
+      tex.y += texOffset.y;
+      Quad::setTexPosRect(&wave.qArray.vertices[0], tex, pos);
+      for (int i = 0; i < 4; ++i)
+        wave.qArray.vertices[i].waveY = 0;
       wave.qArray.commit();
       return;
     }
@@ -256,18 +327,70 @@ struct SpritePrivate
     // Final chunk length
     int lastLength = (visibleLength - firstLength) % 8;
     wave.qArray.resize(!!firstLength + chunks + !!lastLength);
-    SVertex *vert = &wave.qArray.vertices[0];
-    float phase = (wave.phase * (float) M_PI) / 180.0f;
+    if (wave.qArray.count() == 0) {
+      wave.qArray.commit();
+      return;
+    }
+    WVertex *vert = &wave.qArray.vertices[0];
     if (firstLength > 0)
-      emitWaveChunk(vert, phase, width, zoomY, 0, firstLength);
+      emitWaveChunk(vert, width, zoomY, 0, firstLength);
     for (int i = 0; i < chunks; ++i)
-      emitWaveChunk(vert, phase, width, zoomY, firstLength + i * 8, 8);
+      emitWaveChunk(vert, width, zoomY, firstLength + i * 8, 8);
     if (lastLength > 0)
-      emitWaveChunk(vert, phase, width, zoomY, firstLength + chunks * 8, lastLength);
+      emitWaveChunk(vert, width, zoomY, firstLength + chunks * 8, lastLength);
     wave.qArray.commit();
   }
 
+  /* Picks up the bitmap moving into or out of the atlas */
+  void updateDrawTex()
+  {
+    Vec2i offset;
+    const TEXFBO &tex = bitmap->prepareDrawTex(offset);
+    if (offset == texOffset && tex.texH == texHeight) return;
+    texOffset = offset;
+    texHeight = tex.texH;
+    onSrcRectChange();
+  }
+
+  // Chunks are aligned to the screen's 8 pixel rows
+  void waveMoved(int oldY, int newY)
+  {
+    if (oldY % 8 != newY % 8) wave.dirty = true;
+  }
+
+  /* Neutral values are given when there's no effect,
+   * so a wave sprite looks the same as any other */
+  void setEffects(SpriteShader &shader, bool effect, const Vec4 &flashColor)
+  {
+    shader.applyViewportProj();
+    shader.setSpriteMat(trans.getMatrix());
+    shader.setOpacity(opacity.norm);
+    if (!effect) {
+      shader.setTone(Vec4());
+      shader.setColor(Vec4());
+      shader.setBushDepth(0);
+      shader.setBushOpacity(1);
+      return;
+    }
+    shader.setTone(tone->norm);
+    shader.setBushDepth(efBushDepth);
+    shader.setBushOpacity(bushOpacity.norm);
+    /* When both flashing and effective color are set,
+     * the one with higher alpha will be blended */
+    const Vec4 *blend = (flashColor.w > color->norm.w) ?
+                             &flashColor : &color->norm;
+    shader.setColor(*blend);
+  }
+
+  bool needsEffectRender(bool flashing) const
+  {
+    return color->hasEffect() || tone->hasEffect() ||
+           flashing || bushDepth != 0;
+  }
+
   void prepare() {
+    if (!nullOrDisposed(bitmap))
+      updateDrawTex();
     if (wave.dirty) {
       updateWave();
       wave.dirty = false;
@@ -465,19 +588,21 @@ void Sprite::setY(int ny)
 {
   guardDisposed();
   if (p->trans.getPosition().y == ny) return;
+  int oldY = getY();
   p->trans.setPosition(Vec2(getX(), ny));
   if (!p->wave.active) return;//rgssVer >= 2) {
-  p->wave.dirty = true;
+  p->waveMoved(oldY, ny);
   setSpriteY(ny);
 }
 
 void Sprite::set_xy(int nx, int ny)
 {
   guardDisposed();
+  int oldY = getY();
   if (p->trans.getPosition().x != nx || p->trans.getPosition().y != ny)
     p->trans.setPosition(Vec2(nx, ny));
   if (!p->wave.active) return;
-  p->wave.dirty = true;
+  p->waveMoved(oldY, ny);
   setSpriteY(ny);
 }
 
@@ -562,7 +687,7 @@ void Sprite::setBlendType(int type)
 
 int Sprite::getReduceSpeed()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   return p->reduceSpeed;
 }
 
@@ -620,31 +745,75 @@ void Sprite::reduceWidthHeight()
 
 bool Sprite::isWidthIncreased()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   return p->reducedWidth == 0;
 }
 
 bool Sprite::isHeightIncreased()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   return p->reducedHeight == 0;
 }
 
 bool Sprite::isWidthReduced()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   return p->reducedWidth == p->bitmap->width();
 }
 
 bool Sprite::isHeightReduced()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   return p->reducedHeight == p->bitmap->height();
 }
 
+bool Sprite::opaqueAt(int x, int y)
+{
+  guardDisposedQuiet();
+  IntRect area;
+  if (!p->maskArea(area)) return false;
+  Vec2i px;
+  if (!p->toLocal(x + 0.5f, y + 0.5f, area, px)) return false;
+  return p->bitmap->alphaMask().opaque(px.x, px.y);
+}
+
+bool Sprite::overlaps(Sprite &other)
+{
+  guardDisposedQuiet();
+  other.guardDisposedQuiet();
+  IntRect areaA, areaB;
+  if (!p->maskArea(areaA) || !other.p->maskArea(areaB)) return false;
+  const AlphaMask &maskA = p->bitmap->alphaMask();
+  const AlphaMask &maskB = other.p->bitmap->alphaMask();
+  if (!p->isTransformed() && !other.p->isTransformed()) {
+    Vec2i posA = p->trans.getPositionI() - p->trans.getOriginI();
+    Vec2i posB = other.p->trans.getPositionI() - other.p->trans.getOriginI();
+    return AlphaMask::overlap(maskA, areaA, maskB, areaB, posB - posA);
+  }
+  /* Zoomed, rotated or mirrored sprites can't be lined up word
+   * by word; map every opaque pixel of the smaller one onto
+   * the other and sample it there instead */
+  SpritePrivate *src = p, *dst = other.p;
+  const AlphaMask *srcMask = &maskA, *dstMask = &maskB;
+  if (areaB.w * areaB.h < areaA.w * areaA.h) {
+    std::swap(src, dst);
+    std::swap(srcMask, dstMask);
+    std::swap(areaA, areaB);
+  }
+  for (int y = 0; y < areaA.h; ++y)
+    for (int x = 0; x < areaA.w; ++x) {
+      if (!srcMask->opaque(areaA.x + x, areaA.y + y)) continue;
+      Vec2 pt = src->toPlane(x, y, areaA);
+      Vec2i px;
+      if (dst->toLocal(pt.x, pt.y, areaB, px) && dstMask->opaque(px.x, px.y))
+        return true;
+    }
+  return false;
+}
+
 bool Sprite::isMouseInside()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   if (!p->isVisible) return false;
   int mx = shState->input().mouseX();
   int x = p->trans.getPosition().x;
@@ -658,7 +827,7 @@ bool Sprite::isMouseInside()
 
 bool Sprite::isMouseAboveColorFound()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   if (!p->isVisible) return false;
   int mx = shState->input().mouseX();
   int x = p->trans.getPosition().x;
@@ -698,13 +867,16 @@ void Sprite::initDynAttribs()
 // Flashable
 void Sprite::update()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   Flashable::update();
+  if (p->increaseWidth || p->reduceWidth ||
+      p->increaseHeight || p->reduceHeight)
+    Graphics::markDirty();
   p->updateReduceWidth();
   p->updateReduceHeight();
   if (!p->wave.active) return;
   p->wave.phase += p->wave.speed / 180;
-  p->wave.dirty = true;
+  Graphics::markDirty();
 }
 // SceneElement
 void Sprite::draw()
@@ -712,24 +884,21 @@ void Sprite::draw()
   if (!p->isVisible) return;
   if (emptyFlashFlag) return;
   ShaderBase *base;
-  bool renderEffect = p->color->hasEffect() ||
-                      p->tone->hasEffect()  ||
-                      flashing              ||
-                      p->bushDepth != 0;
-  if (renderEffect) {
+  bool renderEffect = p->needsEffectRender(flashing);
+  // Flash color only counts while flashing
+  const Vec4 &flash = flashing ? flashColor : Vec4();
+  if (p->wave.active) {
+    SpriteWaveShader &shader = shState->shaders().spriteWave;
+    shader.bind();
+    // A negative amplitude only narrows the sprite (see updateWave)
+    shader.setWave(std::max(p->wave.amp, 0), p->wave.length,
+                   (p->wave.phase * (float) M_PI) / 180.0f);
+    p->setEffects(shader, renderEffect, flash);
+    base = &shader;
+  } else if (renderEffect) {
     SpriteShader &shader = shState->shaders().sprite;
     shader.bind();
-    shader.applyViewportProj();
-    shader.setSpriteMat(p->trans.getMatrix());
-    shader.setTone(p->tone->norm);
-    shader.setOpacity(p->opacity.norm);
-    shader.setBushDepth(p->efBushDepth);
-    shader.setBushOpacity(p->bushOpacity.norm);
-    /* When both flashing and effective color are set,
-     * the one with higher alpha will be blended */
-    const Vec4 *blend = (flashing && flashColor.w > p->color->norm.w) ?
-                             &flashColor : &p->color->norm;
-    shader.setColor(*blend);
+    p->setEffects(shader, true, flash);
     base = &shader;
   } else if (p->opacity != 255) {
     AlphaSpriteShader &shader = shState->shaders().alphaSprite;
@@ -746,7 +915,7 @@ void Sprite::draw()
     base = &shader;
   }
   glState.blendMode.pushSet(p->blendType);
-  p->bitmap->bindTex(*base);
+  p->bitmap->bindDrawTex(*base);
   if (p->wave.active)
     p->wave.qArray.draw();
   else
@@ -754,6 +923,35 @@ void Sprite::draw()
   glState.blendMode.pop();
 }
 
+bool Sprite::drawBatched(SpriteBatch &batch)
+{
+  if (!p->isVisible) return true;
+  if (emptyFlashFlag) return true;
+  if (p->wave.active) return false;
+  // Same values SpriteShader would be given in draw()
+  Vec4 color, tone;
+  Vec4 effect(p->opacity.norm, 0, 1, 0);
+  if (p->needsEffectRender(flashing)) {
+    color = (flashing && flashColor.w > p->color->norm.w) ?
+            flashColor : p->color->norm;
+    tone = p->tone->norm;
+    effect.y = p->efBushDepth;
+    effect.z = p->bushOpacity.norm;
+  }
+  BVertex *vert = batch.add(p->bitmap->drawTex(), p->blendType);
+  const float *m = p->trans.getMatrix();
+  for (int i = 0; i < 4; ++i) {
+    const Vertex &src = p->quad.vert[i];
+    vert[i].pos = Vec2(m[0] * src.pos.x + m[4] * src.pos.y + m[12],
+                       m[1] * src.pos.x + m[5] * src.pos.y + m[13]);
+    vert[i].texPos = src.texPos;
+    vert[i].color = color;
+    vert[i].tone = tone;
+    vert[i].effect = effect;
+  }
+  return true;
+}
+
 void Sprite::onGeometryChange(const Scene::Geometry &geo)
 {// Offset at which the sprite will be drawn relative to screen origin
   p->trans.setGlobalOffset(geo.offset());
@@ -100,12 +100,17 @@ public:
   bool isHeightReduced();
   bool isMouseInside();
   bool isMouseAboveColorFound();
+  /* Pixel perfect hit tests against the bitmap's alpha mask,
+   * in the coordinate space of the sprite's position */
+  bool opaqueAt(int x, int y);
+  bool overlaps(Sprite &other);
   void initDynAttribs();
   void onGeometryChange(const Scene::Geometry &);
 
 private:
   SpritePrivate *p;
   void draw();
+  bool drawBatched(SpriteBatch &batch);
   void releaseResources();
   const char *klassName() const { return "sprite"; }
   ABOUT_TO_ACCESS_DISP
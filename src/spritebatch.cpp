@@ -0,0 +1,75 @@
+/*
+** spritebatch.cpp
+**
+** This file is part of HiddenChest
+*/
+
+#include "spritebatch.h"
+#include "quadarray.h"
+#include "gl-util.h"
+#include "glstate.h"
+#include "sharedstate.h"
+#include "shader.h"
+
+/* Quads per draw, well within what 16 bit indices can address */
+#define BATCH_MAX_QUADS 4096
+
+struct SpriteBatchPrivate
+{
+  QuadArray<BVertex> quads;
+  bool enabled;
+  size_t count;
+  TEX::ID tex;
+  Vec2i texSize;
+  BlendType blend;
+
+  SpriteBatchPrivate(bool enabled)
+  : enabled(enabled),
+    count(0),
+    blend(BlendNormal)
+  {}
+};
+
+SpriteBatch::SpriteBatch(bool enabled)
+{
+  p = new SpriteBatchPrivate(enabled);
+}
+
+SpriteBatch::~SpriteBatch()
+{
+  delete p;
+}
+
+bool SpriteBatch::enabled() const
+{
+  return p->enabled;
+}
+
+BVertex *SpriteBatch::add(const TEXFBO &tex, BlendType blend)
+{
+  if (p->count > 0 && (tex.tex != p->tex || blend != p->blend ||
+                       p->count == BATCH_MAX_QUADS))
+    flush();
+  if (p->count == 0) {
+    p->tex = tex.tex;
+    p->texSize = Vec2i(tex.texW, tex.texH);
+    p->blend = blend;
+  }
+  p->quads.resize(++p->count);
+  return &p->quads.vertices[(p->count - 1) * 4];
+}
+
+void SpriteBatch::flush()
+{
+  if (p->count == 0) return;
+  p->quads.commitStream();
+  SpriteBatchShader &shader = shState->shaders().spriteBatch;
+  shader.bind();
+  shader.applyViewportProj();
+  TEX::bind(p->tex);
+  shader.setTexSize(p->texSize);
+  glState.blendMode.pushSet(p->blend);
+  p->quads.draw();
+  glState.blendMode.pop();
+  p->count = 0;
+}
@@ -0,0 +1,36 @@
+/*
+** spritebatch.h
+**
+** This file is part of HiddenChest
+*/
+
+#ifndef SPRITEBATCH_H
+#define SPRITEBATCH_H
+
+#include "etc.h"
+
+struct TEXFBO;
+struct BVertex;
+struct SpriteBatchPrivate;
+
+/* Collects the quads of consecutive sprites sharing a texture
+ * and blend mode, and draws them with one call. Effects usually
+ * set as uniforms travel with each vertex instead. Scene flushes
+ * it before any element that can't be batched gets drawn */
+class SpriteBatch
+{
+public:
+  SpriteBatch(bool enabled);
+  ~SpriteBatch();
+  bool enabled() const;
+  /* Returns the 4 vertices of a new quad drawn out of 'tex',
+   * flushing the queued ones first if they can't be merged.
+   * Only valid until the next call */
+  BVertex *add(const TEXFBO &tex, BlendType blend);
+  void flush();
+
+private:
+  SpriteBatchPrivate *p;
+};
+
+#endif // SPRITEBATCH_H
@@ -28,10 +28,10 @@
 
 /* Init normally */
 Table::Table(int x, int y /*= 1*/, int z /*= 1*/)
-: xs(x), ys(y), zs(z), data(x*y*z) {}
+: xs(x), ys(y), zs(z), data(x*y*z), chZ(-1) {}
 
 Table::Table(const Table &other)
-: xs(other.xs), ys(other.ys), zs(other.zs), data(other.data) {}
+: xs(other.xs), ys(other.ys), zs(other.zs), data(other.data), chZ(-1) {}
 
 int16_t Table::get(int x, int y, int z) const
 {
@@ -42,6 +42,8 @@ void Table::set(int16_t value, int x, int y, int z)
 {
   if (x < 0 || x >= xs ||  y < 0 || y >= ys ||  z < 0 || z >= zs) return;
   data[xs*ys*z + xs*y + x] = value;
+  chRect = IntRect(x, y, 1, 1);
+  chZ = z;
   modified();
 }
 
@@ -69,6 +71,34 @@ void Table::resize(int x)
 {
   resize(x, ys, zs);
 }
+void TableDirty::add(const Table &table)
+{
+  const int z = table.changedZ();
+  if (z < 0) {
+    all = true;
+    return;
+  }
+  if ((int) rects.size() <= z) rects.resize(z + 1, IntRect());
+  IntRect &r = rects[z];
+  const IntRect &c = table.changedRect();
+  if (r.w == 0) {
+    r = c;
+    return;
+  }
+  const int right = std::max(r.x + r.w, c.x + c.w);
+  const int bottom = std::max(r.y + r.h, c.y + c.h);
+  r.x = std::min(r.x, c.x);
+  r.y = std::min(r.y, c.y);
+  r.w = right - r.x;
+  r.h = bottom - r.y;
+}
+
+void TableDirty::clear()
+{
+  rects.clear();
+  all = false;
+}
+
 // Serializable
 int Table::serialSize() const
 {// header + data
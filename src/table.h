@@ -23,6 +23,7 @@
 #define TABLE_H
 
 #include "serializable.h"
+#include "etc-internal.h"
 
 #include <stdint.h>
 #include <sigc++/signal.h>
@@ -58,10 +59,32 @@ public:
   }
 
   sigc::signal<void> modified;
+  /* Cells the latest 'modified' signal was about,
+   * a negative z meaning the whole table */
+  const IntRect &changedRect() const { return chRect; }
+  int changedZ() const { return chZ; }
 
 private:
   int xs, ys, zs;
   std::vector<int16_t> data;
+  IntRect chRect;
+  int chZ;
+};
+
+/* Cells changed in a Table since the last clear(), coalesced
+ * into one bounding box per z layer. Listeners keep their own
+ * and feed it from their 'modified' handlers */
+struct TableDirty
+{
+  std::vector<IntRect> rects;
+  /* Everything may have changed */
+  bool all;
+
+  TableDirty() : all(true) {}
+  void add(const Table &table);
+  bool empty() const { return !all && rects.empty(); }
+  void clear();
+  void invalidate() { all = true; }
 };
 
 #endif // TABLE_H
@@ -24,51 +24,85 @@
 #include "sharedstate.h"
 #include "glstate.h"
 #include "boost-hash.h"
+#include "intrulist.h"
 #include "debugwriter.h"
-#include <list>
+#include "util.h"
 #include <utility>
 #include <assert.h>
 #include <string.h>
 
+/* Smallest texture dimension handed out by the pool */
+#define MIN_SIZE_CLASS 16
+
 typedef std::pair<uint16_t, uint16_t> Size;
 
-static uint32_t byteCount(Size &s)
+static uint32_t byteCount(const Size &s)
 {
   return s.first * s.second * 4;
 }
 
+/* Rounds up to a quarter step between powers of two
+ * (16, 20, 24, 28, 32, 40, 48, 56, 64, 80...), so slightly
+ * different sizes share textures while wasting at most
+ * a quarter of each dimension */
+static int sizeClass(int value)
+{
+  if (value <= MIN_SIZE_CLASS) return MIN_SIZE_CLASS;
+  int step = findNextPow2(value) / 8;
+  int rounded = (value + step - 1) / step * step;
+  /* Don't let rounding push us over the hardware limit */
+  return rounded > glState.caps.maxTexSize ? value : rounded;
+}
+
 struct CacheNode
 {
   TEXFBO obj;
-  std::list<TEXFBO>::iterator prioIter;
-  bool operator==(const CacheNode &o) const
-  {
-    return obj == o.obj;
-  }
+  IntruListLink<CacheNode> bucketLink;
+  IntruListLink<CacheNode> prioLink;
+
+  CacheNode(const TEXFBO &obj)
+      : obj(obj),
+        bucketLink(this),
+        prioLink(this)
+  {}
 };
 
-typedef std::list<CacheNode> CNodeList;
+typedef IntruList<CacheNode> CNodeList;
 
 struct TexPoolPrivate
 {
-  /* Contains all cached TexFBOs, grouped by size */
-  BoostHash<Size, CNodeList> poolHash;
-  /* Contains all cached TexFBOs, sorted by release time */
-  std::list<TEXFBO> priorityQueue;
+  /* Contains all cached TexFBOs, grouped by allocated size */
+  BoostHash<Size, CNodeList*> poolHash;
+  /* Contains all cached TexFBOs, most recently released first */
+  CNodeList priorityQueue;
   /* Maximal allowed cache memory */
   const uint32_t maxMemSize;
   /* Current amound of memory consumed by the cache */
   uint32_t memSize;
-  /* Current amount of TexFBOs cached */
-  uint16_t objCount;
   /* Has this pool been disabled? */
   bool disabled;
+  unsigned long hits, misses, evictions;
   TexPoolPrivate(uint32_t maxMemSize)
       : maxMemSize(maxMemSize),
         memSize(0),
-        objCount(0),
-        disabled(false)
+        disabled(false),
+        hits(0), misses(0), evictions(0)
   {}
+
+  CNodeList &bucket(const Size &size)
+  {
+    CNodeList *&list = poolHash[size];
+    if (!list) list = new CNodeList;
+    return *list;
+  }
+
+  /* Both unlinks are O(1), no list has to be searched */
+  void unlink(CacheNode *node)
+  {
+    bucket(Size(node->obj.texW, node->obj.texH)).remove(node->bucketLink);
+    priorityQueue.remove(node->prioLink);
+    memSize -= byteCount(Size(node->obj.texW, node->obj.texH));
+  }
 };
 
 TexPool::TexPool(uint32_t maxMemSize)
@@ -78,45 +112,58 @@ TexPool::TexPool(uint32_t maxMemSize)
 
 TexPool::~TexPool()
 {
-  std::list<TEXFBO>::iterator iter;
-  for (iter = p->priorityQueue.begin();
-       iter != p->priorityQueue.end();
-       ++iter)
-  {
-    TEXFBO obj = *iter;
-    TEXFBO::fini(obj);
-    --p->objCount;
+  while (!p->priorityQueue.isEmpty()) {
+    CacheNode *node = p->priorityQueue.tail();
+    p->unlink(node);
+    TEXFBO::fini(node->obj);
+    delete node;
   }
-  assert(p->objCount == 0);
+  assert(p->memSize == 0);
+  BoostHash<Size, CNodeList*>::const_iterator iter;
+  for (iter = p->poolHash.cbegin(); iter != p->poolHash.cend(); ++iter)
+    delete iter->second;
   delete p;
 }
 
 TEXFBO TexPool::request(int width, int height)
 {
-  CacheNode cnode;
-  Size size(width, height);
+  TEXFBO obj;
+  Size size(sizeClass(width), sizeClass(height));
   /* See if we can statisfy request from cache */
-  CNodeList &bucket = p->poolHash[size];
-  if (!bucket.empty()) {
+  CNodeList &bucket = p->bucket(size);
+  if (!bucket.isEmpty()) {
     /* Found one! */
-    cnode = bucket.back();
-    bucket.pop_back();
-    p->priorityQueue.erase(cnode.prioIter);
-    p->memSize -= byteCount(size);
-    --p->objCount;
+    CacheNode *node = bucket.begin()->data;
+    p->unlink(node);
+    obj = node->obj;
+    delete node;
+    ++p->hits;
 //		Debug() << "TexPool: <?+> (" << width << height << ")";
-    return cnode.obj;
-  }
-  int maxSize = glState.caps.maxTexSize;
-  if (width > maxSize + 800 || height > maxSize + 800)
-    throw Exception(Exception::HIDDENCHESTError,
-      "Texture dimensions [%d, %d] exceed hardware capabilities", width, height);
-  /* Nope, create it instead */
-  TEXFBO::init(cnode.obj);
-  TEXFBO::allocEmpty(cnode.obj, width, height);
-  TEXFBO::linkFBO(cnode.obj);
+  } else {
+    int maxSize = glState.caps.maxTexSize;
+    if (width > maxSize + 800 || height > maxSize + 800)
+      throw Exception(Exception::HIDDENCHESTError,
+        "Texture dimensions [%d, %d] exceed hardware capabilities", width, height);
+    /* Nope, create it instead */
+    TEXFBO::init(obj);
+    TEXFBO::allocEmpty(obj, size.first, size.second);
+    TEXFBO::linkFBO(obj);
+    ++p->misses;
 //	Debug() << "TexPool: <?-> (" << width << height << ")";
-  return cnode.obj;
+  }
+  obj.width = width;
+  obj.height = height;
+  /* Keep whatever lies outside of the used area from
+   * bleeding in when sampling the edges smoothly */
+  if (obj.texW > width || obj.texH > height) {
+    FBO::bind(obj.fbo);
+    glState.scissorTest.pushSet(false);
+    glState.clearColor.pushSet(Vec4());
+    FBO::clear();
+    glState.clearColor.pop();
+    glState.scissorTest.pop();
+  }
+  return obj;
 }
 
 void TexPool::release(TEXFBO &obj)
@@ -131,36 +178,30 @@ void TexPool::release(TEXFBO &obj)
     TEXFBO::fini(obj);
     return;
   }
-  Size size(obj.width, obj.height);
-  uint32_t newMemSize = p->memSize + byteCount(size);
+  Size size(obj.texW, obj.texH);
+  uint32_t objSize = byteCount(size);
   /* If caching this object would spill over the allowed memory budget,
    * delete least used objects until we're good again */
-  while (newMemSize > p->maxMemSize) {
-    if (p->objCount == 0) break;
+  while (p->memSize + objSize > p->maxMemSize) {
+    CacheNode *last = p->priorityQueue.tail();
+    if (!last) break;
 // Debug() << "TexPool: <!~> Size:" << p->memSize;
-    /* Retrieve object with lowest priority for deletion */
-    CacheNode last;
-    last.obj = p->priorityQueue.back();
-    Size removedSize(last.obj.width, last.obj.height);
-    CNodeList &bucket = p->poolHash[removedSize];
-    std::list<CacheNode>::iterator toRemove = std::find(bucket.begin(), bucket.end(), last);
-    assert(toRemove != bucket.end());
-    bucket.erase(toRemove);
-    p->priorityQueue.pop_back();
-    TEXFBO::fini(last.obj);
-    newMemSize -= byteCount(removedSize);
-    --p->objCount;
+    p->unlink(last);
+    TEXFBO::fini(last->obj);
+    delete last;
+    ++p->evictions;
 // Debug() << "TexPool: <!-> (" << last.obj.width << last.obj.height << ")";
   }
-  p->memSize = newMemSize;
+  /* Too big to be cached at all */
+  if (objSize > p->maxMemSize) {
+    TEXFBO::fini(obj);
+    return;
+  }
   /* Retain object */
-  p->priorityQueue.push_front(obj);
-  CacheNode cnode;
-  cnode.obj = obj;
-  cnode.prioIter = p->priorityQueue.begin();
-  CNodeList &bucket = p->poolHash[size];
-  bucket.push_back(cnode);
-  ++p->objCount;
+  CacheNode *node = new CacheNode(obj);
+  p->priorityQueue.prepend(node->prioLink);
+  p->bucket(size).prepend(node->bucketLink);
+  p->memSize += objSize;
 // Debug() << "TexPool: <!+> (" << obj.width << obj.height << ") Current size:" << p->memSize;
 }
 
@@ -168,3 +209,14 @@ void TexPool::disable()
 {
   p->disabled = true;
 }
+
+TexPoolStats TexPool::stats() const
+{
+  TexPoolStats s;
+  s.hits = p->hits;
+  s.misses = p->misses;
+  s.evictions = p->evictions;
+  s.residentBytes = p->memSize;
+  s.residentCount = p->priorityQueue.getSize();
+  return s;
+}
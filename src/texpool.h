@@ -26,14 +26,29 @@
 
 struct TexPoolPrivate;
 
+struct TexPoolStats
+{
+  /* Requests served from / missing the cache */
+  unsigned long hits, misses;
+  /* Cached objects deleted to stay within budget */
+  unsigned long evictions;
+  /* Memory held by cached (idle) objects */
+  uint32_t residentBytes;
+  int residentCount;
+};
+
 class TexPool
 {
 public:
   TexPool(uint32_t maxMemSize = 20000000 /* 20 MB */);
   ~TexPool();
+  /* The returned object's texture might be larger than
+   * requested (see TEXFBO::texW/texH), only the top left
+   * 'width' x 'height' part is meant to be used */
   TEXFBO request(int width, int height);
   void release(TEXFBO &obj);
   void disable();
+  TexPoolStats stats() const;
 
 private:
   TexPoolPrivate *p;
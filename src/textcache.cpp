@@ -0,0 +1,149 @@
+/*
+** textcache.cpp
+**
+** This file is part of HiddenChest
+*/
+
+#include "textcache.h"
+#include "boost-hash.h"
+#include <boost/functional/hash.hpp>
+#include <list>
+
+size_t hash_value(const TextKey &k)
+{
+  size_t seed = boost::hash_value(k.str);
+  boost::hash_combine(seed, k.font);
+  boost::hash_combine(seed, k.style);
+  boost::hash_combine(seed, k.outline);
+  boost::hash_combine(seed, k.shadowSize);
+  boost::hash_combine(seed, k.shadowMode);
+  boost::hash_combine(seed, k.color);
+  boost::hash_combine(seed, k.outColor);
+  boost::hash_combine(seed, k.shadowColor);
+  return seed;
+}
+
+/* Most recently used entries are kept at the front
+ * of the list, the hash points into it */
+template<typename V>
+struct LRUCache
+{
+  typedef std::pair<TextKey, V> Entry;
+  typedef typename std::list<Entry>::iterator Iter;
+  std::list<Entry> entries;
+  BoostHash<TextKey, Iter> index;
+  size_t count;
+
+  LRUCache() : count(0) {}
+
+  V *find(const TextKey &key)
+  {
+    if (!index.contains(key)) return 0;
+    Iter iter = index[key];
+    entries.splice(entries.begin(), entries, iter);
+    return &iter->second;
+  }
+
+  void store(const TextKey &key, const V &value, size_t budget)
+  {
+    if (budget == 0) return;
+    if (index.contains(key)) {
+      Iter iter = index[key];
+      iter->second = value;
+      entries.splice(entries.begin(), entries, iter);
+      return;
+    }
+    while (count >= budget) {
+      index.remove(entries.back().first);
+      entries.pop_back();
+      --count;
+    }
+    entries.push_front(Entry(key, value));
+    index.insert(key, entries.begin());
+    ++count;
+  }
+
+  void clear()
+  {
+    index = BoostHash<TextKey, Iter>();
+    entries.clear();
+    count = 0;
+  }
+};
+
+struct TextCachePrivate
+{
+  LRUCache<IntRect> sizes;
+  LRUCache<TextRun> runs;
+  size_t budget;
+  unsigned long hits, misses;
+
+  TextCachePrivate(int budget)
+  : budget(budget > 0 ? budget : 0), hits(0), misses(0)
+  {}
+};
+
+TextCache::TextCache(int budget)
+{
+  p = new TextCachePrivate(budget);
+}
+
+TextCache::~TextCache()
+{
+  delete p;
+}
+
+bool TextCache::findSize(const TextKey &key, IntRect &size)
+{
+  IntRect *cached = p->sizes.find(key);
+  if (!cached) {
+    p->misses++;
+    return false;
+  }
+  p->hits++;
+  size = *cached;
+  return true;
+}
+
+void TextCache::storeSize(const TextKey &key, const IntRect &size)
+{
+  p->sizes.store(key, size, p->budget);
+}
+
+const TextRun *TextCache::findRun(const TextKey &key, unsigned int generation)
+{
+  TextRun *cached = p->runs.find(key);
+  if (!cached || cached->generation != generation) {
+    p->misses++;
+    return 0;
+  }
+  p->hits++;
+  return cached;
+}
+
+void TextCache::storeRun(const TextKey &key, const TextRun &run)
+{
+  p->runs.store(key, run, p->budget);
+}
+
+unsigned long TextCache::hits() const
+{
+  return p->hits;
+}
+
+unsigned long TextCache::misses() const
+{
+  return p->misses;
+}
+
+int TextCache::size() const
+{
+  return p->sizes.count + p->runs.count;
+}
+
+void TextCache::clear()
+{
+  p->sizes.clear();
+  p->runs.clear();
+  p->hits = p->misses = 0;
+}
@@ -0,0 +1,84 @@
+/*
+** textcache.h
+**
+** This file is part of HiddenChest
+*/
+
+#ifndef TEXTCACHE_H
+#define TEXTCACHE_H
+
+#include "etc-internal.h"
+#include "glyphatlas.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+struct _TTF_Font;
+struct TextCachePrivate;
+
+/* Everything about a Font that changes how a string
+ * is measured or drawn. Measurements leave the
+ * drawing only fields (outline, shadow, colors) at 0 */
+struct TextKey
+{
+  std::string str;
+  _TTF_Font *font;
+  int style;
+  int outline;
+  int shadowSize;
+  int shadowMode;
+  uint32_t color, outColor, shadowColor;
+
+  TextKey(const char *str, _TTF_Font *font, int style)
+  : str(str), font(font), style(style), outline(0),
+    shadowSize(0), shadowMode(0), color(0), outColor(0), shadowColor(0)
+  {}
+
+  bool operator==(const TextKey &o) const
+  {
+    return font == o.font && style == o.style && outline == o.outline &&
+           shadowSize == o.shadowSize && shadowMode == o.shadowMode &&
+           color == o.color && outColor == o.outColor &&
+           shadowColor == o.shadowColor && str == o.str;
+  }
+};
+
+size_t hash_value(const TextKey &key);
+
+/* A string laid out and split into the glyph layers
+ * drawText composes, plus the size it ends up with */
+struct TextRun
+{
+  GlyphRun run;
+  std::vector<GlyphLayer> layers;
+  int width, height;
+  /* Atlas generation the glyph cells are valid for */
+  unsigned int generation;
+
+  TextRun() : width(0), height(0), generation(0) {}
+};
+
+/* Bounded least recently used caches for text measurements
+ * and drawText runs, sized by the 'textCacheSize' option */
+class TextCache
+{
+public:
+  TextCache(int budget);
+  ~TextCache();
+  /* Returns false on a miss */
+  bool findSize(const TextKey &key, IntRect &size);
+  void storeSize(const TextKey &key, const IntRect &size);
+  /* Returns null on a miss or if the run was laid out
+   * in an older atlas generation than 'generation' */
+  const TextRun *findRun(const TextKey &key, unsigned int generation);
+  void storeRun(const TextKey &key, const TextRun &run);
+  unsigned long hits() const;
+  unsigned long misses() const;
+  int size() const;
+  void clear();
+
+private:
+  TextCachePrivate *p;
+};
+
+#endif // TEXTCACHE_H
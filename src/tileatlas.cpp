@@ -20,6 +20,11 @@
 */
 
 #include "tileatlas.h"
+#include "table.h"
+
+#include <algorithm>
+
+extern const StaticRect autotileRects[];
 
 namespace TileAtlas
 {
@@ -160,4 +165,96 @@ Vec2i tileToAtlasCoor(int tileX, int tileY, int tilesetH, int atlasH)
   return Vec2i(atlasX, atlasY);
 }
 
+static void pushQuad(std::vector<SVertex> &vert,
+                     const FloatRect &pos, const FloatRect &tex)
+{
+  const Vec2 p[] = { pos.topLeft(), pos.topRight(), pos.bottomRight(), pos.bottomLeft() };
+  const Vec2 t[] = { tex.topLeft(), tex.topRight(), tex.bottomRight(), tex.bottomLeft() };
+  for (int i = 0; i < 4; ++i) {
+    SVertex v;
+    v.pos = p[i];
+    v.texPos = t[i];
+    vert.push_back(v);
+  }
+}
+
+void QuadTemplates::build(int tilesetH, int atlasH, const Table *priorities)
+{
+  const int ids = 48 * 8 + tilesetH / 32 * 8;
+  vert.clear();
+  first.assign(ids + 1, 0);
+  prio.assign(ids, -1);
+  for (int id = 0; id < ids; ++id) {
+    first[id] = vert.size() / 4;
+    if (id < 48) continue;// Empty space
+    int value = 0;
+    if (priorities && id < priorities->xSize())
+      value = priorities->at(id);
+    if (value < 0 || value > 5) continue;// Faulty data
+    prio[id] = value;
+    if (id < 48 * 8) {
+      /* Autotile: 4 pieces of pattern id % 48 */
+      const int atInd = id / 48 - 1;
+      const StaticRect *pieceRect = &autotileRects[(id % 48) * 4];
+      for (int i = 0; i < 4; ++i) {
+        FloatRect posRect((i % 2) * 16, (i / 2) * 16, 16, 16);
+        FloatRect texRect = pieceRect[i];
+        texRect.y += atInd * 4 * 32;
+        pushQuad(vert, posRect, texRect);
+      }
+      continue;
+    }
+    const int tsInd = id - 48 * 8;
+    Vec2i texPos = tileToAtlasCoor(tsInd % 8, tsInd / 8, tilesetH, atlasH);
+    FloatRect texRect((float) texPos.x + 0.5f, (float) texPos.y + 0.5f, 31, 31);
+    pushQuad(vert, FloatRect(0, 0, 32, 32), texRect);
+  }
+  first[ids] = vert.size() / 4;
+}
+
+static inline int wrapCoor(int value, int range)
+{
+  int res = value % range;
+  return res < 0 ? res + range : res;
+}
+
+void collectTiles(const QuadTemplates &templates, const Table &map,
+                  const IntRect &rect, std::vector<TileRef> &out)
+{
+  const int mw = map.xSize(), mh = map.ySize(), mz = map.zSize();
+  /* Every cell of every layer at most, trimmed afterwards */
+  out.resize(rect.w * rect.h * mz);
+  if (out.empty() || mw == 0 || mh == 0) {
+    out.clear();
+    return;
+  }
+  const int ids = templates.idCount();
+  TileRef *ref = &out[0];
+  for (int y = 0; y < rect.h; ++y) {
+    const int my = wrapCoor(rect.y + y, mh);
+    for (int z = 0; z < mz; ++z) {
+      const int16_t *row = &map.at(0, my, z);
+      for (int x = 0, mx = wrapCoor(rect.x, mw); x < rect.w; mx = 0) {
+        /* Cells up to the map's right edge lie next to each other */
+        const int16_t *src = row + mx;
+        const int run = std::min(rect.w - x, mw - mx);
+        for (int i = 0; i < run; ++i) {
+          const int id = src[i];
+          if (id < 48 || id >= ids) continue;
+          const int prio = templates.prio[id];
+          if (prio < 0) continue;
+          ref->x = x + i;
+          ref->y = y;
+          ref->id = id;
+          ref->prio = prio;
+          ref->quads = templates.quadCount(id);
+          ++ref;
+        }
+        x += run;
+      }
+    }
+  }
+  out.resize(ref - &out[0]);
+}
+
 }
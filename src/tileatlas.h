@@ -23,9 +23,13 @@
 #define TILEATLAS_H
 
 #include "etc-internal.h"
+#include "vertex.h"
 
+#include <stdint.h>
 #include <vector>
 
+class Table;
+
 namespace TileAtlas
 {
 
@@ -62,6 +66,53 @@ BlitVec calcBlits(int tilesetH, const Vec2i &atlasSize);
  * pixel coordinate in the atlas */
 Vec2i tileToAtlasCoor(int tileX, int tileY, int tilesetH, int atlasH);
 
+/* Quads of every tile id as placed at map cell (0, 0), so
+ * filling in a cell boils down to copying them with an offset */
+struct QuadTemplates
+{
+  /* 4 vertices per quad */
+  std::vector<SVertex> vert;
+  /* First quad of each id, plus one past the last */
+  std::vector<uint32_t> first;
+  /* Priority of each id, -1 if it isn't drawn */
+  std::vector<int8_t> prio;
+
+  /* 'priorities' may be null. Ids past the tileset
+   * are left out (they would sample garbage anyway) */
+  void build(int tilesetH, int atlasH, const Table *priorities);
+
+  int idCount() const { return prio.size(); }
+
+  int quadCount(int id) const { return first[id+1] - first[id]; }
+
+  /* Writes the quads of 'id' moved by ('x', 'y') to 'dst' */
+  void emit(int id, float x, float y, SVertex *dst) const
+  {
+    const SVertex *src = &vert[first[id] * 4];
+    const SVertex *end = &vert[first[id+1] * 4];
+    for (; src != end; ++src, ++dst) {
+      dst->pos.x = src->pos.x + x;
+      dst->pos.y = src->pos.y + y;
+      dst->texPos = src->texPos;
+    }
+  }
+};
+
+/* A drawn map tile, relative to the collected rectangle */
+struct TileRef
+{
+  int16_t x, y;
+  int16_t id;
+  int8_t prio;
+  uint8_t quads;
+};
+
+/* Gathers the drawn tiles inside 'rect' of 'map' (which repeats
+ * past its edges) row by row, each row layer by layer from left
+ * to right, reading contiguous runs straight out of the table */
+void collectTiles(const QuadTemplates &templates, const Table &map,
+                  const IntRect &rect, std::vector<TileRef> &out);
+
 }
 
 #endif // TILEATLAS_H
@@ -32,6 +32,7 @@
 #include "vertex.h"
 #include "quad.h"
 #include "etc-internal.h"
+#include "graphics.h"
 
 #include <stdint.h>
 #include <assert.h>
@@ -61,6 +62,19 @@ tableGetWrapped(const Table &t, int x, int y, int z = 0)
 	             z);
 }
 
+/* Whether the ranges [a, a+aLen) and [b, b+bLen) overlap
+ * anywhere, with values repeating every 'range' */
+static inline bool
+wrappedOverlap(int a, int aLen, int b, int bLen, int range)
+{
+	if (aLen >= range || bLen >= range)
+		return true;
+
+	int d = wrap(a - b, range);
+
+	return d < bLen || d + aLen > range;
+}
+
 /* Calculate the tile x/y on which this pixel x/y lies */
 static inline Vec2i
 getTilePos(const Vec2i &pixelPos)
@@ -158,6 +172,12 @@ struct FlashMap
 		dirty = true;
 	}
 
+	/* Whether there may be flashing tiles to animate */
+	bool active() const
+	{
+		return data && (dirty || !vertices.empty());
+	}
+
 	void prepare()
 	{
 		if (!dirty)
@@ -183,6 +203,7 @@ struct FlashMap
 		shader.setAlpha(alpha);
 		shader.setTranslation(trans);
 
+		++glState.drawCalls;
 		gl.DrawElements(GL_TRIANGLES, count * 6, _GL_INDEX_TYPE, 0);
 
 		glState.blendMode.pop();
@@ -194,6 +215,7 @@ private:
 	void setDirty()
 	{
 		dirty = true;
+		Graphics::markDirty();
 	}
 
 	size_t quadCount() const
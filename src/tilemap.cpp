@@ -40,6 +40,7 @@
 #include "tilemap-common.h"
 #include <sigc++/connection.h>
 #include <string.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <algorithm>
 #include <vector>
@@ -138,6 +139,30 @@ static const int tsLaneW = tilesetW / 2;
  *   adjusted if necessary and the data is regenerated. Its size
  *   is fixed. This is NOT related to the RGSS Viewport class!
  *
+ * Quad bags:
+ *   The shared VBO is cut into one range ("bag") for the ground
+ *   layer followed by one for each zlayer slot, every one of them
+ *   with some room to spare. Zlayers are assigned to slots by
+ *   their map row modulo the slot count, and vertices are placed
+ *   relative to a fixed anchor tile instead of the map viewport,
+ *   so when the map viewport moves by a few tiles, only the tiles
+ *   leaving and entering it need to be touched: leaving ones turn
+ *   their quads degenerate and free their slots, entering ones
+ *   take over free slots or are appended. Only tiles of the same
+ *   map cell ever overlap, and their quads are always handed out
+ *   in ascending order, so drawing order stays intact.
+ *   When a bag runs out of room, everything is rebuilt.
+ *
+ * Chunks:
+ *   Maps no larger than 'staticTilemapSize' skip the map viewport
+ *   altogether; their vertices are built once for the whole map,
+ *   in chunks of 16x16 tiles with their own VBO each. Scrolling
+ *   then only changes the translation, chunks out of sight are
+ *   skipped when drawing, and map data changes rebuild just the
+ *   chunks they touched. Within a chunk, the ground layer comes
+ *   first, followed by the zlayers of its rows in order, so any
+ *   run of zlayers can still be drawn in one go per chunk.
+ *
  */
 
 /* Autotile animation */
@@ -163,6 +188,41 @@ static const uint8_t flashAlpha[] =
 
 static elementsN(flashAlpha);
 
+/* Tiles farther than this from the anchor force a rebuild,
+ * keeping vertex coordinates small */
+static const int anchorDriftMax = 4096;
+
+struct QuadBag
+{
+  /* First quad and room of the bag in the VBO */
+  size_t base, capacity;
+  /* Quads in use or freed, counting from 'base' */
+  size_t count;
+  /* Quads holding actual tiles */
+  size_t live;
+  /* Freed quads, ready to be handed out again */
+  std::vector<uint16_t> free;
+  QuadBag() : base(0), capacity(0), count(0), live(0) {}
+};
+
+static const int chunkSize = 16;
+/* Zlayers of a chunk are numbered by row inside the chunk
+ * plus priority, with 0 standing for the ground layer */
+static const int chunkLayers = chunkSize + 5;
+
+struct TileChunk
+{
+  GLMeta::VAO vao;
+  VBO::ID vbo;
+  /* First quad of each layer, plus the end of the last one */
+  uint16_t bases[chunkLayers + 1];
+};
+
+static inline int floorDiv(int value, int range)
+{
+  return (value - wrap(value, range)) / range;
+}
+
 struct GroundLayer : public ViewportElement
 {
   GLsizei vboCount;
@@ -187,6 +247,8 @@ struct ZLayer : public ViewportElement
   /* If this layer is a batch head, this variable
    * holds the element count of the entire batch */
   GLsizei vboBatchCount;
+  /* Index of the batch's last layer */
+  size_t batchLast;
   ZLayer(TilemapPrivate *p, Viewport *viewport);
   void setIndex(int value);
   void draw();
@@ -223,12 +285,12 @@ struct TilemapPrivate
   } atlas;
   /* Map viewport position */
   Vec2i viewpPos;
-  /* Ground layer vertices */
-  std::vector<SVertex> groundVert;
-  /* ZLayer vertices */
-  std::vector<SVertex> zlayerVert[TILE_HEIGHT_MAX + 5];
-  // Base quad indices of each zlayer in the shared buffer
-  size_t zlayerBases[TILE_HEIGHT_MAX + 6];
+  /* Quads of every tile id, for the current atlas and priorities */
+  TileAtlas::QuadTemplates templates;
+  /* Scratch list of the tiles being turned into quads */
+  std::vector<TileAtlas::TileRef> tileRefs;
+  /* Ground layer bag, then one per zlayer slot */
+  QuadBag bags[TILE_HEIGHT_MAX + 6];
   /* Shared buffers for all tiles */
   struct
   {
@@ -238,7 +300,37 @@ struct TilemapPrivate
     /* Animation state */
     uint8_t frameIdx;
     uint8_t aniIdx;
+    /* Map tile vertex positions are relative to */
+    Vec2i anchor;
+    /* Map viewport position the buffer contents belong to */
+    Vec2i pos;
+    /* Copy of the VBO contents */
+    std::vector<SVertex> vert;
+    /* Bag each quad belongs to */
+    std::vector<uint8_t> quadBag;
+    /* Quads of each map viewport cell */
+    std::vector<std::vector<uint16_t> > cellQuads;
+    /* Quads changed since the last upload */
+    std::vector<uint16_t> dirty;
+    /* Bags have spare room for tiles entering */
+    bool scrollable;
   } tiles;
+  /* Whole map mode */
+  struct
+  {
+    bool active;
+    /* Chunk grid size */
+    Vec2i size;
+    std::vector<TileChunk> list;
+    /* Map size the chunks were cut for */
+    Vec2i mapSize;
+  } chunks;
+  /* Map data cells changed since the buffers were last updated */
+  TableDirty mapDirty;
+  /* Map data size the buffers were last fully built for. Table
+   * resizes emit no 'modified', and patching or scrolling cells
+   * laid out for another size would wrap them wrongly */
+  int builtSize[3];
 
   FlashMap flashMap;
   uint8_t flashAlphaIdx;
@@ -294,6 +386,9 @@ struct TilemapPrivate
     atlas.animatedATs.reserve(autotileCount);
     atlas.efTilesetH = 0;
     tiles.animated = false;
+    tiles.scrollable = false;
+    chunks.active = false;
+    builtSize[0] = builtSize[1] = builtSize[2] = -1;
     tiles.frameIdx = 0;
     tiles.aniIdx = 0;
     /* Init tile buffers */
@@ -319,6 +414,7 @@ struct TilemapPrivate
     /* Destroy tile buffers */
     GLMeta::vaoFini(tiles.vao);
     VBO::del(tiles.vbo);
+    releaseChunks();
     /* Disconnect signal handlers */
     tilesetCon.disconnect();
     for (int i = 0; i < autotileCount; ++i) {
@@ -332,12 +428,12 @@ struct TilemapPrivate
 
   void set_dimensions(int tw, int th)
   {
+    if (vw == tw / 32 + 1 && vh == th / 32 + 1) return;
     vw = tw / 32 + 1;
     vh = th / 32 + 1;
     zlayersMax = vh + 5;
-    size_t zlayerBases[zlayersMax + 1];
-    zlayerVert->resize(zlayersMax);
     elem.zlayers.resize(zlayersMax);
+    buffersDirty = true;
   }
 
   void updateFlashMapViewport()
@@ -394,6 +490,13 @@ struct TilemapPrivate
   void invalidateBuffers()
   {
     buffersDirty = true;
+    Graphics::markDirty();
+  }
+
+  void onMapDataModified()
+  {
+    mapDirty.add(*mapData);
+    Graphics::markDirty();
   }
   // Checks for the minimum amount of data needed to display
   bool verifyResources()
@@ -410,6 +513,8 @@ struct TilemapPrivate
     shState->releaseAtlasTex(atlas.gl);
     shState->requestAtlasTex(atlas.size.x, atlas.size.y, atlas.gl);
     atlasDirty = true;
+    /* Texture coordinates depend on the atlas layout */
+    buffersDirty = true;
   }
   // Assembles atlas from tileset and autotile bitmaps
   void buildAtlas()
@@ -493,111 +598,393 @@ struct TilemapPrivate
     }
   }
 
-  int samplePriority(int tileInd)
+  int cellIndex(int x, int y)
   {
-    if (!priorities) return 0;
-    if (tileInd > priorities->xSize()-1) return 0;
-    int value = priorities->at(tileInd);
-    if (value > 5) return -1;
-    return value;
+    return wrap(x, vw) + wrap(y, vh) * vw;
   }
 
-  void handleAutotile(int x, int y, int tileInd, std::vector<SVertex> *array)
-  {/* Which autotile [0-7] */
-    int atInd = tileInd / 48 - 1;
-    /* Which tile pattern of the autotile [0-47] */
-    int subInd = tileInd % 48;
-    const StaticRect *pieceRect = &autotileRects[subInd*4];
-    /* Iterate over the 4 tile pieces */
-    for (int i = 0; i < 4; ++i) {
-      FloatRect posRect(x*32, y*32, 16, 16);
-      atSelectSubPos(posRect, i);
-      FloatRect texRect = pieceRect[i];
-      /* Adjust to atlas coordinates */
-      texRect.y += atInd * autotileH;
-      SVertex v[4];
-      Quad::setTexPosRect(v, texRect, posRect);
-      /* Iterate over 4 vertices */
-      for (size_t i = 0; i < 4; ++i){ array->push_back(v[i]); }
-    }
+  /* Prio 0 tiles are all part of the same ground layer,
+   * the others go to the zlayer slot of row y + prio */
+  int bagIndex(int y, int prio)
+  {
+    return prio == 0 ? 0 : 1 + wrap(y + prio, zlayersMax);
   }
 
-  void handleTile(int x, int y, int z)
+  /* Bag of the zlayer 'index' rows below the map viewport top */
+  QuadBag &layerBag(size_t index)
   {
-    int tileInd = tableGetWrapped(*mapData, x + viewpPos.x, y + viewpPos.y, z);
-    if (tileInd < 48) return;// Check for empty space
-    int prio = samplePriority(tileInd);
-    if (prio == -1) return;// Check for faulty data
-    std::vector<SVertex> *targetArray;
-    /* Prio 0 tiles are all part of the same ground layer */
-    if (prio == 0) {
-      targetArray = &groundVert;
-    } else {
-      int layerInd = y + prio;
-      targetArray = &zlayerVert[layerInd];
+    return bags[1 + wrap(viewpPos.y + (int) index, zlayersMax)];
+  }
+
+  static size_t quadDataSize(size_t quadCount)
+  {
+    return quadCount * sizeof(SVertex) * 4;
+  }
+
+  void buildQuadArray()
+  {
+    const size_t bagCount = zlayersMax + 1;
+    size_t bagQuads[TILE_HEIGHT_MAX + 6] = {0};
+    size_t bagNext[TILE_HEIGHT_MAX + 6];
+    tiles.anchor = tiles.pos = viewpPos;
+    tiles.cellQuads.assign(vw * vh, std::vector<uint16_t>());
+    tiles.dirty.clear();
+    TileAtlas::collectTiles(templates, *mapData, IntRect(viewpPos, Vec2i(vw, vh)), tileRefs);
+    /* Count first, so every quad is written straight to its slot */
+    size_t quadCount = 0;
+    for (size_t i = 0; i < tileRefs.size(); ++i) {
+      const TileAtlas::TileRef &ref = tileRefs[i];
+      bagQuads[bagIndex(viewpPos.y + ref.y, ref.prio)] += ref.quads;
+      quadCount += ref.quads;
     }
-    if (tileInd < 48 * 8) {// Check for autotile
-      handleAutotile(x, y, tileInd, targetArray);
-      return;
+    /* Leave room for an edge's worth of tiles entering each bag,
+     * as far as the 16 bit indices allow */
+    size_t room = INDEX_T_MAX / 6 - std::min<size_t>(quadCount, INDEX_T_MAX / 6);
+    size_t groundSpare = std::min<size_t>(4 * (vw + vh), room / 4);
+    size_t layerSpare = std::min<size_t>(2 * vw, (room - groundSpare) / zlayersMax);
+    tiles.scrollable = groundSpare > 0 && layerSpare > 0;
+    size_t base = 0;
+    for (size_t i = 0; i < bagCount; ++i) {
+      QuadBag &bag = bags[i];
+      bag.base = bagNext[i] = base;
+      bag.count = bag.live = bagQuads[i];
+      bag.capacity = bag.count + (i == 0 ? groundSpare : layerSpare);
+      bag.free.clear();
+      base += bag.capacity;
+    }
+    tiles.vert.assign(base * 4, SVertex());
+    tiles.quadBag.assign(base, 0);
+    for (size_t i = 0; i < tileRefs.size(); ++i) {
+      const TileAtlas::TileRef &ref = tileRefs[i];
+      const int bagInd = bagIndex(viewpPos.y + ref.y, ref.prio);
+      const size_t quad = bagNext[bagInd];
+      bagNext[bagInd] += ref.quads;
+      templates.emit(ref.id, ref.x * 32, ref.y * 32, &tiles.vert[quad * 4]);
+      std::vector<uint16_t> &cell = tiles.cellQuads[cellIndex(viewpPos.x + ref.x, viewpPos.y + ref.y)];
+      for (size_t j = quad; j < quad + ref.quads; ++j) {
+        tiles.quadBag[j] = bagInd;
+        cell.push_back(j);
+      }
     }
-    int tsInd = tileInd - 48 * 8;
-    int tileX = tsInd % 8;
-    int tileY = tsInd / 8;
-    Vec2i texPos = TileAtlas::tileToAtlasCoor(tileX, tileY, atlas.efTilesetH, atlas.size.y);
-    FloatRect texRect((float) texPos.x + 0.5f, (float) texPos.y + 0.5f, 31, 31);
-    FloatRect posRect(x * 32, y * 32, 32, 32);
-    SVertex v[4];
-    Quad::setTexPosRect(v, texRect, posRect);
-    for (size_t i = 0; i < 4; ++i) { targetArray->push_back(v[i]); }
   }
 
-  void clearQuadArrays()
+  /* Frees the quads of map cell (x, y) */
+  void removeCell(int x, int y)
   {
-    groundVert.clear();
-    for (size_t i = 0; i < zlayersMax; ++i) { zlayerVert[i].clear(); }
+    std::vector<uint16_t> &quads = tiles.cellQuads[cellIndex(x, y)];
+    for (size_t i = 0; i < quads.size(); ++i) {
+      uint16_t quad = quads[i];
+      QuadBag &bag = bags[tiles.quadBag[quad]];
+      std::fill_n(&tiles.vert[quad * 4], 4, SVertex());
+      tiles.dirty.push_back(quad);
+      if (--bag.live == 0) {
+        bag.count = 0;
+        bag.free.clear();
+      } else {
+        bag.free.push_back(quad);
+      }
+    }
+    quads.clear();
   }
 
-  void buildQuadArray()
+  /* Fills in the quads of map cell (x, y), false if a bag is full */
+  bool addCell(int x, int y)
   {
-    clearQuadArrays();
-    for (int x = 0; x < vw; ++x)
-      for (int y = 0; y < vh; ++y)
-        for (int z = 0; z < mapData->zSize(); ++z)
-            handleTile(x, y, z);
+    std::vector<uint16_t> &quads = tiles.cellQuads[cellIndex(x, y)];
+    TileAtlas::collectTiles(templates, *mapData, IntRect(x, y, 1, 1), tileRefs);
+    size_t n[6] = {0};
+    for (size_t i = 0; i < tileRefs.size(); ++i)
+      n[tileRefs[i].prio] += tileRefs[i].quads;
+    std::vector<uint16_t> slots[6];
+    for (int prio = 0; prio < 6; ++prio) {
+      if (n[prio] == 0) continue;
+      QuadBag &bag = bags[bagIndex(y, prio)];
+      const size_t reused = std::min(n[prio], bag.free.size());
+      if (bag.count + (n[prio] - reused) > bag.capacity) return false;
+      /* Layers sharing a cell have to stay in order */
+      slots[prio].assign(bag.free.end() - reused, bag.free.end());
+      bag.free.resize(bag.free.size() - reused);
+      std::sort(slots[prio].begin(), slots[prio].end());
+      while (slots[prio].size() < n[prio]) { slots[prio].push_back(bag.base + bag.count++); }
+      bag.live += n[prio];
+    }
+    size_t next[6] = {0};
+    SVertex vert[4 * 4];
+    const Vec2i pos = Vec2i(x, y) - tiles.anchor;
+    for (size_t i = 0; i < tileRefs.size(); ++i) {
+      const TileAtlas::TileRef &ref = tileRefs[i];
+      templates.emit(ref.id, pos.x * 32, pos.y * 32, vert);
+      for (size_t j = 0; j < ref.quads; ++j) {
+        const uint16_t slot = slots[ref.prio][next[ref.prio]++];
+        memcpy(&tiles.vert[slot * 4], &vert[j * 4], quadDataSize(1));
+        tiles.quadBag[slot] = bagIndex(y, ref.prio);
+        tiles.dirty.push_back(slot);
+        quads.push_back(slot);
+      }
+    }
+    return true;
   }
 
-  static size_t quadDataSize(size_t quadCount)
+  /* Adds or frees the cells inside 'rect' but outside 'other' */
+  bool updateCells(const IntRect &rect, const IntRect &other, bool add)
   {
-    return quadCount * sizeof(SVertex) * 4;
+    for (int y = rect.y; y < rect.y + rect.h; ++y) {
+      bool sharedRow = y >= other.y && y < other.y + other.h;
+      for (int x = rect.x; x < rect.x + rect.w; ++x) {
+        if (sharedRow && x >= other.x && x < other.x + other.w) {
+          x = other.x + other.w - 1;
+          continue;
+        }
+        if (!add)
+          removeCell(x, y);
+        else if (!addCell(x, y))
+          return false;
+      }
+    }
+    return true;
   }
 
-  size_t zlayerSize(size_t index)
+  /* Moves the buffer contents along with the map viewport,
+   * false if everything has to be rebuilt instead */
+  bool scrollQuadArray()
   {
-    return zlayerBases[index+1] - zlayerBases[index];
+    if (!tiles.scrollable) return false;
+    if (tiles.cellQuads.size() != (size_t) (vw * vh)) return false;
+    Vec2i delta = viewpPos - tiles.pos;
+    if (abs(delta.x) >= vw || abs(delta.y) >= vh) return false;
+    if (abs(viewpPos.x - tiles.anchor.x) > anchorDriftMax ||
+        abs(viewpPos.y - tiles.anchor.y) > anchorDriftMax)
+      return false;
+    IntRect oldRect(tiles.pos, Vec2i(vw, vh));
+    IntRect newRect(viewpPos, Vec2i(vw, vh));
+    updateCells(oldRect, newRect, false);
+    if (!updateCells(newRect, oldRect, true)) return false;
+    tiles.pos = viewpPos;
+    return true;
   }
 
   void uploadBuffers()
   {
-    /* Calculate total quad count */
-    size_t groundQuadCount = groundVert.size() / 4;
-    size_t quadCount = groundQuadCount;
-    for (size_t i = 0; i < zlayersMax; ++i) {
-      zlayerBases[i] = quadCount;
-      quadCount += zlayerVert[i].size() / 4;
-    }
-    zlayerBases[zlayersMax] = quadCount;
+    size_t quadCount = tiles.quadBag.size();
     VBO::bind(tiles.vbo);
     VBO::allocEmpty(quadDataSize(quadCount));
-    VBO::uploadSubData(0, quadDataSize(groundQuadCount), dataPtr(groundVert));
-    for (size_t i = 0; i < zlayersMax; ++i) {
-      if (zlayerVert[i].empty()) continue;
-      VBO::uploadSubData(quadDataSize(zlayerBases[i]),
-        quadDataSize(zlayerSize(i)), dataPtr(zlayerVert[i]));
-    }
+    VBO::uploadSubData(0, quadDataSize(quadCount), dataPtr(tiles.vert));
     VBO::unbind();
+    tiles.dirty.clear();
     shState->ensureQuadIBO(quadCount);// Ensure global IBO size
   }
 
+  /* Uploads changed quads, in runs of neighbouring ones */
+  void uploadDirtyQuads()
+  {
+    std::vector<uint16_t> &dirty = tiles.dirty;
+    std::sort(dirty.begin(), dirty.end());
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+    VBO::bind(tiles.vbo);
+    for (size_t i = 0; i < dirty.size();) {
+      size_t j = i + 1;
+      while (j < dirty.size() && dirty[j] == dirty[j-1] + 1) { ++j; }
+      VBO::uploadSubData(quadDataSize(dirty[i]), quadDataSize(j - i),
+        &tiles.vert[dirty[i] * 4]);
+      i = j;
+    }
+    VBO::unbind();
+    dirty.clear();
+  }
+
+  bool fitsChunks()
+  {
+    const int maxSize = shState->config().staticTilemapSize;
+    if (mapData->xSize() == 0 || mapData->ySize() == 0) return false;
+    return mapData->xSize() <= maxSize && mapData->ySize() <= maxSize;
+  }
+
+  void releaseChunks()
+  {
+    for (size_t i = 0; i < chunks.list.size(); ++i) {
+      GLMeta::vaoFini(chunks.list[i].vao);
+      VBO::del(chunks.list[i].vbo);
+    }
+    chunks.list.clear();
+  }
+
+  void allocateChunks()
+  {
+    releaseChunks();
+    chunks.size = Vec2i((mapData->xSize() + chunkSize - 1) / chunkSize,
+                        (mapData->ySize() + chunkSize - 1) / chunkSize);
+    chunks.list.resize(chunks.size.x * chunks.size.y);
+    for (size_t i = 0; i < chunks.list.size(); ++i) {
+      TileChunk &chunk = chunks.list[i];
+      chunk.vbo = VBO::gen();
+      GLMeta::vaoFillInVertexData<SVertex>(chunk.vao);
+      chunk.vao.vbo = chunk.vbo;
+      chunk.vao.ibo = shState->globalIBO().ibo;
+      GLMeta::vaoInit(chunk.vao);
+    }
+    chunks.mapSize = Vec2i(mapData->xSize(), mapData->ySize());
+  }
+
+  void buildChunk(int cx, int cy)
+  {
+    TileChunk &chunk = chunks.list[cx + cy * chunks.size.x];
+    const Vec2i orig(cx * chunkSize, cy * chunkSize);
+    const IntRect rect(orig, Vec2i(std::min(chunkSize, mapData->xSize() - orig.x),
+                                   std::min(chunkSize, mapData->ySize() - orig.y)));
+    TileAtlas::collectTiles(templates, *mapData, rect, tileRefs);
+    size_t layerQuads[chunkLayers] = {0};
+    for (size_t i = 0; i < tileRefs.size(); ++i) {
+      const TileAtlas::TileRef &ref = tileRefs[i];
+      layerQuads[ref.prio == 0 ? 0 : ref.y + ref.prio] += ref.quads;
+    }
+    size_t layerNext[chunkLayers];
+    size_t quadCount = 0;
+    for (int i = 0; i < chunkLayers; ++i) {
+      chunk.bases[i] = layerNext[i] = quadCount;
+      quadCount += layerQuads[i];
+    }
+    chunk.bases[chunkLayers] = quadCount;
+    std::vector<SVertex> vert(quadCount * 4);
+    for (size_t i = 0; i < tileRefs.size(); ++i) {
+      const TileAtlas::TileRef &ref = tileRefs[i];
+      size_t &quad = layerNext[ref.prio == 0 ? 0 : ref.y + ref.prio];
+      templates.emit(ref.id, ref.x * 32, ref.y * 32, &vert[quad * 4]);
+      quad += ref.quads;
+    }
+    VBO::bind(chunk.vbo);
+    VBO::allocEmpty(quadDataSize(quadCount));
+    if (quadCount > 0)
+      VBO::uploadSubData(0, quadDataSize(quadCount), dataPtr(vert));
+    VBO::unbind();
+    shState->ensureQuadIBO(quadCount);
+  }
+
+  void updateChunks()
+  {
+    if (chunks.mapSize != Vec2i(mapData->xSize(), mapData->ySize()) ||
+        chunks.list.empty())
+      allocateChunks();
+    for (int cy = 0; cy < chunks.size.y; ++cy)
+      for (int cx = 0; cx < chunks.size.x; ++cx)
+        buildChunk(cx, cy);
+    tiles.pos = viewpPos;
+  }
+
+  /* Rebuilds the chunks touching the changed map cells */
+  void patchChunks()
+  {
+    std::vector<bool> stale(chunks.list.size(), false);
+    for (size_t z = 0; z < mapDirty.rects.size(); ++z) {
+      const IntRect &r = mapDirty.rects[z];
+      if (r.w == 0) continue;
+      for (int cy = r.y / chunkSize; cy * chunkSize < r.y + r.h; ++cy)
+        for (int cx = r.x / chunkSize; cx * chunkSize < r.x + r.w; ++cx)
+          stale[cx + cy * chunks.size.x] = true;
+    }
+    for (int cy = 0; cy < chunks.size.y; ++cy)
+      for (int cx = 0; cx < chunks.size.x; ++cx)
+        if (stale[cx + cy * chunks.size.x])
+          buildChunk(cx, cy);
+  }
+
+  /* Regenerates the map viewport cells showing changed map
+   * cells, wherever the map repeats inside of it */
+  bool patchQuadArray()
+  {
+    if (tiles.cellQuads.size() != (size_t) (vw * vh)) return false;
+    const int mw = mapData->xSize(), mh = mapData->ySize();
+    const IntRect window(tiles.pos, Vec2i(vw, vh));
+    for (size_t z = 0; z < mapDirty.rects.size(); ++z) {
+      const IntRect &r = mapDirty.rects[z];
+      if (r.w == 0) continue;
+      for (int ky = floorDiv(window.y, mh); ky * mh < window.y + window.h; ++ky) {
+        const int y0 = std::max(r.y + ky * mh, window.y);
+        const int y1 = std::min(r.y + r.h + ky * mh, window.y + window.h);
+        for (int kx = floorDiv(window.x, mw); kx * mw < window.x + window.w; ++kx) {
+          const int x0 = std::max(r.x + kx * mw, window.x);
+          const int x1 = std::min(r.x + r.w + kx * mw, window.x + window.w);
+          for (int y = y0; y < y1; ++y) {
+            for (int x = x0; x < x1; ++x) {
+              removeCell(x, y);
+              if (!addCell(x, y)) return false;
+            }
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  bool mapResized() const
+  {
+    return builtSize[0] != mapData->xSize() || builtSize[1] != mapData->ySize() ||
+           builtSize[2] != mapData->zSize();
+  }
+
+  /* Applies the map data changes, false if everything
+   * has to be rebuilt instead */
+  bool patchBuffers()
+  {
+    if (mapDirty.all || mapResized()) return false;
+    if (chunks.active) {
+      patchChunks();
+    } else {
+      if (!patchQuadArray()) return false;
+      uploadDirtyQuads();
+    }
+    updateSceneElements();
+    return true;
+  }
+
+  /* Goes through the chunks in sight, counting the quads of the
+   * zlayers 'first' to 'last' (map viewport relative, -1 meaning
+   * the ground layer) and drawing them if 'shader' is given.
+   * The map repeats past its edges, like the map viewport does */
+  size_t drawChunks(int first, int last, ShaderBase *shader)
+  {
+    const int mw = mapData->xSize(), mh = mapData->ySize();
+    const Vec2i origin = dispPos - viewpPos * 32;
+    size_t quads = 0;
+    for (int ky = floorDiv(viewpPos.y, mh); ky * mh < viewpPos.y + vh; ++ky) {
+      const int y0 = std::max(viewpPos.y - ky * mh, 0);
+      const int y1 = std::min(viewpPos.y + vh - ky * mh, mh);
+      for (int kx = floorDiv(viewpPos.x, mw); kx * mw < viewpPos.x + vw; ++kx) {
+        const int x0 = std::max(viewpPos.x - kx * mw, 0);
+        const int x1 = std::min(viewpPos.x + vw - kx * mw, mw);
+        for (int cy = y0 / chunkSize; cy * chunkSize < y1; ++cy) {
+          int lo = 0, hi = 0;
+          if (first >= 0) {
+            const int row = viewpPos.y - ky * mh - cy * chunkSize;
+            lo = std::max(1, row + first);
+            hi = std::min(chunkLayers - 1, row + last);
+            if (lo > hi) continue;
+          }
+          for (int cx = x0 / chunkSize; cx * chunkSize < x1; ++cx) {
+            TileChunk &chunk = chunks.list[cx + cy * chunks.size.x];
+            const size_t count = chunk.bases[hi+1] - chunk.bases[lo];
+            if (count == 0) continue;
+            quads += count;
+            if (!shader) continue;
+            GLMeta::vaoBind(chunk.vao);
+            shader->setTranslation(origin + Vec2i(kx * mw + cx * chunkSize,
+                                                  ky * mh + cy * chunkSize) * 32);
+            ++glState.drawCalls;
+            gl.DrawElements(GL_TRIANGLES, count * 6, _GL_INDEX_TYPE,
+              (GLvoid*) (chunk.bases[lo] * sizeof(index_t) * 6));
+            GLMeta::vaoUnbind(chunk.vao);
+          }
+        }
+      }
+    }
+    return quads;
+  }
+
+  /* Offset of vertex positions relative to the screen */
+  Vec2i tilesTranslation() const
+  {
+    return dispPos - (viewpPos - tiles.anchor) * 32;
+  }
+
   void bindShader(ShaderBase *&shaderVar)
   {
     if (tiles.animated) {
@@ -637,7 +1024,8 @@ struct TilemapPrivate
     /* Only allocate elements for non-emtpy zlayers */
     std::vector<int> zlayerInd;
     for (size_t i = 0; i < zlayersMax; ++i)
-      if (zlayerVert[i].size() > 0) zlayerInd.push_back(i);
+      if (chunks.active ? drawChunks(i, i, 0) > 0 : layerBag(i).live > 0)
+        zlayerInd.push_back(i);
     updateActiveElements(zlayerInd);
     elem.activeLayers = zlayerInd.size();
     zOrderDirty = false;
@@ -678,16 +1066,22 @@ struct TilemapPrivate
       ZLayer *batchHead = elem.zlayers[i];
       batchHead->batchedFlag = false;
       GLsizei vboBatchCount = batchHead->vboCount;
+      size_t batchLast = batchHead->index;
       IntruListLink<SceneElement> *iter = &batchHead->link;
       for (i = i+1; i < elem.activeLayers; ++i) {
         iter = iter->next;
         ZLayer *layer = elem.zlayers[i];
 // Is next SceneElement is the next zlayer? If not, the current batch is complete
         if (iter != &layer->link) break;
-        vboBatchCount += layer->vboCount;
+// Slots wrapping around break the batch too, spare room in between is degenerate
+        if (!chunks.active && layer->vboOffset < batchHead->vboOffset) break;
+        vboBatchCount = (layer->vboOffset - batchHead->vboOffset) / sizeof(index_t)
+          + layer->vboCount;
+        batchLast = layer->index;
         layer->batchedFlag = true;
       }
       batchHead->vboBatchCount = vboBatchCount;
+      batchHead->batchLast = batchLast;
       --i;
     }
   }
@@ -699,7 +1093,6 @@ struct TilemapPrivate
     set_dimensions(elem.sceneGeo.rect.w, elem.sceneGeo.rect.h);
     if (mvpPos != viewpPos) {
       viewpPos = mvpPos;
-      buffersDirty = true;
       updateFlashMapViewport();
     }
     dispPos = elem.sceneGeo.rect.pos() - wrap(combOrigin, 32);
@@ -724,10 +1117,39 @@ struct TilemapPrivate
       updateMapViewport();
       mapViewportDirty = false;
     }
+    /* Neither scrolling nor drawing copes with the old layout */
+    if (!buffersDirty && mapResized())
+      buffersDirty = true;
+    if (!buffersDirty && !mapDirty.empty()) {
+      buffersDirty = !patchBuffers();
+      mapDirty.clear();
+    }
+    if (!buffersDirty && tiles.pos != viewpPos) {
+      if (chunks.active) {
+        tiles.pos = viewpPos;
+        updateSceneElements();
+      } else if (scrollQuadArray()) {
+        uploadDirtyQuads();
+        updateSceneElements();
+      } else {
+        buffersDirty = true;
+      }
+    }
     if (buffersDirty) {
-      buildQuadArray();
-      uploadBuffers();
+      templates.build(atlas.efTilesetH, atlas.size.y, priorities);
+      chunks.active = fitsChunks();
+      if (chunks.active) {
+        updateChunks();
+      } else {
+        releaseChunks();
+        buildQuadArray();
+        uploadBuffers();
+      }
       updateSceneElements();
+      mapDirty.clear();
+      builtSize[0] = mapData->xSize();
+      builtSize[1] = mapData->ySize();
+      builtSize[2] = mapData->zSize();
       buffersDirty = false;
     }
     flashMap.prepare();
@@ -750,24 +1172,29 @@ GroundLayer::GroundLayer(TilemapPrivate *p, Viewport *viewport)
 
 void GroundLayer::updateVboCount()
 {
-  vboCount = p->zlayerBases[0] * 6;
+  vboCount = p->bags[0].count * 6;
 }
 
 void GroundLayer::draw()
 {
-  if (p->groundVert.size() == 0) return;
+  if (!p->chunks.active && p->bags[0].live == 0) return;
   ShaderBase *shader;
   p->bindShader(shader);
   p->bindAtlas(*shader);
-  GLMeta::vaoBind(p->tiles.vao);
-  shader->setTranslation(p->dispPos);
-  drawInt();
-  GLMeta::vaoUnbind(p->tiles.vao);
+  if (p->chunks.active) {
+    p->drawChunks(-1, -1, shader);
+  } else {
+    GLMeta::vaoBind(p->tiles.vao);
+    shader->setTranslation(p->tilesTranslation());
+    drawInt();
+    GLMeta::vaoUnbind(p->tiles.vao);
+  }
   p->flashMap.draw(flashAlpha[p->flashAlphaIdx] / 255.f, p->dispPos);
 }
 
 void GroundLayer::drawInt()
 {
+  ++glState.drawCalls;
   gl.DrawElements(GL_TRIANGLES, vboCount, _GL_INDEX_TYPE, (GLvoid*) 0);
 }
 
@@ -782,7 +1209,8 @@ ZLayer::ZLayer(TilemapPrivate *p, Viewport *viewport)
   vboOffset(0),
   vboCount(0),
   p(p),
-  vboBatchCount(0)
+  vboBatchCount(0),
+  batchLast(0)
 {}
 
 void ZLayer::setIndex(int value)
@@ -790,8 +1218,9 @@ void ZLayer::setIndex(int value)
   index = value;
   z = calculateZ(p, index);
   scene->reinsert(*this);
-  vboOffset = p->zlayerBases[index] * sizeof(index_t) * 6;
-  vboCount = p->zlayerSize(index) * 6;
+  const QuadBag &bag = p->layerBag(index);
+  vboOffset = bag.base * sizeof(index_t) * 6;
+  vboCount = bag.count * 6;
 }
 
 void ZLayer::draw()
@@ -800,14 +1229,19 @@ void ZLayer::draw()
   ShaderBase *shader;
   p->bindShader(shader);
   p->bindAtlas(*shader);
+  if (p->chunks.active) {
+    p->drawChunks(index, batchLast, shader);
+    return;
+  }
   GLMeta::vaoBind(p->tiles.vao);
-  shader->setTranslation(p->dispPos);
+  shader->setTranslation(p->tilesTranslation());
   drawInt();
   GLMeta::vaoUnbind(p->tiles.vao);
 }
 
 void ZLayer::drawInt()
 {
+  ++glState.drawCalls;
   gl.DrawElements(GL_TRIANGLES, vboBatchCount, _GL_INDEX_TYPE, (GLvoid*) vboOffset);
 }
 
@@ -866,13 +1300,16 @@ Tilemap::~Tilemap()
 
 void Tilemap::update()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   if (!p->tilemapReady) return;
   // Animate flash
   if (++p->flashAlphaIdx >= flashAlphaN) p->flashAlphaIdx = 0;
+  if (p->flashMap.active()) Graphics::markDirty();
   // Animate autotiles
   if (!p->tiles.animated) return;
-  p->tiles.frameIdx = atAnimation[p->tiles.aniIdx];
+  const int frameIdx = atAnimation[p->tiles.aniIdx];
+  if (p->tiles.frameIdx != frameIdx) Graphics::markDirty();
+  p->tiles.frameIdx = frameIdx;
   if (++p->tiles.aniIdx >= atAnimationN)
     p->tiles.aniIdx = 0;
 }
@@ -914,7 +1351,7 @@ void Tilemap::setMapData(Table *value)
   p->invalidateBuffers();
   p->mapDataCon.disconnect();
   p->mapDataCon = value->modified.connect
-    (sigc::mem_fun(p, &TilemapPrivate::invalidateBuffers));
+    (sigc::mem_fun(p, &TilemapPrivate::onMapDataModified));
 }
 
 void Tilemap::setFlashData(Table *value)
@@ -73,6 +73,11 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
   uint8_t flashAlphaIdx;
   bool atlasDirty;
   bool buffersDirty;
+  /* Map data cells changed since the last rebuild */
+  TableDirty mapDirty;
+  /* Map data size of the last rebuild, as Table
+   * resizes emit no 'modified' */
+  int builtSize[3];
   bool mapViewportDirty;
   sigc::connection mapDataCon;
   sigc::connection flagsCon;
@@ -111,6 +116,7 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
     above(this, viewport)
   {
     memset(bitmaps, 0, sizeof(bitmaps));
+    builtSize[0] = builtSize[1] = builtSize[2] = -1;
     shState->requestAtlasTex(ATLASVX_W, ATLASVX_H, atlas);
     vbo = VBO::gen();
     GLMeta::vaoFillInVertexData<SVertex>(vao);
@@ -144,6 +150,29 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
   void invalidateBuffers()
   {
     buffersDirty = true;
+    Graphics::markDirty();
+  }
+
+  void onMapDataModified()
+  {
+    mapDirty.add(*mapData);
+    Graphics::markDirty();
+  }
+
+  /* Whether any changed map cell shows up in the map viewport.
+   * Quads are laid out layer by layer and table tiles reach into
+   * their neighbours, so changes inside still rebuild it all */
+  bool mapViewportTouched()
+  {
+    if (mapDirty.all) return true;
+    for (size_t z = 0; z < mapDirty.rects.size(); ++z) {
+      const IntRect &r = mapDirty.rects[z];
+      if (r.w == 0) continue;
+      if (wrappedOverlap(r.x, r.w, mapViewp.x, mapViewp.w, mapData->xSize()) &&
+          wrappedOverlap(r.y, r.h, mapViewp.y, mapViewp.h, mapData->ySize()))
+        return true;
+    }
+    return false;
   }
 
   void rebuildAtlas()
@@ -195,6 +224,15 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
     VBO::uploadSubData(quadBytes(groundQuads), quadBytes(aboveQuads), dataPtr(aboveVert));
     VBO::unbind();
     shState->ensureQuadIBO(totalQuads);
+    builtSize[0] = mapData->xSize();
+    builtSize[1] = mapData->ySize();
+    builtSize[2] = mapData->zSize();
+  }
+
+  bool mapResized() const
+  {
+    return builtSize[0] != mapData->xSize() || builtSize[1] != mapData->ySize() ||
+           builtSize[2] != mapData->zSize();
   }
 
   void prepare()
@@ -208,6 +246,11 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
       updateMapViewport();
       mapViewportDirty = false;
     }
+    if (!mapDirty.empty()) {
+      if (mapViewportTouched()) buffersDirty = true;
+      mapDirty.clear();
+    }
+    if (mapResized()) buffersDirty = true;
     if (buffersDirty) {
       rebuildBuffers();
       buffersDirty = false;
@@ -247,6 +290,7 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
     shader->setTranslation(dispPos);
     TEX::bind(atlas.tex);
     GLMeta::vaoBind(vao);
+    ++glState.drawCalls;
     gl.DrawElements(GL_TRIANGLES, groundQuads*6, _GL_INDEX_TYPE, 0);
     GLMeta::vaoUnbind(vao);
   }
@@ -261,6 +305,7 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
     shader.setTranslation(dispPos);
     TEX::bind(atlas.tex);
     GLMeta::vaoBind(vao);
+    ++glState.drawCalls;
     gl.DrawElements(GL_TRIANGLES, aboveQuads*6, _GL_INDEX_TYPE,
       (GLvoid*) (groundQuads*6*sizeof(index_t)));
     GLMeta::vaoUnbind(vao);
@@ -327,7 +372,7 @@ TilemapVX::~TilemapVX()
 
 void TilemapVX::update()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   /* Animate tiles */
   if (++p->frameIdx >= 30*3*4) p->frameIdx = 0;
   const uint8_t aniIndicesA[3*4] =
@@ -336,9 +381,12 @@ void TilemapVX::update()
       { 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2 };
   uint8_t aniIdxA = aniIndicesA[p->frameIdx / 30];
   uint8_t aniIdxC = aniIndicesC[p->frameIdx / 30];
-  p->aniOffset = Vec2(aniIdxA * 2 * 32, aniIdxC * 32);
+  const Vec2 aniOffset(aniIdxA * 2 * 32, aniIdxC * 32);
+  if (!(p->aniOffset == aniOffset)) Graphics::markDirty();
+  p->aniOffset = aniOffset;
   /* Animate flash */
   if (++p->flashAlphaIdx >= flashAlphaN) p->flashAlphaIdx = 0;
+  if (p->flashMap.active()) Graphics::markDirty();
 }
 
 TilemapVX::BitmapArray &TilemapVX::getBitmapArray()
@@ -380,7 +428,7 @@ void TilemapVX::setMapData(Table *value)
   p->buffersDirty = true;
   p->mapDataCon.disconnect();
   p->mapDataCon = value->modified.connect
-    (sigc::mem_fun(p, &TilemapVXPrivate::invalidateBuffers));
+    (sigc::mem_fun(p, &TilemapVXPrivate::onMapDataModified));
 }
 
 void TilemapVX::setFlashData(Table *value)
@@ -26,6 +26,7 @@
 #include <string>
 #include <algorithm>
 #include <vector>
+#include <stdint.h>
 
 static inline int wrapRange(int value, int min, int max)
 {
@@ -77,6 +78,31 @@ inline void strReplace(std::string &str, char before, char after)
       str[i] = after;
 }
 
+/* http://www.lemoda.net/c/utf8-to-ucs2/index.html */
+static inline uint16_t utf8_to_ucs2(const char *_input, const char **end_ptr)
+{
+  const unsigned char *input = reinterpret_cast<const unsigned char*>(_input);
+  *end_ptr = _input;
+  if (input[0] == 0) return -1;
+  if (input[0] < 0x80) {
+    *end_ptr = _input + 1;
+    return input[0];
+  }
+  if ((input[0] & 0xE0) == 0xE0) {
+    if (input[1] == 0 || input[2] == 0) return -1;
+    *end_ptr = _input + 3;
+    return (input[0] & 0x0F)<<12 |
+           (input[1] & 0x3F)<<6  |
+           (input[2] & 0x3F);
+  }
+  if ((input[0] & 0xC0) == 0xC0) {
+    if (input[1] == 0) return -1;
+    *end_ptr = _input + 2;
+    return (input[0] & 0x1F)<<6 | (input[1] & 0x3F);
+  }
+  return -1;
+}
+
 /* Check if [C]ontainer contains [V]alue */
 template<typename C, typename V>
 inline bool contains(const C &c, const V &v)
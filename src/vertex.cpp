@@ -53,6 +53,22 @@ static const VertexAttribute VertexAttribs[] =
 	{ Shader::TexCoord, 2, GL_FLOAT, o(Vertex, texPos) }
 };
 
+static const VertexAttribute WVertexAttribs[] =
+{
+	{ Shader::Position, 2, GL_FLOAT, o(WVertex, pos)    },
+	{ Shader::TexCoord, 2, GL_FLOAT, o(WVertex, texPos) },
+	{ Shader::WaveY,    1, GL_FLOAT, o(WVertex, waveY)  }
+};
+
+static const VertexAttribute BVertexAttribs[] =
+{
+	{ Shader::Position, 2, GL_FLOAT, o(BVertex, pos)    },
+	{ Shader::TexCoord, 2, GL_FLOAT, o(BVertex, texPos) },
+	{ Shader::Color,    4, GL_FLOAT, o(BVertex, color)  },
+	{ Shader::Tone,     4, GL_FLOAT, o(BVertex, tone)   },
+	{ Shader::Effect,   4, GL_FLOAT, o(BVertex, effect) }
+};
+
 #define DEF_TRAITS(VertType) \
 	template<> \
 	const VertexAttribute *VertexTraits<VertType>::attr = VertType##Attribs; \
@@ -62,3 +78,5 @@ static const VertexAttribute VertexAttribs[] =
 DEF_TRAITS(SVertex);
 DEF_TRAITS(CVertex);
 DEF_TRAITS(Vertex);
+DEF_TRAITS(WVertex);
+DEF_TRAITS(BVertex);
@@ -46,6 +46,24 @@ struct Vertex
   Vec4 color;
   Vertex();
 };
+/* Wave Vertex, 'waveY' being the first row of its chunk */
+struct WVertex
+{
+  Vec2 pos;
+  Vec2 texPos;
+  float waveY;
+};
+/* Batched sprite Vertex, carrying what SpriteShader
+ * otherwise takes as uniforms. 'effect' holds opacity,
+ * bush depth (normalized) and bush opacity */
+struct BVertex
+{
+  Vec2 pos;
+  Vec2 texPos;
+  Vec4 color;
+  Vec4 tone;
+  Vec4 effect;
+};
 
 struct VertexAttribute
 {
@@ -116,7 +116,7 @@ Viewport::~Viewport()
 
 void Viewport::update()
 {
-  guardDisposed();
+  guardDisposedQuiet();
   Flashable::update();
 }
 
@@ -393,7 +393,7 @@ struct WindowPrivate
       if (openMode == 3) sceneOffset.y = size.y - baseTex.height;
     }
     TEX::bind(baseTex.tex);
-    TEX::allocEmpty(baseTex.width, baseTex.height);
+    TEX::allocEmpty(baseTex.texW, baseTex.texH);
     TEX::unbind();
     FBO::bind(baseTex.fbo);
     glState.viewport.pushSet(IntRect(0, 0, baseTex.width, baseTex.height));
@@ -492,7 +492,7 @@ struct WindowPrivate
     shader.applyViewportProj();
     shader.setTranslation(position + sceneOffset);
     if (useBaseTex) {
-      shader.setTexSize(Vec2i(baseTex.width, baseTex.height));
+      shader.setTexSize(Vec2i(baseTex.texW, baseTex.texH));
       TEX::bind(baseTex.tex);
       baseTexQuad.draw();
     } else {
@@ -578,7 +578,7 @@ struct WindowVXPrivate
     shader.applyViewportProj();
     if (windowskinValid) {
       shader.setTranslation(trans);
-      shader.setTexSize(Vec2i(base.tex.width, base.tex.height));
+      shader.setTexSize(Vec2i(base.tex.texW, base.tex.texH));
       TEX::bind(base.tex.tex);
       base.quad.draw();
       if (openness < 255) return;